@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include "arena.h"
+
+bool requestArena::m_debug = false;
+thread_local requestArena* requestArena::m_local = NULL;
+
+// 全局operator new计数，用于检查稳定状态下处理请求是否仍有堆分配
+static thread_local size_t heapCount = 0;
+
+void* operator new(size_t size){
+    heapCount++;
+    void* p = malloc(size ? size : 1);
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+size_t requestArena::heapAllocations(){
+    return heapCount;
+}
+
+requestArena* requestArena::local(){
+    if(!m_local){
+        // 线程退出时不释放，工作线程与进程同生命周期
+        m_local = new requestArena;
+        m_local->m_heapMark = heapCount;
+    }
+    return m_local;
+}
+
+void* requestArena::do_allocate(size_t bytes, size_t align){
+    m_bytes += bytes;
+    m_count++;
+    if(bytes > ARENA_BLOCK_SIZE / 2){
+        char* p = new char[bytes + align];
+        m_large.push_back(p);
+        m_newBlocks++;
+        return (void*)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+    }
+    while(true){
+        if(m_current < m_blocks.size()){
+            uintptr_t base = (uintptr_t)m_blocks[m_current];
+            uintptr_t p = (base + m_used + align - 1) & ~(uintptr_t)(align - 1);
+            if(p + bytes <= base + ARENA_BLOCK_SIZE){
+                m_used = p + bytes - base;
+                return (void*)p;
+            }
+            m_current++;
+            m_used = 0;
+            continue;
+        }
+        m_blocks.push_back(new char[ARENA_BLOCK_SIZE]);
+        m_newBlocks++;
+    }
+}
+
+void requestArena::reset(){
+    if(m_debug && (m_count > 0 || heapCount != m_heapMark)){
+        printf("arena: %zu bytes in %zu allocations, %zu new blocks, %zu operator new\n",
+            m_bytes, m_count, m_newBlocks, heapCount - m_heapMark);
+    }
+    for(size_t i = 0; i < m_large.size(); i++){
+        delete [] m_large[i];
+    }
+    m_large.clear();
+    while(m_blocks.size() > ARENA_RETAIN_BLOCKS){
+        delete [] m_blocks.back();
+        m_blocks.pop_back();
+    }
+    m_current = 0;
+    m_used = 0;
+    m_bytes = 0;
+    m_count = 0;
+    m_newBlocks = 0;
+    m_heapMark = heapCount;
+}
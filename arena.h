@@ -0,0 +1,53 @@
+// 请求内存池：每个工作线程1个按块分配的arena，请求处理结束时整体回收，
+// 处理请求时使用的std::pmr容器从中分配，稳定状态下不访问全局堆；
+// 调试模式(-m)在每次处理结束时输出arena用量和本线程operator new的次数
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include <memory_resource>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)            // 每块大小，超过半块的分配单独申请
+#define ARENA_RETAIN_BLOCKS 16                  // 回收时保留的块数，超出的归还全局堆
+
+class requestArena : public std::pmr::memory_resource{
+    public:
+        static requestArena* local();           // 本线程的arena，首次调用时创建
+
+        // 处理结束：保留已申请的块，下一个请求从头复用；调试模式输出本次用量
+        void reset();
+
+        static void setDebug(bool on){ m_debug = on; }
+
+        size_t bytes() const { return m_bytes; } // 本次处理分配的字节数
+        size_t allocations() const { return m_count; }
+
+        static size_t heapAllocations();        // 本线程累计的operator new次数
+
+        // 离开作用域时回收，工作线程处理请求的入口处声明；挂起后继续执行的协程不能使用arena
+        class scope{
+            public:
+                ~scope(){ requestArena::local()->reset(); }
+        };
+
+    private:
+        requestArena() : m_current(0), m_used(0), m_bytes(0), m_count(0), m_newBlocks(0), m_heapMark(0){}
+
+        void* do_allocate(size_t bytes, size_t align) override;
+        void do_deallocate(void*, size_t, size_t) override {} // 整体回收，单个释放不做处理
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+        std::vector<char*> m_blocks;            // 标准大小的块
+        std::vector<char*> m_large;             // 超大分配，回收时释放
+        size_t m_current;                       // 当前块的下标
+        size_t m_used;                          // 当前块已用的字节
+        size_t m_bytes;
+        size_t m_count;
+        size_t m_newBlocks;                     // 本次处理向全局堆申请的块数
+        size_t m_heapMark;                      // 上次回收时的operator new次数
+
+        static bool m_debug;
+        static thread_local requestArena* m_local;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include <string.h>
+#include "bufferPool.h"
+
+size_t bufferPool::m_size = 0;
+std::vector<char*> bufferPool::m_free;
+locker bufferPool::m_lock;
+
+void bufferPool::init(size_t size){
+    m_size = size;
+    // 预留空间，归还时不再分配
+    m_free.reserve(BUFFER_POOL_RETAIN);
+}
+
+char* bufferPool::get(){
+    char* buf = NULL;
+    m_lock.lock();
+    if(!m_free.empty()){
+        buf = m_free.back();
+        m_free.pop_back();
+    }
+    m_lock.unlock();
+    if(!buf){
+        buf = new char[m_size];
+    }
+    // 解析依赖读缓冲中未写入的部分为'\0'
+    memset(buf, 0, m_size);
+    return buf;
+}
+
+void bufferPool::put(char* buf){
+    if(!buf){
+        return;
+    }
+    m_lock.lock();
+    if(m_free.size() < BUFFER_POOL_RETAIN){
+        m_free.push_back(buf);
+        buf = NULL;
+    }
+    m_lock.unlock();
+    delete [] buf;
+}
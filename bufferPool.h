@@ -0,0 +1,27 @@
+// 连接缓冲池：连接处理请求期间从池中取得读写缓冲，keep-alive空闲时归还，
+// 大量空闲连接只占用连接对象本身；池中保留的空闲缓冲有上限，超出的归还全局堆
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+#include <stddef.h>
+#include <vector>
+#include "locker.h"
+
+#define BUFFER_POOL_RETAIN 1024                 // 池中最多保留的空闲缓冲数
+
+class bufferPool{
+    public:
+        static void init(size_t size);          // 每个缓冲的字节数，启动时设置1次
+
+        // 取得1个清零的缓冲，reactor和工作线程都会调用
+        static char* get();
+
+        // 归还缓冲，NULL不做处理
+        static void put(char* buf);
+
+    private:
+        static size_t m_size;
+        static std::vector<char*> m_free;
+        static locker m_lock;
+};
+
+#endif
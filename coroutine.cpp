@@ -0,0 +1,168 @@
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "coroutine.h"
+#include "httpConnect.h"
+#include "arena.h"
+
+// 静态变量初始化
+int coScheduler::m_eventfd = -1;
+locker coScheduler::schedLock;
+std::vector<std::coroutine_handle<> > coScheduler::readyQueue;
+std::priority_queue<coScheduler::timer, std::vector<coScheduler::timer>, std::greater<coScheduler::timer> > coScheduler::timers;
+
+extern void addfd(int epollfd, int fd, bool oneshot);
+
+coTask::promise_type::promise_type(httpConnect* conn) : m_conn(conn), m_generation(conn->generation()){
+}
+
+bool coTask::promise_type::alive() const{
+    return m_conn->generation() == m_generation && m_conn->socketfd() != -1;
+}
+
+// 协程执行结束，由连接发送响应
+void coTask::promise_type::return_void(){
+    if(alive()){
+        m_conn->handlerDone();
+    }
+}
+
+void coTask::promise_type::unhandled_exception(){
+    if(alive()){
+        m_conn->setResponse(500, "Internal Error", "There was an unusual problem serving the requested file.\n");
+        m_conn->handlerDone();
+    }
+}
+
+// 挂起协程，在连接上等待事件；连接已关闭则不挂起
+bool ioAwaiter::await_suspend(coHandle h){
+    if(!h.promise().alive()){
+        ok = false;
+        return false;
+    }
+    ok = true;
+    return h.promise().m_conn->waitEvent(h, &ok, events);
+}
+
+void timerAwaiter::await_suspend(coHandle h){
+    handle = h;
+    coScheduler::addTimer(ms, h);
+}
+
+bool timerAwaiter::await_resume(){
+    return !handle || handle.promise().alive();
+}
+
+void coFileOp::process(){
+    result = pread(fd, buf, len, offset);
+    coScheduler::post(handle);
+}
+
+bool fileAwaiter::await_suspend(std::coroutine_handle<> h){
+    op.handle = h;
+    if(!coScheduler::submitRead(&op)){
+        // I/O队列已满，同步读取
+        op.result = pread(op.fd, op.buf, op.len, op.offset);
+        return false;
+    }
+    return true;
+}
+
+void coBlockingOp::process(){
+    // fn可能使用arena(如生成响应)，在本线程结束时回收
+    requestArena::scope arenaScope;
+    fn();
+    coScheduler::post(handle);
+}
+
+bool blockingAwaiter::await_suspend(coHandle h){
+    handle = h;
+    op.handle = h;
+    if(!coScheduler::submitBlocking(&op)){
+        // I/O队列已满，在当前线程执行
+        op.fn();
+        return false;
+    }
+    return true;
+}
+
+void coScheduler::init(int epollfd){
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_eventfd == -1){
+        throw std::exception();
+    }
+    addfd(epollfd, m_eventfd, false);
+}
+
+long long coScheduler::now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void coScheduler::wakeup(){
+    uint64_t one = 1;
+    ::write(m_eventfd, &one, sizeof(one));
+}
+
+void coScheduler::post(std::coroutine_handle<> h){
+    schedLock.lock();
+    readyQueue.push_back(h);
+    schedLock.unlock();
+    wakeup();
+}
+
+void coScheduler::addTimer(int ms, std::coroutine_handle<> h){
+    schedLock.lock();
+    timers.push(timer{now() + ms, h});
+    schedLock.unlock();
+    // 可能早于reactor当前的超时时间，唤醒以重新计算
+    wakeup();
+}
+
+bool coScheduler::submitRead(coFileOp* op){
+    return diskIO::append(op);
+}
+
+bool coScheduler::submitBlocking(coBlockingOp* op){
+    return diskIO::append(op);
+}
+
+int coScheduler::nextTimeout(){
+    schedLock.lock();
+    int timeout = -1;
+    if(!timers.empty()){
+        long long diff = timers.top().expire - now();
+        timeout = diff > 0 ? (int)diff : 0;
+    }
+    schedLock.unlock();
+    return timeout;
+}
+
+void coScheduler::runTimers(){
+    long long cur = now();
+    std::vector<std::coroutine_handle<> > expired;
+    schedLock.lock();
+    while(!timers.empty() && timers.top().expire <= cur){
+        expired.push_back(timers.top().handle);
+        timers.pop();
+    }
+    schedLock.unlock();
+    for(size_t i = 0; i < expired.size(); i++){
+        expired[i].resume();
+    }
+}
+
+void coScheduler::runReady(){
+    uint64_t cnt;
+    // ET模式，读空eventfd计数
+    while(::read(m_eventfd, &cnt, sizeof(cnt)) > 0){
+    }
+    std::vector<std::coroutine_handle<> > ready;
+    schedLock.lock();
+    ready.swap(readyQueue);
+    schedLock.unlock();
+    for(size_t i = 0; i < ready.size(); i++){
+        ready[i].resume();
+    }
+}
@@ -0,0 +1,153 @@
+// C++20协程：请求处理函数可以co_await socket就绪、文件读取和定时器，由reactor恢复执行
+#ifndef COROUTINE_H
+#define COROUTINE_H
+#include <coroutine>
+#include <functional>
+#include <vector>
+#include <queue>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include "locker.h"
+#include "diskIO.h"
+
+class httpConnect;
+
+// 协程处理函数的返回类型，协程帧由自身管理，结束时通知所属连接发送响应
+class coTask{
+    public:
+        struct promise_type{
+            // 协程的第1个参数即所属连接，记录连接的代数以识别fd被复用的情况
+            promise_type(httpConnect* conn);
+
+            coTask get_return_object(){
+                return coTask();
+            }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void();
+            void unhandled_exception();
+
+            // 连接仍是启动协程时的那个连接
+            bool alive() const;
+
+            httpConnect* m_conn;
+            unsigned int m_generation;
+        };
+};
+
+// 协程处理函数：coTask handler(httpConnect* conn)
+typedef coTask (*coHandler)(httpConnect* conn);
+
+typedef std::coroutine_handle<coTask::promise_type> coHandle;
+
+// 等待连接socket可读/可写，连接关闭时以false恢复
+struct ioAwaiter{
+    int events;
+    bool ok;
+    bool await_ready(){ return false; }
+    bool await_suspend(coHandle h);
+    bool await_resume(){ return ok; }
+};
+
+// 定时器：co_await sleepFor(ms)，返回时连接是否仍然有效
+struct timerAwaiter{
+    int ms;
+    bool ok;
+    coHandle handle;
+    bool await_ready(){ return ms <= 0; }
+    void await_suspend(coHandle h);
+    bool await_resume();
+};
+
+// 文件读取：在磁盘I/O线程中pread，完成后交回reactor恢复
+struct coFileOp : public ioTask{
+    int fd;
+    char* buf;
+    size_t len;
+    off_t offset;
+    ssize_t result;
+    std::coroutine_handle<> handle;
+    void process();                     // 由磁盘I/O线程调用
+};
+
+struct fileAwaiter{
+    coFileOp op;
+    bool await_ready(){ return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    ssize_t await_resume(){ return op.result; }
+};
+
+// 阻塞操作(数据库、密码哈希等)：在磁盘I/O线程中执行fn，完成后交回reactor恢复
+struct coBlockingOp : public ioTask{
+    std::function<void()> fn;
+    std::coroutine_handle<> handle;
+    void process();                     // 由磁盘I/O线程调用
+};
+
+struct blockingAwaiter{
+    coBlockingOp op;
+    coHandle handle;
+    bool await_ready(){ return false; }
+    bool await_suspend(coHandle h);
+    bool await_resume(){ return handle.promise().alive(); }
+};
+
+inline ioAwaiter waitReadable(){ return ioAwaiter{EPOLLIN, false}; }
+inline ioAwaiter waitWritable(){ return ioAwaiter{EPOLLOUT, false}; }
+inline timerAwaiter sleepFor(int ms){ return timerAwaiter{ms, false, coHandle()}; }
+inline fileAwaiter readFile(int fd, char* buf, size_t len, off_t offset){
+    fileAwaiter a;
+    a.op.fd = fd;
+    a.op.buf = buf;
+    a.op.len = len;
+    a.op.offset = offset;
+    a.op.result = -1;
+    return a;
+}
+// 返回时连接是否仍然有效；fn期间连接没有注册事件，仍由协程独占
+inline blockingAwaiter runBlocking(std::function<void()> fn){
+    blockingAwaiter a;
+    a.op.fn = std::move(fn);
+    return a;
+}
+
+// 协程调度器：运行在reactor线程，负责定时器和跨线程恢复
+class coScheduler{
+    public:
+        static void init(int epollfd);
+
+        static int m_eventfd;                   // 其他线程通过eventfd唤醒reactor
+
+        // 线程安全：将协程交给reactor恢复
+        static void post(std::coroutine_handle<> h);
+
+        // 线程安全：ms毫秒后由reactor恢复
+        static void addTimer(int ms, std::coroutine_handle<> h);
+
+        static bool submitRead(coFileOp* op);
+
+        static bool submitBlocking(coBlockingOp* op);
+
+        // epoll_wait的超时时间，无定时器时为-1
+        static int nextTimeout();
+
+        static void runTimers();                // reactor每轮调用，恢复到期的协程
+
+        static void runReady();                 // eventfd可读时调用，恢复就绪的协程
+
+    private:
+        struct timer{
+            long long expire;
+            std::coroutine_handle<> handle;
+            bool operator>(const timer& t) const { return expire > t.expire; }
+        };
+
+        static long long now();
+        static void wakeup();
+
+        static locker schedLock;
+        static std::vector<std::coroutine_handle<> > readyQueue;
+        static std::priority_queue<timer, std::vector<timer>, std::greater<timer> > timers;
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <algorithm>
+#include <memory>
+#include "dirIndex.h"
+
+int dirIndex::m_inotifyfd = -1;
+bool dirIndex::m_autoindex = false;
+rwlocker dirIndex::indexLock;
+std::unordered_map<std::string, dirIndex::dirState*, dirIndex::pathHash, std::equal_to<> > dirIndex::byPath;
+std::unordered_map<int, dirIndex::dirState*> dirIndex::byWatch;
+
+extern void addfd(int epollfd, int fd, bool oneshot);
+
+// 条目增删、写入完成、属性变化，以及目录自身被删除或移走
+#define DIR_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB \
+                        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+void dirIndex::init(int epollfd, bool autoindex){
+    m_autoindex = autoindex;
+    if(!autoindex){
+        return;
+    }
+    m_inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_inotifyfd == -1){
+        throw std::exception();
+    }
+    addfd(epollfd, m_inotifyfd, false);
+}
+
+// 隐藏文件不出现在列表中
+static bool hidden(const char* name){
+    return name[0] == '.';
+}
+
+bool dirIndex::load(dirState* d){
+    DIR* dir = opendir(d->fsPath.c_str());
+    if(!dir){
+        return false;
+    }
+    d->large = false;
+    struct dirent* de;
+    while((de = readdir(dir)) != NULL){
+        if(!hidden(de->d_name)){
+            update(d, de->d_name);
+        }
+        if(d->entries.size() > DIR_INDEX_MAX_ENTRIES){
+            d->large = true;
+            d->entries.clear();
+            break;
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+void dirIndex::update(dirState* d, const char* name){
+    std::string path = d->fsPath + "/" + name;
+    struct stat st;
+    if(stat(path.c_str(), &st) < 0 || !(st.st_mode & S_IROTH)){
+        d->entries.erase(name);
+        return;
+    }
+    entry& e = d->entries[name];
+    e.isDir = S_ISDIR(st.st_mode);
+    e.size = st.st_size;
+    e.mtime = st.st_mtime;
+}
+
+// HTML文本转义
+static void appendHtml(std::string& out, const std::string& s){
+    for(char c : s){
+        switch(c){
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += c;
+        }
+    }
+}
+
+// 链接中的文件名按百分号编码
+static void appendUri(std::string& out, const std::string& s){
+    static const char hex[] = "0123456789ABCDEF";
+    for(unsigned char c : s){
+        if(isalnum(c) || strchr("-._~!$&'()*+,;=:@/", c)){
+            out += c;
+        }else{
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+}
+
+static void appendJson(std::string& out, const std::string& s){
+    char buf[8];
+    for(unsigned char c : s){
+        if(c == '"' || c == '\\'){
+            out += '\\';
+            out += c;
+        }else if(c < 0x20){
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }else{
+            out += c;
+        }
+    }
+}
+
+// 列表的开头：JSON数组的'['，HTML的标题和上级目录链接
+static void appendHead(std::string& out, const std::string& urlPath, bool json){
+    if(json){
+        out += '[';
+        return;
+    }
+    out += "<html><head><meta charset=\"utf-8\"><title>Index of ";
+    appendHtml(out, urlPath);
+    out += "</title></head><body><h1>Index of ";
+    appendHtml(out, urlPath);
+    out += "</h1><hr><pre>\n";
+    if(urlPath != "/"){
+        out += "<a href=\"../\">../</a>\n";
+    }
+}
+
+static void appendTail(std::string& out, bool json){
+    out += json ? "]\n" : "</pre><hr></body></html>\n";
+}
+
+// 单个条目；first表示JSON数组的第1个元素
+static void appendEntry(std::string& out, const std::string& urlPath, const std::string& name,
+    bool isDir, off_t size, time_t mtime, bool json, bool first){
+    char buf[128];
+    if(json){
+        out += first ? "{\"name\":\"" : ",{\"name\":\"";
+        appendJson(out, name);
+        snprintf(buf, sizeof(buf), "\",\"type\":\"%s\",\"size\":%lld,\"mtime\":%lld}",
+            isDir ? "directory" : "file", (long long)size, (long long)mtime);
+        out += buf;
+        return;
+    }
+    out += "<a href=\"";
+    appendUri(out, urlPath);
+    appendUri(out, name);
+    out += isDir ? "/\">" : "\">";
+    appendHtml(out, name);
+    out += isDir ? "/</a>" : "</a>";
+    struct tm tm;
+    gmtime_r(&mtime, &tm);
+    strftime(buf, sizeof(buf), "%d-%b-%Y %H:%M", &tm);
+    int pad = 50 - (int)name.size() - (isDir ? 1 : 0);
+    out.append(pad > 1 ? pad : 1, ' ');
+    out += buf;
+    if(isDir){
+        out += "                   -\n";
+    }else{
+        snprintf(buf, sizeof(buf), "%20lld\n", (long long)size);
+        out += buf;
+    }
+}
+
+cacheEntryPtr dirIndex::serialize(const dirState* d, bool json){
+    std::string out;
+    appendHead(out, d->urlPath, json);
+    // HTML中子目录在前，文件在后，各自按名称排序；JSON按名称排序
+    bool first = true;
+    for(int pass = 0; pass < 2; pass++){
+        for(auto& it : d->entries){
+            if(!json && it.second.isDir != (pass == 0)){
+                continue;
+            }
+            appendEntry(out, d->urlPath, it.first, it.second.isDir, it.second.size, it.second.mtime, json, first);
+            first = false;
+        }
+        if(json){
+            break;
+        }
+    }
+    appendTail(out, json);
+
+    cacheEntryPtr e = std::make_shared<cacheEntry>();
+    e->path = d->urlPath;
+    e->size = out.size();
+    e->data = new char[e->size];
+    memcpy(e->data, out.data(), e->size);
+    e->mtime = {0, 0};
+    e->checkTime.store(0, std::memory_order_relaxed);
+    return e;
+}
+
+cacheEntryPtr dirIndex::listing(std::string_view fsPath, std::string_view urlPath, bool json, bool* large){
+    // 已缓存且未变化，直接返回序列化结果
+    cacheEntryPtr e;
+    *large = false;
+    indexLock.rdlock();
+    auto it = byPath.find(fsPath);
+    if(it != byPath.end()){
+        e = json ? it->second->json : it->second->html;
+        *large = it->second->large;
+    }
+    indexLock.unlock();
+    if(e || *large){
+        return e;
+    }
+
+    indexLock.wrlock();
+    it = byPath.find(fsPath);
+    dirState* d = it != byPath.end() ? it->second : NULL;
+    if(!d && byWatch.size() < DIR_INDEX_MAX){
+        // 先添加监视再读取目录，读取期间的变化不会丢失
+        int wd = inotify_add_watch(m_inotifyfd, std::string(fsPath).c_str(), DIR_WATCH_MASK);
+        if(wd >= 0 && byWatch.find(wd) == byWatch.end()){
+            d = new dirState;
+            d->wd = wd;
+            d->fsPath = fsPath;
+            d->urlPath = urlPath;
+            if(!load(d)){
+                inotify_rm_watch(m_inotifyfd, wd);
+                delete d;
+                indexLock.unlock();
+                return e;
+            }
+            byPath[d->fsPath] = d;
+            byWatch[wd] = d;
+        }
+    }
+    if(d){
+        // 条目过多的目录保留监视，之后的请求不必再读取就能确定流式生成
+        *large = d->large;
+        cacheEntryPtr& slot = json ? d->json : d->html;
+        if(!slot && !d->large){
+            slot = serialize(d, json);
+        }
+        e = slot;
+        indexLock.unlock();
+        return e;
+    }
+    indexLock.unlock();
+
+    // 监视数已达上限(或同一目录经不同路径访问)，现场生成，不缓存
+    dirState tmp;
+    tmp.wd = -1;
+    tmp.fsPath = fsPath;
+    tmp.urlPath = urlPath;
+    if(load(&tmp)){
+        *large = tmp.large;
+        if(!tmp.large){
+            e = serialize(&tmp, json);
+        }
+    }
+    return e;
+}
+
+// 流式生成的状态，随生产者在连接关闭或响应结束时释放
+struct dirStreamState{
+    DIR* dir;
+    std::string urlPath;
+    bool json;
+    bool first;
+    bool done;
+    std::string pending;                        // 已生成但尚未输出的文本，条目可能跨块
+    size_t pos;
+    ~dirStreamState(){ closedir(dir); }
+};
+
+std::function<int(char* buf, int len)> dirIndex::stream(std::string_view fsPath, std::string_view urlPath, bool json){
+    DIR* dir = opendir(std::string(fsPath).c_str());
+    if(!dir){
+        return nullptr;
+    }
+    std::shared_ptr<dirStreamState> st = std::make_shared<dirStreamState>();
+    st->dir = dir;
+    st->urlPath = urlPath;
+    st->json = json;
+    st->first = true;
+    st->done = false;
+    st->pos = 0;
+    appendHead(st->pending, st->urlPath, json);
+    return [st](char* buf, int len){
+        int n = 0;
+        while(n < len){
+            if(st->pos < st->pending.size()){
+                int k = std::min((size_t)(len - n), st->pending.size() - st->pos);
+                memcpy(buf + n, st->pending.data() + st->pos, k);
+                n += k;
+                st->pos += k;
+                continue;
+            }
+            st->pending.clear();
+            st->pos = 0;
+            if(st->done){
+                break;
+            }
+            struct dirent* de = readdir(st->dir);
+            if(!de){
+                appendTail(st->pending, st->json);
+                st->done = true;
+                continue;
+            }
+            struct stat sb;
+            if(hidden(de->d_name) || fstatat(dirfd(st->dir), de->d_name, &sb, 0) < 0 || !(sb.st_mode & S_IROTH)){
+                continue;
+            }
+            appendEntry(st->pending, st->urlPath, de->d_name, S_ISDIR(sb.st_mode), sb.st_size, sb.st_mtime, st->json, st->first);
+            st->first = false;
+        }
+        return n;
+    };
+}
+
+void dirIndex::drop(dirState* d){
+    byPath.erase(d->fsPath);
+    byWatch.erase(d->wd);
+    delete d;
+}
+
+void dirIndex::onNotify(){
+    alignas(struct inotify_event) char buf[4096];
+    while(1){
+        ssize_t n = read(m_inotifyfd, buf, sizeof(buf));
+        if(n <= 0){
+            // EAGAIN：事件已读完(ET模式)
+            break;
+        }
+        indexLock.wrlock();
+        for(char* p = buf; p < buf + n; ){
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if(ev->mask & IN_Q_OVERFLOW){
+                // 事件丢失，全部目录下次请求时重新读取
+                for(auto& w : byWatch){
+                    inotify_rm_watch(m_inotifyfd, w.first);
+                    delete w.second;
+                }
+                byWatch.clear();
+                byPath.clear();
+                continue;
+            }
+            auto it = byWatch.find(ev->wd);
+            if(it == byWatch.end()){
+                continue;
+            }
+            dirState* d = it->second;
+            if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)){
+                // 目录本身失效；IN_IGNORED表示内核已移除监视
+                if(!(ev->mask & IN_IGNORED)){
+                    inotify_rm_watch(m_inotifyfd, d->wd);
+                }
+                drop(d);
+                continue;
+            }
+            if(ev->len == 0 || hidden(ev->name)){
+                continue;
+            }
+            if(d->large){
+                // 不保存条目，删除后可能不再超过上限，下次请求时重新读取
+                if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+                    inotify_rm_watch(m_inotifyfd, d->wd);
+                    drop(d);
+                }
+                continue;
+            }
+            if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+                d->entries.erase(ev->name);
+            }else{
+                update(d, ev->name);
+                if(d->entries.size() > DIR_INDEX_MAX_ENTRIES){
+                    d->large = true;
+                    d->entries.clear();
+                }
+            }
+            // 序列化结果在下次请求时重新生成，连接仍持有旧版本的引用
+            d->html.reset();
+            d->json.reset();
+        }
+        indexLock.unlock();
+    }
+}
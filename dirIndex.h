@@ -0,0 +1,72 @@
+// 目录索引：目录列表生成1次后缓存为序列化好的HTML和JSON，inotify通知时增量更新条目，请求不必每次readdir
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+#include <sys/types.h>
+#include <time.h>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include "locker.h"
+#include "fileCache.h"
+
+#define DIR_INDEX_FILE "index.html"             // 目录的默认文件
+#define DIR_INDEX_MAX 1024                      // 最多缓存并监视的目录数，超出时每次请求现场生成
+#define DIR_INDEX_MAX_ENTRIES 10000             // 缓存的目录最多的条目数，更大的目录每次请求流式生成列表
+
+class dirIndex{
+    public:
+        // autoindex为false时不生成目录列表，也不创建inotify实例
+        static void init(int epollfd, bool autoindex);
+
+        static bool enabled(){ return m_autoindex; }
+
+        static int m_inotifyfd;                 // 加入reactor的epoll，可读时调用onNotify
+
+        // 工作线程调用：返回目录列表，json为true时为JSON格式；fsPath为目录路径，urlPath以'/'结尾；
+        // 条目超过DIR_INDEX_MAX_ENTRIES的目录不生成列表，返回NULL并置*large为true，由stream生成
+        static cacheEntryPtr listing(std::string_view fsPath, std::string_view urlPath, bool json, bool* large);
+
+        // 流式响应的生产者(httpConnect::startStream)：按readdir的顺序逐块输出列表，不排序，
+        // 内存占用与目录大小无关；打开目录失败时返回空
+        static std::function<int(char* buf, int len)> stream(std::string_view fsPath, std::string_view urlPath, bool json);
+
+        // reactor调用：读取inotify事件，增量更新条目，序列化结果在下次请求时重新生成
+        static void onNotify();
+
+    private:
+        // 支持以string_view查找，避免构造std::string
+        struct pathHash{
+            typedef void is_transparent;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+        };
+
+        struct entry{
+            bool isDir;
+            off_t size;
+            time_t mtime;
+        };
+
+        struct dirState{
+            int wd;                             // inotify监视描述符
+            std::string fsPath;
+            std::string urlPath;
+            std::map<std::string, entry> entries; // 按名称排序
+            cacheEntryPtr html;                 // 序列化结果，条目变化时置空
+            cacheEntryPtr json;
+            bool large;                         // 条目超过DIR_INDEX_MAX_ENTRIES，不保存条目，只监视删除
+        };
+
+        static bool load(dirState* d);          // readdir读取全部条目
+        static void update(dirState* d, const char* name); // stat单个条目，不存在则删除
+        static cacheEntryPtr serialize(const dirState* d, bool json);
+        static void drop(dirState* d);
+
+        static bool m_autoindex;
+        static rwlocker indexLock;
+        static std::unordered_map<std::string, dirState*, pathHash, std::equal_to<> > byPath;
+        static std::unordered_map<int, dirState*> byWatch;
+};
+
+#endif
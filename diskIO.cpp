@@ -0,0 +1,77 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include <vector>
+#include "diskIO.h"
+#include "httpConnect.h"
+#include "fileCache.h"
+
+threadPool<ioTask>* diskIO::pool = NULL;
+
+void diskIO::init(int threadNum){
+    pool = new threadPool<ioTask>(threadNum);
+}
+
+bool diskIO::append(ioTask* task){
+    return pool && pool->append(task);
+}
+
+// mincore检查
+bool diskIO::resident(char* address, size_t length){
+    static thread_local std::vector<unsigned char> vec;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (length + pageSize - 1) / pageSize;
+    vec.resize(pages);
+    if(mincore(address, length, vec.data()) != 0){
+        return true; // 无法判断，按已驻留处理
+    }
+    for(size_t i = 0; i < pages; i++){
+        if(!(vec[i] & 1)){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool diskIO::submit(httpConnect* conn, char* address, size_t length, const char* cacheKey, const struct stat* st){
+    if(!pool || !address || address == MAP_FAILED || length == 0 || resident(address, length)){
+        return false;
+    }
+    diskRequest* req = new diskRequest;
+    req->conn = conn;
+    req->generation = conn->generation();
+    req->address = address;
+    req->length = length;
+    if(cacheKey && st){
+        req->cacheKey = cacheKey;
+        req->st = *st;
+    }
+    if(!pool->append(req)){
+        delete req;
+        return false;
+    }
+    return true;
+}
+
+void diskIO::pageIn(char* address, size_t length){
+    if(!address || address == MAP_FAILED){
+        return;
+    }
+    madvise(address, length, MADV_WILLNEED);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    volatile char c;
+    for(size_t off = 0; off < length; off += pageSize){
+        c = address[off];
+    }
+    (void)c;
+}
+
+// 在I/O线程中触发缺页，reactor中的writev不会再因读盘阻塞
+void diskRequest::process(){
+    diskIO::pageIn(address, length);
+    // 页面已读入，复制到缓存不会再缺页；本次响应仍从映射发送
+    if(!cacheKey.empty()){
+        fileCache::insert(cacheKey, st, address);
+    }
+    conn->diskDone(this);
+    delete this;
+}
@@ -0,0 +1,50 @@
+// 磁盘I/O线程：处理可能阻塞在磁盘上的操作，不占用请求处理线程和reactor线程
+#ifndef DISKIO_H
+#define DISKIO_H
+#include <stddef.h>
+#include <sys/stat.h>
+#include <string>
+#include "threadPool.h"
+
+class httpConnect;
+
+// I/O任务基类，由磁盘I/O线程调用process()
+struct ioTask{
+    virtual void process() = 0;
+    virtual ~ioTask(){}
+};
+
+// 冷文件预读：将未驻留内存的文件页读入，完成后交回连接发送响应；
+// 每次提交单独分配，由磁盘I/O线程在完成后释放，连接关闭后复用也不会改写进行中的请求
+struct diskRequest : public ioTask{
+    httpConnect* conn;
+    unsigned int generation;                    // 提交时连接的代数
+    char* address;                              // 文件映射的起始位置
+    size_t length;                              // 映射长度
+    std::string cacheKey;                       // 非空时预读后加入文件缓存，为相对网站根目录的路径
+    struct stat st;                             // 加入缓存时校验用的文件状态
+    void process();
+};
+
+class diskIO{
+    public:
+        static void init(int threadNum = 4);
+
+        static bool append(ioTask* task);
+
+        // 文件页未全部驻留内存时提交预读请求，提交成功返回true；
+        // 给出cacheKey时由磁盘I/O线程在预读后加入文件缓存，工作线程不因复制冷文件而缺页
+        static bool submit(httpConnect* conn, char* address, size_t length, const char* cacheKey = NULL, const struct stat* st = NULL);
+
+        // 映射的文件页是否都在page cache中
+        static bool resident(char* address, size_t length);
+
+        // 在当前线程触发缺页，读入映射的全部文件页；只能在磁盘I/O线程调用
+        static void pageIn(char* address, size_t length);
+
+    private:
+
+        static threadPool<ioTask>* pool;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <time.h>
+#include <string.h>
+#include "fileCache.h"
+
+rwlocker fileCache::cacheLock;
+std::unordered_map<std::string, cacheEntryPtr, fileCache::keyHash, std::equal_to<> > fileCache::entries;
+std::list<std::string> fileCache::fifo;
+size_t fileCache::totalBytes = 0;
+
+long long fileCache::now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+cacheEntryPtr fileCache::lookup(std::string_view path){
+    cacheEntryPtr e;
+    cacheLock.rdlock();
+    auto it = entries.find(path);
+    if(it != entries.end()){
+        e = it->second;
+    }
+    cacheLock.unlock();
+    if(e && now() - e->checkTime.load(std::memory_order_relaxed) >= CACHE_CHECK_INTERVAL){
+        // 需要重新stat，交给工作线程
+        e.reset();
+    }
+    return e;
+}
+
+cacheEntryPtr fileCache::validate(std::string_view path, const struct stat& st){
+    cacheEntryPtr e;
+    cacheLock.rdlock();
+    auto it = entries.find(path);
+    if(it != entries.end()){
+        e = it->second;
+    }
+    cacheLock.unlock();
+    if(!e){
+        return e;
+    }
+    if((off_t)e->size != st.st_size || e->mtime.tv_sec != st.st_mtim.tv_sec || e->mtime.tv_nsec != st.st_mtim.tv_nsec){
+        // 文件已修改，由调用者重新插入
+        e.reset();
+        return e;
+    }
+    e->checkTime.store(now(), std::memory_order_relaxed);
+    return e;
+}
+
+cacheEntryPtr fileCache::insert(std::string_view path, const struct stat& st, const char* data){
+    cacheEntryPtr e;
+    if(st.st_size <= 0 || st.st_size > CACHE_MAX_FILE_SIZE){
+        return e;
+    }
+    e = std::make_shared<cacheEntry>();
+    e->path = path;
+    e->size = st.st_size;
+    e->data = new char[e->size];
+    memcpy(e->data, data, e->size);
+    e->mtime = st.st_mtim;
+    e->checkTime.store(now(), std::memory_order_relaxed);
+
+    cacheLock.wrlock();
+    auto it = entries.find(path);
+    if(it != entries.end()){
+        // 替换旧版本，正在发送旧版本的连接仍持有其引用
+        totalBytes -= it->second->size;
+        it->second = e;
+    }else{
+        entries.emplace(e->path, e);
+        fifo.push_back(e->path);
+    }
+    totalBytes += e->size;
+    while(totalBytes > CACHE_MAX_BYTES && !fifo.empty()){
+        auto old = entries.find(fifo.front());
+        if(old != entries.end()){
+            totalBytes -= old->second->size;
+            entries.erase(old);
+        }
+        fifo.pop_front();
+    }
+    cacheLock.unlock();
+    return e;
+}
+
+std::vector<std::string> fileCache::keys(size_t max){
+    std::vector<std::string> ret;
+    cacheLock.rdlock();
+    for(auto it = fifo.rbegin(); it != fifo.rend() && ret.size() < max; ++it){
+        if(entries.count(*it)){
+            ret.push_back(*it);
+        }
+    }
+    cacheLock.unlock();
+    return ret;
+}
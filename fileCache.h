@@ -0,0 +1,58 @@
+// 静态文件缓存：小文件内容常驻内存，reactor命中时直接发送，无需交给线程池
+#ifndef FILECACHE_H
+#define FILECACHE_H
+#include <sys/stat.h>
+#include <string>
+#include <string_view>
+#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include "locker.h"
+
+#define CACHE_MAX_FILE_SIZE (256 * 1024)        // 可缓存的最大文件
+#define CACHE_MAX_BYTES (64 * 1024 * 1024)      // 缓存总容量
+#define CACHE_CHECK_INTERVAL 1000               // 毫秒，超过此时间未经stat校验的条目不在reactor中命中
+
+struct cacheEntry{
+    std::string path;                           // 相对网站根目录的路径
+    char* data;
+    size_t size;
+    struct timespec mtime;
+    std::atomic<long long> checkTime;           // 最近一次stat校验的时间
+    ~cacheEntry(){ delete [] data; }
+};
+
+typedef std::shared_ptr<cacheEntry> cacheEntryPtr;
+
+class fileCache{
+    public:
+        // reactor调用：最近校验过的条目才命中，不做系统调用
+        static cacheEntryPtr lookup(std::string_view path);
+
+        // 工作线程调用：根据stat结果校验条目，未变化则刷新校验时间
+        static cacheEntryPtr validate(std::string_view path, const struct stat& st);
+
+        // 工作线程调用：加入缓存，超出容量时按插入顺序淘汰
+        static cacheEntryPtr insert(std::string_view path, const struct stat& st, const char* data);
+
+        static long long now();
+
+        // 最近插入的至多max个条目的路径，升级时交给新进程预热
+        static std::vector<std::string> keys(size_t max);
+
+    private:
+        // 支持以string_view查找，避免构造std::string
+        struct keyHash{
+            typedef void is_transparent;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+        };
+
+        static rwlocker cacheLock;
+        static std::unordered_map<std::string, cacheEntryPtr, keyHash, std::equal_to<> > entries;
+        static std::list<std::string> fifo;     // 插入顺序，用于淘汰
+        static size_t totalBytes;
+};
+
+#endif
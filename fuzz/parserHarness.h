@@ -0,0 +1,104 @@
+// 解析器的fuzz和测试驱动共用：在不关联socket的httpConnect上，把数据按read()的方式追加到读缓冲并调用process_read()，
+// 与服务器相同，每次追加后解析1次，得到完整请求或出错后停止
+#ifndef PARSERHARNESS_H
+#define PARSERHARNESS_H
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "../httpConnect.h"
+#include "../bufferPool.h"
+
+struct parserHarness{
+    // 进程内调用1次
+    static void setup(){
+        bufferPool::init(READ_BUFFER_SIZE + WRITE_BUFFER_SIZE);
+    }
+
+    // 开始解析新连接上的第1个请求，不保留上次的流水线数据
+    static void reset(httpConnect& c){
+        c.releaseBuffers();
+        c.m_traceId = 0;
+        c.m_h2 = NULL;
+        c.m_requestEnd = 0;
+        c.m_requestCnt = 0;
+        c.init();
+        c.holdBuffers();
+    }
+
+    static void release(httpConnect& c){
+        c.releaseBuffers();
+    }
+
+    // 读缓冲放不下的部分丢弃，与read()读满缓冲时相同
+    static httpConnect::HTTP_CODE feed(httpConnect& c, const char* data, size_t len){
+        size_t room = READ_BUFFER_SIZE - c.readIndex;
+        if(len > room){
+            len = room;
+        }
+        memcpy(c.readBuf + c.readIndex, data, len);
+        c.readIndex += len;
+        return c.process_read();
+    }
+
+    // 解析结果：返回码，完整请求时加上各字段、请求体和之后的数据(读缓冲中剩余的和尚未追加的rest)，用于比较
+    static std::string summary(httpConnect& c, httpConnect::HTTP_CODE code, const std::string& rest){
+        char buf[128];
+        snprintf(buf, sizeof(buf), "code=%d", code);
+        std::string s = buf;
+        if(code != httpConnect::GET_REQUEST){
+            return s;
+        }
+        snprintf(buf, sizeof(buf), " method=%d keepalive=%d chunked=%d length=%d headers=%d",
+            c.requestMethod, c.connectState, c.m_chunked, c.contentLength, c.m_headers.cnt);
+        s += buf;
+        s += " url=";
+        s += c.url ? c.url : "(null)";
+        s += " version=";
+        s += c.httpVersion ? c.httpVersion : "(null)";
+        s += " host=";
+        s += c.host ? c.host : "(null)";
+        s += " body=";
+        if(c.m_content){
+            s.append(c.m_content, c.contentLength);
+        }
+        // 请求体结尾的'\0'覆盖了下一个请求的第1个字节，init时由m_requestEndByte恢复
+        s += " next=";
+        if(c.m_requestEnd < c.readIndex){
+            s += c.m_requestEndByte;
+            s.append(c.readBuf + c.m_requestEnd + 1, c.readIndex - c.m_requestEnd - 1);
+        }
+        s += rest;
+        return s;
+    }
+
+    // 完整请求的URL路径已规范化：不含空段、"."段和".."段，".."越过根目录的请求不会到达这里
+    static bool pathNormalized(httpConnect& c){
+        std::string path(c.url, strcspn(c.url, "?"));
+        if(path.empty() || path[0] != '/' || path.find("//") != std::string::npos){
+            return false;
+        }
+        path += '/';
+        return path.find("/./") == std::string::npos && path.find("/../") == std::string::npos;
+    }
+
+    // 整体追加1次
+    static std::string parse(httpConnect& c, const char* data, size_t len){
+        reset(c);
+        return summary(c, feed(c, data, len), "");
+    }
+
+    // 在cuts[0..n)处切开，依次追加
+    static std::string parseSplit(httpConnect& c, const char* data, size_t len, const size_t* cuts, int n){
+        reset(c);
+        httpConnect::HTTP_CODE code = httpConnect::NO_REQUEST;
+        size_t pos = 0;
+        for(int i = 0; i <= n && code == httpConnect::NO_REQUEST; i++){
+            size_t end = i < n ? cuts[i] : len;
+            code = feed(c, data + pos, end - pos);
+            pos = end;
+        }
+        return summary(c, code, std::string(data + pos, len - pos));
+    }
+};
+
+#endif
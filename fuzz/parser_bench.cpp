@@ -0,0 +1,61 @@
+// 解析器计时：典型请求整体读入和逐字节读入两种方式，各解析N次，输出每个请求的耗时和吞吐量
+// 用法: parser_bench [次数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "parserHarness.h"
+
+static httpConnect conn;
+
+static double nowSec(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void run(const char* name, const std::string& req, int n, bool bytewise){
+    double start = nowSec();
+    for(int i = 0; i < n; i++){
+        parserHarness::reset(conn);
+        httpConnect::HTTP_CODE code = httpConnect::NO_REQUEST;
+        if(bytewise){
+            for(size_t j = 0; j < req.size() && code == httpConnect::NO_REQUEST; j++){
+                code = parserHarness::feed(conn, req.data() + j, 1);
+            }
+        }else{
+            code = parserHarness::feed(conn, req.data(), req.size());
+        }
+        if(code != httpConnect::GET_REQUEST){
+            printf("%s: unexpected result %d\n", name, code);
+            exit(1);
+        }
+    }
+    double t = nowSec() - start;
+    printf("%-24s %8.0f ns/request %8.1f MB/s\n", name, t * 1e9 / n, req.size() * (double)n / t / 1e6);
+}
+
+int main(int argc, char* argv[]){
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    parserHarness::setup();
+    std::string get = "GET /images/dog.jpg HTTP/1.1\r\n"
+        "Host: 127.0.0.1:10000\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+        "Accept: image/avif,image/webp,*/*\r\n"
+        "Accept-Language: zh-CN,zh;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Referer: http://127.0.0.1:10000/picture.html\r\n"
+        "Cookie: session=0123456789abcdef\r\n\r\n";
+    std::string post = "POST /login HTTP/1.1\r\nHost: 127.0.0.1:10000\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 27\r\n\r\n"
+        "username=test&password=1234";
+    std::string chunked = "POST /login HTTP/1.1\r\nHost: 127.0.0.1:10000\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "9\r\nusername=\r\n12\r\ntest&password=1234\r\n0\r\n\r\n";
+    run("get", get, n, false);
+    run("get bytewise", get, n / 10, true);
+    run("post", post, n, false);
+    run("chunked", chunked, n, false);
+    run("chunked bytewise", chunked, n / 10, true);
+    parserHarness::release(conn);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// libFuzzer入口：输入整体解析1次，再按由输入决定的切分点分成最多7段依次解析，两次结果不同、
+// 或完整请求的URL路径未规范化时中止；
+// 越界和未初始化的读取由AddressSanitizer报告。构建和运行见README
+#include <stdint.h>
+#include <stdlib.h>
+#include "parserHarness.h"
+
+static httpConnect conn;
+
+extern "C" int LLVMFuzzerInitialize(int*, char***){
+    parserHarness::setup();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+    // 整个请求须能放入读缓冲，否则两种方式读满缓冲的时机不同
+    if(size == 0 || size >= READ_BUFFER_SIZE){
+        return 0;
+    }
+    const char* p = (const char*)data;
+    std::string whole = parserHarness::parse(conn, p, size);
+    if(whole.compare(0, 7, "code=0 ") == 0 && !parserHarness::pathNormalized(conn)){
+        fprintf(stderr, "path not normalized: %s\n", whole.c_str());
+        abort();
+    }
+
+    // 切分点取自输入的哈希，同一输入总是得到相同的切分
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < size; i++){
+        h = (h ^ data[i]) * 16777619u;
+    }
+    size_t cuts[6];
+    int n = h % 7;
+    for(int i = 0; i < n; i++){
+        h = h * 1103515245u + 12345u;
+        cuts[i] = (h >> 8) % (size + 1);
+    }
+    for(int i = 1; i < n; i++){
+        for(int j = i; j > 0 && cuts[j - 1] > cuts[j]; j--){
+            size_t t = cuts[j];
+            cuts[j] = cuts[j - 1];
+            cuts[j - 1] = t;
+        }
+    }
+    std::string split = parserHarness::parseSplit(conn, p, size, cuts, n);
+    if(whole != split){
+        fprintf(stderr, "whole: %s\nsplit: %s\n", whole.c_str(), split.c_str());
+        abort();
+    }
+    parserHarness::release(conn);
+    return 0;
+}
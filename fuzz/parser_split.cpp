@@ -0,0 +1,87 @@
+// 分段读取的等价性测试：每个样例整体解析的结果与在任意1处、任意2处切开后依次解析的结果相同，
+// 并与期望的返回码一致，完整请求的URL路径已规范化。有不一致时输出样例和切分点，返回1
+#include <stdio.h>
+#include <string.h>
+#include "parserHarness.h"
+
+struct sample{
+    const char* name;
+    std::string data;
+    httpConnect::HTTP_CODE expect;
+};
+
+static httpConnect conn;
+
+int main(){
+    parserHarness::setup();
+    sample samples[] = {
+        {"get", "GET /index.html HTTP/1.1\r\nHost: example.com\r\nConnection: keep-alive\r\n\r\n", httpConnect::GET_REQUEST},
+        {"bare-lf", "GET / HTTP/1.1\nHost: x\n\n", httpConnect::BAD_REQUEST},
+        {"absolute-url", "GET http://example.com/a?b=c HTTP/1.1\r\nHost: example.com\r\n\r\n", httpConnect::GET_REQUEST},
+        {"post", "POST /login HTTP/1.1\r\nHost: x\r\nContent-Length: 27\r\n\r\nusername=test&password=1234", httpConnect::GET_REQUEST},
+        {"chunked", "POST /login HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "9\r\nusername=\r\n4;ext=1\r\ntest\r\n0\r\nTrailer: x\r\n\r\n", httpConnect::GET_REQUEST},
+        {"pipelined", "GET /a HTTP/1.1\r\nHost: x\r\n\r\nGET /b HTTP/1.1\r\nHost: x\r\n\r\n", httpConnect::GET_REQUEST},
+        {"pipelined-body", "POST /login HTTP/1.1\r\nHost: x\r\nContent-Length: 3\r\n\r\nabcGET /b HTTP/1.1\r\n\r\n", httpConnect::GET_REQUEST},
+        {"pipelined-chunked", "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\nGET /b HTTP/1.1\r\n\r\n", httpConnect::GET_REQUEST},
+        {"bad-method", "FETCH / HTTP/1.1\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"no-url", "GET\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"space-before-colon", "GET / HTTP/1.1\r\nHost : x\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"obs-fold", "GET / HTTP/1.1\r\nX-A: 1\r\n  2\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"length-sign", "POST / HTTP/1.1\r\nContent-Length: -5\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"length-conflict", "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd", httpConnect::BAD_REQUEST},
+        {"length-and-chunked", "POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"bad-chunk-size", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", httpConnect::BAD_REQUEST},
+        {"bad-chunk-end", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcXY", httpConnect::BAD_REQUEST},
+        {"long-chunk-ext", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3;" + std::string(300, 'e') + "\r\nabc\r\n0\r\n\r\n",
+            httpConnect::BAD_REQUEST},
+        {"large-length", "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n", httpConnect::PAYLOAD_TOO_LARGE},
+        {"large-chunk", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nfffff\r\n", httpConnect::PAYLOAD_TOO_LARGE},
+        {"dot-segments", "GET /a/../b/./c//d/. HTTP/1.1\r\nHost: x\r\n\r\n", httpConnect::GET_REQUEST},
+        {"dot-query", "GET /a/b/..?x=/../ HTTP/1.1\r\n\r\n", httpConnect::GET_REQUEST},
+        {"traversal", "GET /../../etc/passwd HTTP/1.1\r\nHost: x\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"traversal-nested", "GET /a/../../?format=json HTTP/1.1\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"traversal-absolute", "GET http://x/a/../../etc/passwd HTTP/1.1\r\n\r\n", httpConnect::BAD_REQUEST},
+        {"incomplete", "GET / HTTP/1.1\r\nHost: x\r\n", httpConnect::NO_REQUEST},
+        {"incomplete-body", "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nabc", httpConnect::NO_REQUEST},
+    };
+
+    int failed = 0;
+    long long checks = 0;
+    for(const sample& s : samples){
+        const char* d = s.data.data();
+        size_t len = s.data.size();
+        std::string whole = parserHarness::parse(conn, d, len);
+        char expect[32];
+        snprintf(expect, sizeof(expect), "code=%d", s.expect);
+        if(whole.compare(0, strlen(expect), expect) != 0 || (whole.size() > strlen(expect) && whole[strlen(expect)] != ' ')){
+            printf("%s: expected %s, got %s\n", s.name, expect, whole.c_str());
+            failed++;
+            continue;
+        }
+        if(s.expect == httpConnect::GET_REQUEST){
+            parserHarness::parse(conn, d, len);
+            if(!parserHarness::pathNormalized(conn)){
+                printf("%s: path not normalized: %s\n", s.name, whole.c_str());
+                failed++;
+                continue;
+            }
+        }
+        bool ok = true;
+        for(size_t i = 0; i <= len && ok; i++){
+            for(size_t j = i; j <= len && ok; j++){
+                size_t cuts[2] = {i, j};
+                std::string split = parserHarness::parseSplit(conn, d, len, cuts, 2);
+                checks++;
+                if(split != whole){
+                    printf("%s: split at %zu,%zu\n  whole: %s\n  split: %s\n", s.name, i, j, whole.c_str(), split.c_str());
+                    ok = false;
+                    failed++;
+                }
+            }
+        }
+    }
+    parserHarness::release(conn);
+    printf("%d samples, %lld split checks, %d failed\n", (int)(sizeof(samples) / sizeof(samples[0])), checks, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "handoff.h"
+#include "fileCache.h"
+
+int handoff::m_controlfd = -1;
+int handoff::m_peerfd = -1;
+int handoff::m_epollfd = -1;
+int handoff::m_oldfd = -1;
+
+extern void addfd(int epollfd, int fd, bool oneshot);
+extern void removefd(int epollfd, int fd);
+
+// 控制连接是本机的阻塞socket，收发超时避免对方卡住时阻塞reactor
+static void setTimeout(int fd){
+    struct timeval tv = {HANDOFF_TIMEOUT, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static bool sendAll(int fd, const char* data, size_t len){
+    while(len > 0){
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if(n <= 0){
+            if(n == -1 && errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, char* data, size_t len){
+    while(len > 0){
+        ssize_t n = recv(fd, data, len, 0);
+        if(n <= 0){
+            if(n == -1 && errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool handoff::receive(const char* path, std::vector<listener>& listeners, std::vector<std::string>& manifest){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        return false;
+    }
+    setTimeout(fd);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1){
+        // 没有旧进程在运行
+        ::close(fd);
+        return false;
+    }
+
+    uint32_t head[2];
+    struct iovec iov = {head, sizeof(head)};
+    union{
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    ssize_t n = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    std::vector<int> fds;
+    for(struct cmsghdr* c = CMSG_FIRSTHDR(&msg); n > 0 && c; c = CMSG_NXTHDR(&msg, c)){
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS){
+            size_t cnt = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t old = fds.size();
+            fds.resize(old + cnt);
+            memcpy(&fds[old], CMSG_DATA(c), cnt * sizeof(int));
+        }
+    }
+    std::string text;
+    bool ok = n == sizeof(head) && !(msg.msg_flags & MSG_CTRUNC) && fds.size() == head[0] && head[1] <= HANDOFF_MAX_MANIFEST * (FILENAME_MAX + 1);
+    if(ok){
+        text.resize(head[1]);
+        ok = recvAll(fd, &text[0], text.size());
+    }
+    if(!ok){
+        for(size_t i = 0; i < fds.size(); i++){
+            ::close(fds[i]);
+        }
+        ::close(fd);
+        return false;
+    }
+
+    // 前n行对应收到的fd，地址和tls都相同才接管，其余的关闭，由本进程按自己的配置重新监听
+    size_t pos = 0;
+    for(size_t i = 0; pos < text.size(); i++){
+        size_t end = text.find('\n', pos);
+        if(end == std::string::npos){
+            end = text.size();
+        }
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        if(i >= fds.size()){
+            manifest.push_back(line);
+            continue;
+        }
+        bool tls = line.compare(0, 2, "1 ") == 0;
+        std::string address = line.size() > 2 ? line.substr(2) : "";
+        listener* l = NULL;
+        for(size_t j = 0; j < listeners.size(); j++){
+            if(listeners[j].fd == -1 && listeners[j].tls == tls && listeners[j].address == address){
+                l = &listeners[j];
+                break;
+            }
+        }
+        if(l){
+            l->fd = fds[i];
+        }else{
+            ::close(fds[i]);
+        }
+    }
+    m_oldfd = fd;
+    return true;
+}
+
+void handoff::ready(){
+    if(m_oldfd == -1){
+        return;
+    }
+    if(!sendAll(m_oldfd, "R", 1)){
+        perror("handoff");
+    }
+    ::close(m_oldfd);
+    m_oldfd = -1;
+}
+
+bool handoff::listen(const char* path, int epollfd){
+    listener l;
+    if(!l.parse((std::string("unix:") + path).c_str()) || !l.open()){
+        return false;
+    }
+    // 拿到控制socket即可取得监听socket，只允许同一用户连接
+    chmod(path, 0600);
+    m_controlfd = l.fd;
+    m_epollfd = epollfd;
+    addfd(epollfd, m_controlfd, false);
+    return true;
+}
+
+void handoff::sendState(const std::vector<listener>& listeners){
+    std::vector<int> fds;
+    std::string text;
+    for(size_t i = 0; i < listeners.size() && fds.size() < HANDOFF_MAX_FDS; i++){
+        if(listeners[i].fd != -1){
+            fds.push_back(listeners[i].fd);
+            text += listeners[i].tls ? "1 " : "0 ";
+            text += listeners[i].address;
+            text += '\n';
+        }
+    }
+    std::vector<std::string> keys = fileCache::keys(HANDOFF_MAX_MANIFEST);
+    for(size_t i = 0; i < keys.size(); i++){
+        text += keys[i];
+        text += '\n';
+    }
+
+    uint32_t head[2] = {(uint32_t)fds.size(), (uint32_t)text.size()};
+    struct iovec iov = {head, sizeof(head)};
+    union{
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(!fds.empty()){
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(c), fds.data(), sizeof(int) * fds.size());
+    }
+    if(sendmsg(m_peerfd, &msg, MSG_NOSIGNAL) != sizeof(head) || !sendAll(m_peerfd, text.data(), text.size())){
+        perror("handoff");
+        ::close(m_peerfd);
+        m_peerfd = -1;
+        return;
+    }
+    printf("handoff: sent %d listeners and %d cached files\n", (int)fds.size(), (int)keys.size());
+    addfd(m_epollfd, m_peerfd, false);
+}
+
+bool handoff::onEvent(int fd, const std::vector<listener>& listeners){
+    if(fd == m_controlfd){
+        // 边沿触发，取完全部连接；同一时间只处理1个新进程
+        int c;
+        while((c = accept4(m_controlfd, NULL, NULL, SOCK_CLOEXEC)) != -1){
+            if(m_peerfd != -1){
+                ::close(c);
+                continue;
+            }
+            m_peerfd = c;
+            setTimeout(m_peerfd);
+            sendState(listeners);
+        }
+        return false;
+    }
+    char c;
+    ssize_t n = recv(m_peerfd, &c, 1, 0);
+    if(n == 1 && c == 'R'){
+        return true;
+    }
+    if(n == -1 && (errno == EAGAIN || errno == EINTR)){
+        return false;
+    }
+    // 新进程未就绪就退出，继续服务
+    printf("handoff: new process exited before taking over\n");
+    removefd(m_epollfd, m_peerfd);
+    m_peerfd = -1;
+    return false;
+}
+
+void handoff::detach(){
+    int* fds[] = {&m_oldfd, &m_controlfd, &m_peerfd};
+    for(int i = 0; i < 3; i++){
+        if(*fds[i] != -1){
+            ::close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+void handoff::close(){
+    if(m_peerfd != -1){
+        removefd(m_epollfd, m_peerfd);
+        m_peerfd = -1;
+    }
+    // 控制socket文件已由新进程重新创建，不删除
+    if(m_controlfd != -1){
+        removefd(m_epollfd, m_controlfd);
+        m_controlfd = -1;
+    }
+}
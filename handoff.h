@@ -0,0 +1,49 @@
+// 不停机升级：新进程通过Unix域控制socket从旧进程接收监听socket(SCM_RIGHTS)和文件缓存清单，
+// 预热缓存并开始accept后通知旧进程，旧进程停止accept并排空已有连接后退出
+#ifndef HANDOFF_H
+#define HANDOFF_H
+#include <string>
+#include <vector>
+#include "listener.h"
+
+#define HANDOFF_MAX_FDS 64                      // 1次传递的监听socket上限
+#define HANDOFF_MAX_MANIFEST 4096               // 清单中的文件数上限，取最近加入缓存的文件
+#define HANDOFF_TIMEOUT 5                       // 秒，控制连接的收发超时
+
+/*
+    控制连接上的消息：
+        旧进程 -> 新进程：uint32 监听socket数n  uint32 文本长度(随附n个fd)，
+                         文本前n行为"tls 地址"，与fd一一对应，其余各行为缓存文件的路径
+        新进程 -> 旧进程：1字节'R'，表示已开始accept
+    新进程在发送'R'之前退出时，旧进程读到EOF，继续正常服务
+*/
+class handoff{
+    public:
+        // 新进程启动时调用：连接path上的旧进程，地址与tls相同的监听地址直接使用收到的fd，
+        // 缓存文件路径写入manifest；没有旧进程或传递失败返回false
+        static bool receive(const char* path, std::vector<listener>& listeners, std::vector<std::string>& manifest);
+
+        // 新进程开始accept后调用：通知旧进程排空
+        static void ready();
+
+        // 在path上等待下一次升级，控制socket加入epoll
+        static bool listen(const char* path, int epollfd);
+
+        // reactor调用：控制socket或升级连接可读；返回true表示新进程已就绪，本进程应开始排空
+        static bool onEvent(int fd, const std::vector<listener>& listeners);
+
+        static void close();                    // 开始排空时关闭控制socket和升级连接
+
+        static void detach();                   // 多进程模式的工作进程调用：关闭从主进程继承的控制socket和升级连接
+
+        static int m_controlfd;                 // 监听的控制socket
+        static int m_peerfd;                    // 与新进程的升级连接
+
+    private:
+        static void sendState(const std::vector<listener>& listeners);
+
+        static int m_epollfd;
+        static int m_oldfd;                     // 新进程与旧进程的连接，发送'R'后关闭
+};
+
+#endif
@@ -0,0 +1,419 @@
+#include "hpack.h"
+
+// 静态表，RFC 7541 附录A
+static const struct { const char* name; const char* value; } staticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+static const size_t STATIC_TABLE_LEN = sizeof(staticTable) / sizeof(staticTable[0]);
+
+// Huffman编码表，RFC 7541 附录B，下标为符号，256为EOS
+static const struct { uint32_t code; int bits; } huffmanCodes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+// Huffman解码树：由编码表构建，叶子节点以负数保存符号
+class huffmanTree{
+    public:
+        huffmanTree(){
+            nodes.push_back(node());
+            for(int sym = 0; sym < 257; sym++){
+                int cur = 0;
+                for(int i = huffmanCodes[sym].bits - 1; i >= 0; i--){
+                    int bit = (huffmanCodes[sym].code >> i) & 1;
+                    if(i == 0){
+                        nodes[cur].next[bit] = -(sym + 1);
+                    }else{
+                        if(nodes[cur].next[bit] == 0){
+                            nodes[cur].next[bit] = nodes.size();
+                            nodes.push_back(node());
+                        }
+                        cur = nodes[cur].next[bit];
+                    }
+                }
+            }
+        }
+
+        struct node{
+            int next[2];
+            node(){ next[0] = next[1] = 0; }
+        };
+        std::vector<node> nodes;
+};
+
+static const huffmanTree huffTree;
+
+bool huffmanDecode(const uint8_t* data, size_t len, std::string& out){
+    int cur = 0;
+    int depth = 0;                              // 当前未完成符号已读入的位数
+    bool allOnes = true;                        // 填充位必须全为1
+    for(size_t i = 0; i < len; i++){
+        for(int b = 7; b >= 0; b--){
+            int bit = (data[i] >> b) & 1;
+            int next = huffTree.nodes[cur].next[bit];
+            depth++;
+            allOnes = allOnes && bit;
+            if(next < 0){
+                int sym = -next - 1;
+                if(sym == 256){
+                    return false; // 不允许出现EOS
+                }
+                out.push_back((char)sym);
+                cur = 0;
+                depth = 0;
+                allOnes = true;
+            }else if(next == 0){
+                return false;
+            }else{
+                cur = next;
+            }
+        }
+    }
+    // 末尾填充不超过7位且为EOS的前缀
+    return depth <= 7 && allOnes;
+}
+
+void hpackEncodeInt(std::string& out, uint64_t value, int prefix, uint8_t flags){
+    uint64_t mask = (1u << prefix) - 1;
+    if(value < mask){
+        out.push_back((char)(flags | value));
+        return;
+    }
+    out.push_back((char)(flags | mask));
+    value -= mask;
+    while(value >= 128){
+        out.push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool hpackDecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value){
+    if(p >= end){
+        return false;
+    }
+    uint64_t mask = (1u << prefix) - 1;
+    value = *p++ & mask;
+    if(value < mask){
+        return true;
+    }
+    int shift = 0;
+    while(p < end){
+        uint8_t b = *p++;
+        value += (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)){
+            return true;
+        }
+        shift += 7;
+        if(shift > 28){
+            return false; // 超出合理范围
+        }
+    }
+    return false;
+}
+
+void hpackTable::evict(size_t limit){
+    while(size > limit && !entries.empty()){
+        const hpackHeader& h = entries.back();
+        size -= h.name.size() + h.value.size() + 32;
+        entries.pop_back();
+    }
+}
+
+void hpackTable::setMaxSize(size_t newSize){
+    maxSize = newSize;
+    evict(maxSize);
+}
+
+void hpackTable::add(const std::string& name, const std::string& value){
+    size_t entrySize = name.size() + value.size() + 32;
+    if(entrySize > maxSize){
+        // 条目比整个表大：清空表，不加入
+        evict(0);
+        return;
+    }
+    evict(maxSize - entrySize);
+    entries.push_front(hpackHeader{name, value});
+    size += entrySize;
+}
+
+bool hpackTable::get(size_t index, std::string& name, std::string& value) const{
+    if(index == 0){
+        return false;
+    }
+    if(index <= STATIC_TABLE_LEN){
+        name = staticTable[index - 1].name;
+        value = staticTable[index - 1].value;
+        return true;
+    }
+    index -= STATIC_TABLE_LEN + 1;
+    if(index >= entries.size()){
+        return false;
+    }
+    name = entries[index].name;
+    value = entries[index].value;
+    return true;
+}
+
+size_t hpackTable::find(const std::string& name, const std::string& value, bool* nameOnly) const{
+    size_t nameIndex = 0;
+    for(size_t i = 0; i < STATIC_TABLE_LEN; i++){
+        if(name == staticTable[i].name){
+            if(value == staticTable[i].value){
+                *nameOnly = false;
+                return i + 1;
+            }
+            if(!nameIndex){
+                nameIndex = i + 1;
+            }
+        }
+    }
+    for(size_t i = 0; i < entries.size(); i++){
+        if(entries[i].name == name){
+            if(entries[i].value == value){
+                *nameOnly = false;
+                return STATIC_TABLE_LEN + 1 + i;
+            }
+            if(!nameIndex){
+                nameIndex = STATIC_TABLE_LEN + 1 + i;
+            }
+        }
+    }
+    *nameOnly = true;
+    return nameIndex;
+}
+
+bool hpackDecoder::decodeString(const uint8_t*& p, const uint8_t* end, std::string& out){
+    if(p >= end){
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t len;
+    if(!hpackDecodeInt(p, end, 7, len) || len > (uint64_t)(end - p)){
+        return false;
+    }
+    out.clear();
+    if(huffman){
+        if(!huffmanDecode(p, len, out)){
+            return false;
+        }
+    }else{
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+bool hpackDecoder::decode(const uint8_t* data, size_t len, std::vector<hpackHeader>& headers){
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t listSize = 0;
+    bool first = true;                          // 动态表容量更新只能出现在头部块开头
+    while(p < end){
+        uint8_t b = *p;
+        uint64_t index;
+        hpackHeader h;
+        if(b & 0x80){
+            // 索引表示
+            if(!hpackDecodeInt(p, end, 7, index) || !table.get(index, h.name, h.value)){
+                return false;
+            }
+        }else if((b & 0xe0) == 0x20){
+            // 动态表容量更新
+            if(!first || !hpackDecodeInt(p, end, 5, index) || index > HPACK_TABLE_SIZE){
+                return false;
+            }
+            table.setMaxSize(index);
+            continue;
+        }else{
+            // 字面量：01增量索引，0000不索引，0001永不索引
+            bool incremental = b & 0x40;
+            int prefix = incremental ? 6 : 4;
+            if(!hpackDecodeInt(p, end, prefix, index)){
+                return false;
+            }
+            if(index == 0){
+                if(!decodeString(p, end, h.name)){
+                    return false;
+                }
+            }else{
+                std::string unused;
+                if(!table.get(index, h.name, unused)){
+                    return false;
+                }
+            }
+            if(!decodeString(p, end, h.value)){
+                return false;
+            }
+            if(incremental){
+                table.add(h.name, h.value);
+            }
+        }
+        first = false;
+        listSize += h.name.size() + h.value.size() + 32;
+        if(listSize > HPACK_MAX_HEADER_LIST){
+            return false;
+        }
+        headers.push_back(h);
+    }
+    return true;
+}
+
+void hpackEncoder::setMaxTableSize(size_t newSize){
+    if(newSize > HPACK_TABLE_SIZE){
+        newSize = HPACK_TABLE_SIZE; // 编码端不使用超过默认值的表
+    }
+    pendingUpdate = true;
+    pendingSize = newSize;
+    table.setMaxSize(newSize);
+}
+
+void hpackEncoder::encode(const std::string& name, const std::string& value, bool index, std::string& out){
+    if(pendingUpdate){
+        hpackEncodeInt(out, pendingSize, 5, 0x20);
+        pendingUpdate = false;
+    }
+    bool nameOnly = false;
+    size_t i = table.find(name, value, &nameOnly);
+    if(i && !nameOnly){
+        hpackEncodeInt(out, i, 7, 0x80);
+        return;
+    }
+    if(index){
+        hpackEncodeInt(out, i, 6, 0x40);
+    }else{
+        hpackEncodeInt(out, i, 4, 0x00);
+    }
+    if(!i){
+        hpackEncodeInt(out, name.size(), 7, 0x00);
+        out += name;
+    }
+    hpackEncodeInt(out, value.size(), 7, 0x00);
+    out += value;
+    if(index){
+        table.add(name, value);
+    }
+}
@@ -0,0 +1,74 @@
+// HPACK头部压缩(RFC 7541)：静态表、动态表、整数和字符串编码、Huffman解码
+#ifndef HPACK_H
+#define HPACK_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+#define HPACK_TABLE_SIZE 4096                   // 默认动态表容量
+#define HPACK_MAX_HEADER_LIST 16384             // 解码后头部总大小上限
+
+struct hpackHeader{
+    std::string name;
+    std::string value;
+};
+
+// 头部表：索引1-61为静态表，之后为动态表，新条目索引最小
+class hpackTable{
+    public:
+        hpackTable() : size(0), maxSize(HPACK_TABLE_SIZE){}
+
+        void setMaxSize(size_t newSize);
+
+        void add(const std::string& name, const std::string& value);
+
+        bool get(size_t index, std::string& name, std::string& value) const;
+
+        // 返回完全匹配的索引；仅名称匹配时*nameOnly为true；未找到返回0
+        size_t find(const std::string& name, const std::string& value, bool* nameOnly) const;
+
+    private:
+        void evict(size_t limit);
+
+        std::deque<hpackHeader> entries;
+        size_t size;                            // 条目大小之和，每个条目为名称+值+32
+        size_t maxSize;
+};
+
+class hpackDecoder{
+    public:
+        // 解码1个完整的头部块，格式错误返回false，对应COMPRESSION_ERROR
+        bool decode(const uint8_t* data, size_t len, std::vector<hpackHeader>& headers);
+
+    private:
+        bool decodeString(const uint8_t*& p, const uint8_t* end, std::string& out);
+
+        hpackTable table;
+};
+
+class hpackEncoder{
+    public:
+        hpackEncoder() : pendingUpdate(false), pendingSize(0){}
+
+        // 对端SETTINGS_HEADER_TABLE_SIZE变化，在下一个头部块开头通知
+        void setMaxTableSize(size_t newSize);
+
+        // index为true时加入动态表，适合重复出现的头部；字符串不做Huffman编码
+        void encode(const std::string& name, const std::string& value, bool index, std::string& out);
+
+    private:
+        hpackTable table;
+        bool pendingUpdate;
+        size_t pendingSize;
+};
+
+// 整数编码，prefix为前缀位数，flags为首字节的高位标志
+void hpackEncodeInt(std::string& out, uint64_t value, int prefix, uint8_t flags);
+
+bool hpackDecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value);
+
+bool huffmanDecode(const uint8_t* data, size_t len, std::string& out);
+
+#endif
@@ -0,0 +1,597 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "http2.h"
+#include "httpConnect.h"
+
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+#define SETTINGS_HEADER_TABLE_SIZE 0x1
+#define SETTINGS_ENABLE_PUSH 0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define SETTINGS_MAX_FRAME_SIZE 0x5
+#define SETTINGS_MAX_HEADER_LIST_SIZE 0x6
+
+#define H2_MAX_WINDOW 0x7fffffff
+#define H2_DATA_CHUNK 16384                     // 每个流每轮最多发送的字节，保证多个流交替推进
+
+static uint32_t get32(const uint8_t* p){
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put32(std::string& out, uint32_t v){
+    out.push_back((char)(v >> 24));
+    out.push_back((char)(v >> 16));
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+// HTTP2-Settings头部为base64url编码，不含填充
+static bool base64urlDecode(const char* in, std::string& out){
+    uint32_t acc = 0;
+    int bits = 0;
+    for(; *in && *in != ' ' && *in != '\t'; in++){
+        char c = *in;
+        int v;
+        if(c >= 'A' && c <= 'Z') v = c - 'A';
+        else if(c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if(c >= '0' && c <= '9') v = c - '0' + 52;
+        else if(c == '-') v = 62;
+        else if(c == '_') v = 63;
+        else if(c == '=') break;
+        else return false;
+        acc = acc << 6 | v;
+        bits += 6;
+        if(bits >= 8){
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+h2Response::~h2Response(){
+    if(mapped){
+        munmap(mapped, size);
+    }
+}
+
+http2Session::http2Session(httpConnect* conn) : m_conn(conn), outPos(0), prefaceReceived(false), goaway(false),
+    continuationStream(0), continuationEnd(false), lastStreamId(0), connWindow(H2_DEFAULT_WINDOW),
+    peerInitialWindow(H2_DEFAULT_WINDOW), peerMaxFrame(H2_MAX_FRAME_SIZE){
+    // 连接建立时已设置TCP_NODELAY，小帧(WINDOW_UPDATE的响应、TLS记录尾部)不被Nagle算法延迟
+    // 服务端连接前言：SETTINGS帧
+    sendSettings();
+}
+
+void http2Session::feed(const char* data, size_t len){
+    inBuf.append(data, len);
+}
+
+void http2Session::upgrade(const char* settings, const char* method, const char* path){
+    // 101响应在服务端SETTINGS之前发送
+    outBuf.insert(0, "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    std::string raw;
+    if(settings && base64urlDecode(settings, raw) && raw.size() % 6 == 0){
+        const uint8_t* p = (const uint8_t*)raw.data();
+        for(size_t i = 0; i < raw.size(); i += 6){
+            applySetting((uint16_t)(p[i] << 8 | p[i + 1]), get32(p + i + 2));
+        }
+    }
+    // 升级请求成为流1，请求已接收完整
+    std::unique_ptr<h2Stream> s(new h2Stream());
+    s->id = 1;
+    s->method = method;
+    s->path = path;
+    s->endStream = true;
+    s->window = peerInitialWindow;
+    s->sent = 0;
+    h2Stream* p = s.get();
+    streams[1] = std::move(s);
+    lastStreamId = 1;
+    respond(p);
+}
+
+bool http2Session::process(){
+    char buf[H2_MAX_FRAME_SIZE];
+    bool ok = parse();
+    while(ok){
+        int n = m_conn->recvBytes(buf, sizeof(buf));
+        if(n > 0){
+            inBuf.append(buf, n);
+            ok = parse();
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        return false; // 对端关闭或读错误
+    }
+    // 协议错误时尽力发送GOAWAY后关闭
+    if(!flush() || !ok){
+        return false;
+    }
+    // 收到GOAWAY：已有的流全部发送完毕后关闭
+    return !(goaway && streams.empty() && !wantWrite());
+}
+
+bool http2Session::resume(){
+    std::vector<uint32_t> ids;
+    ids.swap(deferredStreams);
+    for(uint32_t sid : ids){
+        // 推迟期间被RST_STREAM取消的流已删除
+        auto it = streams.find(sid);
+        if(it != streams.end()){
+            it->second->resp.deferred = false;
+            respond(it->second.get());
+        }
+    }
+    if(!flush()){
+        return false;
+    }
+    return !(goaway && streams.empty() && !wantWrite());
+}
+
+// 解析输入缓冲中的完整帧，不完整的帧留到下次
+bool http2Session::parse(){
+    if(!prefaceReceived){
+        size_t n = inBuf.size() < H2_PREFACE_LEN ? inBuf.size() : H2_PREFACE_LEN;
+        if(memcmp(inBuf.data(), H2_PREFACE, n) != 0){
+            return false;
+        }
+        if(n < H2_PREFACE_LEN){
+            return true;
+        }
+        inBuf.erase(0, H2_PREFACE_LEN);
+        prefaceReceived = true;
+    }
+    size_t pos = 0;
+    while(inBuf.size() - pos >= H2_FRAME_HEADER_LEN){
+        const uint8_t* p = (const uint8_t*)inBuf.data() + pos;
+        uint32_t len = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        uint8_t type = p[3];
+        uint8_t flags = p[4];
+        uint32_t sid = get32(p + 5) & H2_MAX_WINDOW;
+        if(len > H2_MAX_FRAME_SIZE){
+            inBuf.clear();
+            return connectionError(H2_FRAME_SIZE_ERROR);
+        }
+        if(inBuf.size() - pos < H2_FRAME_HEADER_LEN + len){
+            break;
+        }
+        if(!handleFrame(type, flags, sid, p + H2_FRAME_HEADER_LEN, len)){
+            inBuf.clear();
+            return false;
+        }
+        pos += H2_FRAME_HEADER_LEN + len;
+    }
+    inBuf.erase(0, pos);
+    return true;
+}
+
+bool http2Session::handleFrame(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t* payload, uint32_t len){
+    // 头部块未结束时只允许同一流的CONTINUATION
+    if(continuationStream && (type != CONTINUATION || sid != continuationStream)){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    switch(type){
+        case DATA:
+            return onData(sid, flags, payload, len);
+        case HEADERS:
+            return onHeaders(sid, flags, payload, len);
+        case PRIORITY:
+            // 不按优先级调度，只校验格式
+            if(sid == 0){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            if(len != 5){
+                resetStream(sid, H2_FRAME_SIZE_ERROR);
+            }
+            return true;
+        case RST_STREAM:
+            if(sid == 0 || sid > lastStreamId){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            if(len != 4){
+                return connectionError(H2_FRAME_SIZE_ERROR);
+            }
+            streams.erase(sid);
+            sendQueue.remove(sid);
+            return true;
+        case SETTINGS:
+            if(sid != 0){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            return onSettings(flags, payload, len);
+        case PUSH_PROMISE:
+            // 客户端不能推送
+            return connectionError(H2_PROTOCOL_ERROR);
+        case PING:
+            if(sid != 0){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            if(len != 8){
+                return connectionError(H2_FRAME_SIZE_ERROR);
+            }
+            if(!(flags & FLAG_ACK)){
+                frameHeader(8, PING, FLAG_ACK, 0);
+                outBuf.append((const char*)payload, 8);
+            }
+            return true;
+        case GOAWAY:
+            if(sid != 0){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            goaway = true;
+            return true;
+        case WINDOW_UPDATE:
+            return onWindowUpdate(sid, payload, len);
+        case CONTINUATION:
+            if(!continuationStream){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            headerBlock.append((const char*)payload, len);
+            if(headerBlock.size() > HPACK_MAX_HEADER_LIST){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            if(flags & FLAG_END_HEADERS){
+                continuationStream = 0;
+                return onHeaderBlock(sid, continuationEnd);
+            }
+            return true;
+        default:
+            // 未知帧类型忽略
+            return true;
+    }
+}
+
+bool http2Session::onHeaders(uint32_t sid, uint8_t flags, const uint8_t* payload, uint32_t len){
+    if(sid == 0 || (sid & 1) == 0){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    uint32_t off = 0, pad = 0;
+    if(flags & FLAG_PADDED){
+        if(len < 1){
+            return connectionError(H2_PROTOCOL_ERROR);
+        }
+        pad = payload[0];
+        off = 1;
+    }
+    if(flags & FLAG_PRIORITY){
+        off += 5;
+    }
+    if(off + pad > len){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    headerBlock.assign((const char*)payload + off, len - off - pad);
+    bool end = flags & FLAG_END_STREAM;
+    if(!(flags & FLAG_END_HEADERS)){
+        continuationStream = sid;
+        continuationEnd = end;
+        return true;
+    }
+    return onHeaderBlock(sid, end);
+}
+
+// 完整的头部块：解码后创建流，请求没有请求体时立即响应
+bool http2Session::onHeaderBlock(uint32_t sid, bool endStream){
+    std::vector<hpackHeader> headers;
+    // 被拒绝的流也要解码，保持动态表同步
+    if(!decoder.decode((const uint8_t*)headerBlock.data(), headerBlock.size(), headers)){
+        return connectionError(H2_COMPRESSION_ERROR);
+    }
+    headerBlock.clear();
+
+    auto it = streams.find(sid);
+    if(it != streams.end()){
+        // 请求体之后的trailer，必须结束请求
+        h2Stream* s = it->second.get();
+        if(s->endStream || !endStream){
+            return connectionError(H2_PROTOCOL_ERROR);
+        }
+        s->endStream = true;
+        respond(s);
+        return true;
+    }
+    // 客户端的流ID必须递增
+    if(sid <= lastStreamId){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    lastStreamId = sid;
+    if(goaway){
+        return true;
+    }
+    if(streams.size() >= H2_MAX_STREAMS){
+        resetStream(sid, H2_REFUSED_STREAM);
+        return true;
+    }
+
+    std::unique_ptr<h2Stream> s(new h2Stream());
+    s->id = sid;
+    s->endStream = endStream;
+    s->window = peerInitialWindow;
+    s->sent = 0;
+    for(size_t i = 0; i < headers.size(); i++){
+        if(headers[i].name == ":method"){
+            s->method = headers[i].value;
+        }else if(headers[i].name == ":path"){
+            s->path = headers[i].value;
+        }
+    }
+    if(s->method.empty() || s->path.empty()){
+        resetStream(sid, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    h2Stream* p = s.get();
+    streams[sid] = std::move(s);
+    if(endStream){
+        respond(p);
+    }
+    return true;
+}
+
+bool http2Session::onData(uint32_t sid, uint8_t flags, const uint8_t* payload, uint32_t len){
+    if(sid == 0){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    // 请求体很小，收到后立即归还连接窗口
+    if(len > 0){
+        sendWindowUpdate(0, len);
+    }
+    auto it = streams.find(sid);
+    if(it == streams.end() || it->second->endStream){
+        if(sid > lastStreamId){
+            return connectionError(H2_PROTOCOL_ERROR);
+        }
+        resetStream(sid, H2_STREAM_CLOSED);
+        return true;
+    }
+    h2Stream* s = it->second.get();
+    uint32_t off = 0, pad = 0;
+    if(flags & FLAG_PADDED){
+        if(len < 1){
+            return connectionError(H2_PROTOCOL_ERROR);
+        }
+        pad = payload[0];
+        off = 1;
+    }
+    if(off + pad > len){
+        return connectionError(H2_PROTOCOL_ERROR);
+    }
+    if(s->body.size() + len - off - pad > H2_MAX_BODY){
+        resetStream(sid, H2_CANCEL);
+        return true;
+    }
+    s->body.append((const char*)payload + off, len - off - pad);
+    if(flags & FLAG_END_STREAM){
+        s->endStream = true;
+        respond(s);
+    }else if(len > 0){
+        sendWindowUpdate(sid, len);
+    }
+    return true;
+}
+
+bool http2Session::onSettings(uint8_t flags, const uint8_t* payload, uint32_t len){
+    if(flags & FLAG_ACK){
+        if(len != 0){
+            return connectionError(H2_FRAME_SIZE_ERROR);
+        }
+        return true;
+    }
+    if(len % 6 != 0){
+        return connectionError(H2_FRAME_SIZE_ERROR);
+    }
+    for(uint32_t i = 0; i < len; i += 6){
+        if(!applySetting((uint16_t)(payload[i] << 8 | payload[i + 1]), get32(payload + i + 2))){
+            return false;
+        }
+    }
+    frameHeader(0, SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+bool http2Session::applySetting(uint16_t id, uint32_t value){
+    switch(id){
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.setMaxTableSize(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if(value > 1){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:{
+            if(value > H2_MAX_WINDOW){
+                return connectionError(H2_FLOW_CONTROL_ERROR);
+            }
+            // 初始窗口的变化量作用于所有已打开的流
+            int64_t delta = (int64_t)value - peerInitialWindow;
+            for(auto it = streams.begin(); it != streams.end(); ++it){
+                it->second->window += delta;
+            }
+            peerInitialWindow = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if(value < 16384 || value > 16777215){
+                return connectionError(H2_PROTOCOL_ERROR);
+            }
+            peerMaxFrame = value;
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+bool http2Session::onWindowUpdate(uint32_t sid, const uint8_t* payload, uint32_t len){
+    if(len != 4){
+        return connectionError(H2_FRAME_SIZE_ERROR);
+    }
+    uint32_t inc = get32(payload) & H2_MAX_WINDOW;
+    if(sid == 0){
+        if(inc == 0){
+            return connectionError(H2_PROTOCOL_ERROR);
+        }
+        connWindow += inc;
+        if(connWindow > H2_MAX_WINDOW){
+            return connectionError(H2_FLOW_CONTROL_ERROR);
+        }
+        return true;
+    }
+    auto it = streams.find(sid);
+    if(it == streams.end()){
+        // 已关闭的流
+        return true;
+    }
+    if(inc == 0){
+        resetStream(sid, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    it->second->window += inc;
+    if(it->second->window > H2_MAX_WINDOW){
+        resetStream(sid, H2_FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+// 分发请求并发送响应头，响应体加入发送队列
+void http2Session::respond(h2Stream* s){
+    m_conn->h2Dispatch(s->method.c_str(), s->path, s->body, s->resp);
+    if(s->resp.deferred){
+        deferredStreams.push_back(s->id);
+        return;
+    }
+    std::string block;
+    char status[8];
+    snprintf(status, sizeof(status), "%d", s->resp.status);
+    encoder.encode(":status", status, true, block);
+    encoder.encode("content-type", s->resp.contentType, true, block);
+    encoder.encode("content-length", std::to_string(s->resp.size), false, block);
+    if(s->resp.cacheControl){
+        encoder.encode("cache-control", s->resp.cacheControl, true, block);
+    }
+
+    bool noBody = s->resp.size == 0 || s->method == "HEAD";
+    frameHeader(block.size(), HEADERS, FLAG_END_HEADERS | (noBody ? FLAG_END_STREAM : 0), s->id);
+    outBuf.append(block);
+    if(noBody){
+        streams.erase(s->id);
+        return;
+    }
+    sendQueue.push_back(s->id);
+}
+
+// 轮转调度：每个流每轮最多发送H2_DATA_CHUNK，受连接和流两级窗口限制
+bool http2Session::schedule(){
+    // h2c升级时等待客户端连接前言后再发送响应体，避免客户端的升级缓冲区溢出
+    if(!prefaceReceived){
+        return false;
+    }
+    bool wrote = false;
+    size_t blocked = 0; // 连续因流窗口耗尽而跳过的流
+    while(!sendQueue.empty() && connWindow > 0 && blocked < sendQueue.size()
+        && outBuf.size() - outPos < H2_OUTPUT_LIMIT){
+        uint32_t sid = sendQueue.front();
+        sendQueue.pop_front();
+        auto it = streams.find(sid);
+        if(it == streams.end()){
+            continue;
+        }
+        h2Stream* s = it->second.get();
+        if(s->window <= 0){
+            // 等待对端WINDOW_UPDATE
+            sendQueue.push_back(sid);
+            blocked++;
+            continue;
+        }
+        size_t chunk = s->resp.size - s->sent;
+        if(chunk > H2_DATA_CHUNK) chunk = H2_DATA_CHUNK;
+        if(chunk > peerMaxFrame) chunk = peerMaxFrame;
+        if((int64_t)chunk > s->window) chunk = s->window;
+        if((int64_t)chunk > connWindow) chunk = connWindow;
+        bool last = s->sent + chunk == s->resp.size;
+        frameHeader(chunk, DATA, last ? FLAG_END_STREAM : 0, sid);
+        outBuf.append(s->resp.data + s->sent, chunk);
+        s->sent += chunk;
+        s->window -= chunk;
+        connWindow -= chunk;
+        wrote = true;
+        blocked = 0;
+        if(last){
+            streams.erase(it);
+        }else{
+            sendQueue.push_back(sid);
+        }
+    }
+    return wrote;
+}
+
+// 发送输出缓冲，发送完毕后继续调度DATA帧，直到socket写满或没有可发送的数据
+bool http2Session::flush(){
+    while(1){
+        if(outPos == outBuf.size()){
+            outBuf.clear();
+            outPos = 0;
+            if(!schedule()){
+                return true;
+            }
+        }
+        struct iovec iv;
+        iv.iov_base = &outBuf[outPos];
+        iv.iov_len = outBuf.size() - outPos;
+        int n = m_conn->sendv(&iv, 1);
+        if(n < 0){
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        outPos += n;
+    }
+}
+
+void http2Session::frameHeader(uint32_t len, uint8_t type, uint8_t flags, uint32_t sid){
+    outBuf.push_back((char)(len >> 16));
+    outBuf.push_back((char)(len >> 8));
+    outBuf.push_back((char)len);
+    outBuf.push_back((char)type);
+    outBuf.push_back((char)flags);
+    put32(outBuf, sid);
+}
+
+void http2Session::sendSettings(){
+    frameHeader(12, SETTINGS, 0, 0);
+    outBuf.push_back(0);
+    outBuf.push_back(SETTINGS_MAX_CONCURRENT_STREAMS);
+    put32(outBuf, H2_MAX_STREAMS);
+    outBuf.push_back(0);
+    outBuf.push_back(SETTINGS_MAX_HEADER_LIST_SIZE);
+    put32(outBuf, HPACK_MAX_HEADER_LIST);
+}
+
+void http2Session::sendWindowUpdate(uint32_t sid, uint32_t increment){
+    frameHeader(4, WINDOW_UPDATE, 0, sid);
+    put32(outBuf, increment);
+}
+
+// 流错误：只关闭该流
+void http2Session::resetStream(uint32_t sid, uint32_t code){
+    frameHeader(4, RST_STREAM, 0, sid);
+    put32(outBuf, code);
+    streams.erase(sid);
+    sendQueue.remove(sid);
+}
+
+// 连接错误：发送GOAWAY，之后关闭连接
+bool http2Session::connectionError(uint32_t code){
+    frameHeader(8, GOAWAY, 0, 0);
+    put32(outBuf, lastStreamId);
+    put32(outBuf, code);
+    goaway = true;
+    return false;
+}
@@ -0,0 +1,124 @@
+// HTTP/2(RFC 7540)：帧解析、流多路复用、流量控制，DATA帧在各流之间轮转发送
+#ifndef HTTP2_H
+#define HTTP2_H
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <memory>
+#include "hpack.h"
+#include "fileCache.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER_LEN 9
+#define H2_DEFAULT_WINDOW 65535                 // 初始流量控制窗口
+#define H2_MAX_FRAME_SIZE 16384                 // 本端接收的最大帧
+#define H2_MAX_STREAMS 100                      // 最大并发流
+#define H2_MAX_BODY 65536                       // 请求体上限
+#define H2_OUTPUT_LIMIT 65536                   // 每轮调度写入输出缓冲的上限
+
+class httpConnect;
+
+// 流的响应：响应体来自文件缓存、文件映射或body
+struct h2Response{
+    int status;
+    const char* contentType;
+    const char* cacheControl;                   // NULL表示不发送
+    const char* data;
+    size_t size;
+    cacheEntryPtr cache;                        // 持有缓存条目的引用
+    char* mapped;                               // 文件映射，流结束时munmap
+    std::string body;                           // 错误页等小响应
+    std::string typeBuf;                        // 反向代理响应的Content-Type
+    bool deferred;                              // 转发给后端的流，响应推迟到反向代理的专用线程上生成
+
+    h2Response() : status(200), contentType("text/html"), cacheControl(NULL), data(NULL), size(0), mapped(NULL), deferred(false){}
+    ~h2Response();
+};
+
+class http2Session{
+    public:
+        enum FRAME_TYPE { DATA = 0, HEADERS, PRIORITY, RST_STREAM, SETTINGS, PUSH_PROMISE, PING, GOAWAY, WINDOW_UPDATE, CONTINUATION };
+        enum ERROR_CODE { H2_NO_ERROR = 0, H2_PROTOCOL_ERROR, H2_INTERNAL_ERROR, H2_FLOW_CONTROL_ERROR, H2_SETTINGS_TIMEOUT,
+                          H2_STREAM_CLOSED, H2_FRAME_SIZE_ERROR, H2_REFUSED_STREAM, H2_CANCEL, H2_COMPRESSION_ERROR };
+
+        http2Session(httpConnect* conn);
+
+        // 已读入的字节(如读缓冲中的连接前言)
+        void feed(const char* data, size_t len);
+
+        // h2c升级：先发送101响应，原HTTP/1.1请求作为流1；settings为HTTP2-Settings头部的值
+        void upgrade(const char* settings, const char* method, const char* path);
+
+        // 工作线程调用：读取并处理帧，生成响应，尽可能发送；返回false时关闭连接
+        bool process();
+
+        // 有推迟生成响应的流
+        bool deferred() const { return !deferredStreams.empty(); }
+
+        // 反向代理的专用线程调用：生成推迟的流的响应，尽可能发送；返回false时关闭连接
+        bool resume();
+
+        // 输出缓冲中仍有数据，需等待EPOLLOUT
+        bool wantWrite() const { return outPos < outBuf.size(); }
+
+        // 没有未完成的流和待发送的数据，排空时可以直接关闭
+        bool idle() const { return streams.empty() && !wantWrite(); }
+
+    private:
+        struct h2Stream{
+            uint32_t id;
+            std::string method;
+            std::string path;
+            std::string body;
+            bool endStream;                     // 请求已接收完整
+            int64_t window;                     // 发送窗口
+            h2Response resp;
+            size_t sent;
+        };
+
+        bool parse();
+        bool handleFrame(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t* payload, uint32_t len);
+        bool onHeaders(uint32_t sid, uint8_t flags, const uint8_t* payload, uint32_t len);
+        bool onHeaderBlock(uint32_t sid, bool endStream);
+        bool onData(uint32_t sid, uint8_t flags, const uint8_t* payload, uint32_t len);
+        bool onSettings(uint8_t flags, const uint8_t* payload, uint32_t len);
+        bool onWindowUpdate(uint32_t sid, const uint8_t* payload, uint32_t len);
+        bool applySetting(uint16_t id, uint32_t value);
+
+        void respond(h2Stream* s);
+        bool schedule();                        // 轮转填充DATA帧，返回是否写入了数据
+        bool flush();
+
+        void frameHeader(uint32_t len, uint8_t type, uint8_t flags, uint32_t sid);
+        void sendSettings();
+        void sendWindowUpdate(uint32_t sid, uint32_t increment);
+        void resetStream(uint32_t sid, uint32_t code);
+        bool connectionError(uint32_t code);
+
+    private:
+        httpConnect* m_conn;
+        std::string inBuf;                      // 未处理的输入
+        std::string outBuf;                     // 待发送的帧
+        size_t outPos;
+        bool prefaceReceived;
+        bool goaway;                            // 已发送或收到GOAWAY，发送完毕后关闭
+
+        hpackDecoder decoder;
+        hpackEncoder encoder;
+        std::string headerBlock;                // HEADERS + CONTINUATION拼接的头部块
+        uint32_t continuationStream;            // 等待CONTINUATION的流，0表示无
+        bool continuationEnd;                   // 该头部块所在的HEADERS带有END_STREAM
+
+        std::map<uint32_t, std::unique_ptr<h2Stream> > streams;
+        std::list<uint32_t> sendQueue;          // 有响应体待发送的流，轮转调度
+        std::vector<uint32_t> deferredStreams;  // 推迟生成响应的流，按请求顺序
+        uint32_t lastStreamId;                  // 已处理的最大流ID
+        int64_t connWindow;                     // 连接级发送窗口
+        uint32_t peerInitialWindow;             // 对端SETTINGS_INITIAL_WINDOW_SIZE
+        uint32_t peerMaxFrame;                  // 对端SETTINGS_MAX_FRAME_SIZE
+};
+
+#endif
@@ -1,4 +1,10 @@
 #include "httpConnect.h"
+#include "userStore.h"
+#include "supervisor.h"
+#include <openssl/err.h>
+#include <poll.h>
+#include <sched.h>
+#include <netinet/tcp.h>
 
 // 定义HTTP响应的一些状态信息
 const char* ok_200_title = "OK";
@@ -8,13 +14,28 @@ const char* error_403_title = "Forbidden";
 const char* error_403_form = "You do not have permission to get file from this server.\n";
 const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
+const char* error_405_title = "Method Not Allowed";
+const char* error_405_form = "The request method is not supported by the requested resource.\n";
+const char* error_413_title = "Payload Too Large";
+const char* error_413_form = "The request body does not fit in the read buffer of this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_502_title = "Bad Gateway";
+const char* error_502_form = "The upstream server is unavailable or returned an invalid response.\n";
 
 
 // 静态变量初始化，记录总的连接数
 int httpConnect::m_epollfd = -1;
-int httpConnect::userCnt = 0;
+std::atomic<int> httpConnect::userCnt(0);
+std::atomic<bool> httpConnect::m_draining(false);
+int httpConnect::m_maxRequests = MAX_KEEPALIVE_REQUESTS;
+
+// 请求头表以16位偏移记录字段位置
+static_assert(READ_BUFFER_SIZE <= 65536, "header offsets are 16-bit");
+router<httpConnect::routeHandler> httpConnect::m_router;
+
+// 请求方法名，与METHOD顺序一致
+static const char* methodNames[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT"};
 
 // 设置文件描述符为非阻塞
 void setNonblock(int fd){
@@ -50,27 +71,75 @@ void modfd(int epollfd, int fd, int ev){
 }
 
 // 初始化
-void httpConnect::init(int sockfd, const sockaddr_in &addr){
+bool httpConnect::init(int sockfd, const sockaddr_storage &addr, bool tls){
+    // fd号被复用：与上一个连接closeConnect中CONN_CLOSED的release配对，其对成员的修改都在关闭fd之前完成
+    if(m_state.load(std::memory_order_acquire) != CONN_CLOSED){
+        return false;
+    }
+    // HTTPS连接需先完成握手；创建SSL失败时不能按明文处理
+    SSL* ssl = tls ? sslContext::newSSL(sockfd) : NULL;
+    if(tls && !ssl){
+        return false;
+    }
     m_socketfd = sockfd;
     m_address = addr;
+    m_generation++;
+    targetFileAddress = 0;
+    m_cacheEntry.reset();
+    m_respEntry.reset();
+    m_ssl = ssl;
+    m_handshakeDone = !m_ssl;
+    m_ktls = false;
+    m_h2 = NULL;
+    m_paced = false;
+    m_writeMore = false;
+    m_h2Resp = NULL;
+    m_proxyHandoff = false;
+    m_traceId = 0;
     // 端口复用
     int optval = 1;
     setsockopt(m_socketfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
-    // 添加到epoll实例
-    addfd(m_epollfd, m_socketfd, true);
+    // 报文段的边界由MSG_MORE决定，不经Nagle算法延迟：流式响应的结束块、HTTP/2的小帧都不等待对端ACK
+    if(m_address.ss_family != AF_UNIX){
+        setsockopt(m_socketfd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    }
     userCnt++;
     init();
+    m_requestCnt = 0;
+    // 添加到epoll实例，由reactor持有
+    m_state.store(CONN_IDLE, std::memory_order_release);
+    addfd(m_epollfd, m_socketfd, true);
+    return true;
 }
 
 // 初始化http解析的状态
 void httpConnect::init(){
-    memset(readBuf, 0, sizeof(readBuf));
-    memset(writeBuf, 0, sizeof(writeBuf));
+    // 上一个请求处理完毕
+    if(m_traceId){
+        tracer::record(m_traceId, tracer::REQUEST, 'e');
+        m_traceId = 0;
+    }
+    m_requestCnt++;
+    // 客户端流水线发送的下一个请求已在读缓冲中：前移到开头并保留缓冲，其余部分清零供解析使用
+    int leftover = 0;
+    if(!m_h2 && readBuf && m_requestEnd > 0 && m_requestEnd < readIndex){
+        leftover = readIndex - m_requestEnd;
+        readBuf[m_requestEnd] = m_requestEndByte;
+        memmove(readBuf, readBuf + m_requestEnd, leftover);
+        memset(readBuf + leftover, 0, READ_BUFFER_SIZE - leftover);
+    }
+    // 请求之间不持有读写缓冲，空闲的keep-alive连接不占用缓冲，下次读取时重新取得
+    // HTTP/2连接的处理函数可能随时使用写缓冲，持有到连接关闭
+    if(!m_h2 && leftover == 0){
+        releaseBuffers();
+    }
     memset(targetFile, 0, sizeof(targetFile));
     bytes_have_send = 0;
     bytes_to_send = 0;
     checkState = CHECK_STATE_REQUESTLINE; 
-    readIndex = 0; // 相当于char* = NULL 
+    readIndex = leftover;
+    m_requestEnd = 0;
+    m_pipelined = leftover > 0;
     lineIndex = 0;
     checkIndex = 0;
     writeIndex = 0;
@@ -79,15 +148,115 @@ void httpConnect::init(){
     httpVersion = 0;
     host = 0;
     connectState = false;
+    contentLength = 0;
+    m_content = 0;
+    m_parsed = false;
+    m_cacheBypass = false;
+    m_params.cnt = 0;
+    m_upgradeH2c = false;
+    m_h2Settings = NULL;
+    m_chunked = false;
+    m_streaming = false;
+    m_streamDone = false;
+    m_producer = nullptr;
+    m_contentType = NULL;
+    m_mime = NULL;
+    m_headers.clear();
+}
+
+// 先重置状态再注册事件，注册后连接可能立即被其他线程处理。
+// 读缓冲中已有流水线请求时，其数据已从socket读出，边沿触发下不会再有读事件，改为等待写事件：
+// 刚发送完响应的socket立即可写，reactor收到后直接解析缓冲中的请求
+void httpConnect::nextRequest(){
+    init();
+    rearm(m_pipelined ? EPOLLOUT : EPOLLIN);
 }
 
-// 关闭连接
+void httpConnect::holdBuffers(){
+    if(!readBuf){
+        readBuf = bufferPool::get();
+        writeBuf = readBuf + READ_BUFFER_SIZE;
+    }
+}
+
+void httpConnect::releaseBuffers(){
+    bufferPool::put(readBuf);
+    readBuf = NULL;
+    writeBuf = NULL;
+}
+
+// 关闭连接：CAS进入CONN_CLOSING的线程负责释放资源，最后关闭fd，之后该fd号可能立即被新连接复用
 void httpConnect::closeConnect(){
-    if(m_socketfd != -1){
-        removefd(m_epollfd, m_socketfd);
-        m_socketfd = -1;
-        userCnt--;
+    int state = m_state.load(std::memory_order_acquire);
+    do{
+        if(state == CONN_CLOSED || state == CONN_CLOSING){
+            return;
+        }
+    }while(!m_state.compare_exchange_weak(state, CONN_CLOSING, std::memory_order_acq_rel));
+    // 交还连接的线程可能仍在modfd中(事件已送达reactor)，等其返回再关闭fd
+    while(m_rearming.load() != 0){
+        sched_yield();
+    }
+
+    int fd = m_socketfd;
+    m_socketfd = -1;
+    if(m_ssl){
+        if(m_handshakeDone){
+            SSL_shutdown(m_ssl); // 非阻塞，尽力发送close_notify
+        }
+        SSL_free(m_ssl);
+        m_ssl = NULL;
+    }
+    // 释放HTTP/2会话，各流的响应体随之释放
+    delete m_h2;
+    m_h2 = NULL;
+    // 释放生产者持有的状态
+    m_producer = nullptr;
+    m_streaming = false;
+    // 预读未完成时映射交由磁盘I/O线程释放
+    if(m_diskPending.exchange(false)){
+        targetFileAddress = 0;
+    }else{
+        unmap();
+    }
+    // 等待socket事件的协程不会再被唤醒，以失败恢复，由其自行结束
+    if(m_waitHandle){
+        resumeWaiting(false);
+    }
+    releaseBuffers();
+    rateLimit::disconnect(m_address);
+    if(m_traceId){
+        tracer::record(m_traceId, tracer::REQUEST, 'e');
+        m_traceId = 0;
+    }
+    m_state.store(CONN_CLOSED, std::memory_order_release);
+    removefd(m_epollfd, fd);
+    // 排空时连接数归零后epoll实例随即关闭，计数在不再使用它之后减少
+    userCnt--;
+}
+
+bool httpConnect::acquire(){
+    int state = CONN_IDLE;
+    if(!m_state.compare_exchange_strong(state, CONN_BUSY, std::memory_order_acq_rel)){
+        return false;
+    }
+    trace(tracer::QUEUE, 'b');
+    return true;
+}
+
+// 已关闭的连接不再注册：fd可能已被关闭并分配给新连接，注册会修改新连接的事件
+void httpConnect::rearm(int ev){
+    int state = m_state.load(std::memory_order_acquire);
+    if(state == CONN_CLOSED || state == CONN_CLOSING){
+        return;
     }
+    // store之后reactor可能随时收到事件并关闭连接，除计数外不能再访问成员；
+    // 计数非0期间排空的扫描不关闭连接，否则modfd可能作用于已关闭、甚至已分配给新连接的fd
+    int fd = m_socketfd;
+    m_rearming.fetch_add(1);
+    m_state.store(CONN_IDLE, std::memory_order_release);
+    modfd(m_epollfd, fd, ev);
+    m_rearming.fetch_sub(1);
 }
 
 // 循环读数据
@@ -95,9 +264,18 @@ bool httpConnect::read(){
     if(readIndex >= READ_BUFFER_SIZE){ // 缓冲区已满
         return false;
     }
+    // 新请求的第1次读取时决定是否追踪，请求和分发阶段从epoll_wait返回时算起
+    if(readIndex == 0 && !m_traceId && (m_traceId = tracer::sample())){
+        tracer::recordAt(m_traceId, tracer::REQUEST, 'b', tracer::wakeTime());
+        tracer::recordAt(m_traceId, tracer::DISPATCH, 'b', tracer::wakeTime());
+        tracer::record(m_traceId, tracer::DISPATCH, 'e');
+    }
+    holdBuffers();
+    trace(tracer::READ, 'b');
     int readBytes = 0;
-    while(1){
-        readBytes = recv(m_socketfd, readBuf + readIndex, READ_BUFFER_SIZE - readIndex, 0);
+    // 缓冲区读满时先解析，chunked请求体解码后腾出空间，epoll重新注册时继续读取
+    while(readIndex < READ_BUFFER_SIZE){
+        readBytes = recvBytes(readBuf + readIndex, READ_BUFFER_SIZE - readIndex);
         if(readBytes == -1){
             // 无数据，读取结束
             if(errno == EAGAIN || errno == EWOULDBLOCK){
@@ -110,9 +288,35 @@ bool httpConnect::read(){
         }
         readIndex += readBytes; 
     }
+    trace(tracer::READ, 'e');
     return true;
 }
 
+// 读取socket：HTTPS连接由OpenSSL解密，启用kTLS接收时在内核中解密
+int httpConnect::recvBytes(char* buf, int len){
+    if(!m_ssl){
+        return recv(m_socketfd, buf, len, 0);
+    }
+    if(len <= 0){
+        return 0;
+    }
+    ERR_clear_error();
+    int n = SSL_read(m_ssl, buf, len);
+    if(n > 0){
+        return n;
+    }
+    int err = SSL_get_error(m_ssl, n);
+    if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE){
+        errno = EAGAIN;
+        return -1;
+    }
+    if(err == SSL_ERROR_ZERO_RETURN){
+        return 0;
+    }
+    errno = EIO;
+    return -1;
+}
+
 // 解析HTTP请求，主状态机
 httpConnect::HTTP_CODE httpConnect::process_read(){
     LINE_STATUS lineStatus = LINE_OK;
@@ -121,7 +325,7 @@ httpConnect::HTTP_CODE httpConnect::process_read(){
     char* data = 0;
     // 循环解析
     while((checkState == CHECK_STATE_CONTENT && lineStatus == LINE_OK)||
-      (lineStatus == parse_line() &&  lineStatus == LINE_OK)){
+      (checkState != CHECK_STATE_CONTENT && (lineStatus = parse_line()) == LINE_OK)){
         // 正在解析请求体或解析了一行完整数据
         // 读取数据
         data  = getline();
@@ -138,18 +342,16 @@ httpConnect::HTTP_CODE httpConnect::process_read(){
 
             case CHECK_STATE_HEADER:{
                 res = parse_header(data); // 解析请求头
-                if(res == BAD_REQUEST){
-                    return BAD_REQUEST;
-                }else if(res == GET_REQUEST){ // 获取到完整请求
-                    return solve_request(); // 处理请求
+                if(res != NO_REQUEST){ // 获取到完整请求或出错
+                    return res;
                 }
                 break;
             }
 
             case CHECK_STATE_CONTENT:{
                 res = parse_content(data); // 解析请求体
-                if(res == GET_REQUEST){
-                    return solve_request();
+                if(res != NO_REQUEST){
+                    return res;
                 }
                 lineStatus = LINE_OPEN; 
                 break;
@@ -160,22 +362,83 @@ httpConnect::HTTP_CODE httpConnect::process_read(){
             }
         }
     }
+    if(lineStatus == LINE_BAD){ // 行格式错误
+        return BAD_REQUEST;
+    }
+    // 读缓冲已满仍未读完请求体，解码后的请求体放不下
+    if(checkState == CHECK_STATE_CONTENT && readIndex >= READ_BUFFER_SIZE){
+        return PAYLOAD_TOO_LARGE;
+    }
     return NO_REQUEST; // 数据不完整
 }
 
+// 原地规范化URL的路径部分(查询字符串之前)：合并重复的'/'，去掉"."段，".."段退回上一级，
+// 路由、文件路径和缓存键都使用规范化后的结果；".."退到网站根目录之上时返回false
+static bool normalizePath(char* url){
+    char* end = url + strcspn(url, "?");
+    char* w = url;
+    char* r = url;
+    bool dirSlash = false;                      // 结果以'/'结尾
+    while(r < end){
+        while(r < end && *r == '/'){
+            r++;
+        }
+        char* seg = r;
+        while(r < end && *r != '/'){
+            r++;
+        }
+        int n = r - seg;
+        dirSlash = true;
+        if(n == 0 || (n == 1 && seg[0] == '.')){
+            continue;
+        }
+        if(n == 2 && seg[0] == '.' && seg[1] == '.'){
+            if(w == url){
+                return false;
+            }
+            while(*--w != '/'){
+            }
+            continue;
+        }
+        *w++ = '/';
+        memmove(w, seg, n);
+        w += n;
+        dirSlash = r < end;
+    }
+    if(w == url || dirSlash){
+        *w++ = '/';
+    }
+    memmove(w, end, strlen(end) + 1);
+    return true;
+}
+
 // 解析HTTP请求首行：请求方法，目标URL，HTTP协议版本
 // GET url HTTP/1.1
 httpConnect::HTTP_CODE httpConnect::parse_requsetLine(char* data){
     url = strpbrk(data, " \t"); // 在data中定位第一个匹配字符串" \t"中字符的字符
+    if(!url){ // 请求行只有1个字段
+        return BAD_REQUEST;
+    }
     *url++ = '\0';
-    if(strcasecmp(data, "GET")== 0){ // 不计大小写比较字符串
-        requestMethod = GET;
-    }else{ // 暂不支持其他请求
+    int method = 0;
+    for(; method < ROUTE_METHODS; method++){
+        if(strcasecmp(data, methodNames[method])== 0){ // 不计大小写比较字符串
+            break;
+        }
+    }
+    if(method == ROUTE_METHODS){ // 未知请求方法
         return BAD_REQUEST;
     }
+    // 方法是否支持由路由决定
+    requestMethod = (METHOD)method;
 
     httpVersion = strpbrk(url, " \t");
+    if(!httpVersion){ // 缺少协议版本
+        return BAD_REQUEST;
+    }
     *httpVersion++ = '\0';
+    // HTTP/1.1默认保持连接，HTTP/1.0需要Connection: keep-alive
+    connectState = strcasecmp(httpVersion, "HTTP/1.1") == 0;
     // webbench需注释
     /*
     if(strcasecmp(httpVersion, "HTTP/1.1")!= 0){ // 暂支持HTTP/1.1
@@ -187,7 +450,7 @@ httpConnect::HTTP_CODE httpConnect::parse_requsetLine(char* data){
         url += 7; // 192.168.3.100:1000/index.html
         url = strchr(url, '/'); // /index.html
     }
-    if(url[0] != '/'){
+    if(!url || url[0] != '/' || !normalizePath(url)){
         return BAD_REQUEST;
     }
     // 请求行解析结束
@@ -199,46 +462,210 @@ httpConnect::HTTP_CODE httpConnect::parse_requsetLine(char* data){
 httpConnect::HTTP_CODE httpConnect::parse_header(char* data){
     // 遇空行，表示头部字段解析完毕
     if(data[0] == '\0'){
+        // 排空中或已达到连接的请求数上限时，本次响应后关闭连接
+        if(m_draining.load(std::memory_order_relaxed) || (m_maxRequests > 0 && m_requestCnt + 1 >= m_maxRequests)){
+            connectState = false;
+        }
+        supervisor::countRequest();
         // 如果HTTP请求有请求体，则还需要读取contentLength字节的消息体，
         // 状态机转移到CHECK_STATE_CONTENT状态
+        if(m_chunked){
+            // chunked请求体从当前位置开始原地解码
+            m_chunkState = CHUNK_SIZE;
+            m_chunkPos = m_chunkBody = m_chunkEnd = checkIndex;
+            checkState = CHECK_STATE_CONTENT;
+            return NO_REQUEST;
+        }
         if(contentLength != 0){
+            // 请求体和结尾的'\0'须放入读缓冲
+            if(contentLength > READ_BUFFER_SIZE - 1 - checkIndex){
+                return PAYLOAD_TOO_LARGE;
+            }
             checkState = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         // 已经得到了一个完整的HTTP请求
+        m_requestEnd = checkIndex;
+        m_requestEndByte = readBuf[checkIndex];
         return GET_REQUEST;
-    }else if(strncasecmp(data, "Connection:", 11)== 0){
-        // 处理Connection 头部字段  Connection: keep-alive
-        data += 11;
-        data += strspn(data, " \t");
-        if(strcasecmp(data, "keep-alive")== 0){
-            connectState = true;
-        }
-    }else if(strncasecmp(data, "Content-Length:", 15)== 0){
-        // 处理Content-Length头部字段
-        data += 15;
-        data += strspn(data, " \t");
-        contentLength = atol(data);
-    }else if(strncasecmp(data, "Host:", 5)== 0){
-        // 处理Host头部字段
-        data += 5;
-        data += strspn(data, " \t");
-        host = data;
-    }else{
-        //printf("Error! Unknow header %s\n", data);
+    }
+    // 字段名到':'为止，值去掉首尾空白，记入请求头表
+    // 字段名与':'之间不能有空白，也不接受以空白开头的折叠行：代理与后端对字段边界的理解可能不同
+    char* colon = strchr(data, ':');
+    if(!colon || colon == data || m_headers.cnt >= MAX_HEADERS
+        || colon[-1] == ' ' || colon[-1] == '\t' || data[0] == ' ' || data[0] == '\t'){
+        return BAD_REQUEST;
+    }
+    char* value = colon + 1;
+    value += strspn(value, " \t");
+    char* end = value + strlen(value);
+    while(end > value && (end[-1] == ' ' || end[-1] == '\t')){
+        *--end = '\0';
+    }
+    int id = headerTable::lookupId(data, colon - data);
+    headerField& f = m_headers.fields[m_headers.cnt++];
+    f.name = data - readBuf;
+    f.nameLen = colon - data;
+    f.value = value - readBuf;
+    f.valueLen = end - value;
+    f.id = id;
+    if(id != HDR_OTHER && !m_headers.index[id]){
+        m_headers.index[id] = m_headers.cnt;
+    }
+    switch(id){
+        case HDR_CONNECTION:
+            // 逗号分隔的选项，如 Connection: keep-alive, Upgrade
+            if(headerHasToken(value, "close")){
+                connectState = false;
+            }else if(headerHasToken(value, "keep-alive")){
+                connectState = true;
+            }
+            break;
+        case HDR_CONTENT_LENGTH:{
+            // 只接受十进制数字，超过读缓冲的长度不再累加，在空行处返回413；重复出现时取值须相同
+            long n = 0;
+            const char* p = value;
+            for(; isdigit(*p); p++){
+                if(n <= READ_BUFFER_SIZE){
+                    n = n * 10 + (*p - '0');
+                }
+            }
+            if(p == value || *p != '\0' || (m_headers.index[id] != m_headers.cnt && n != contentLength)){
+                return BAD_REQUEST;
+            }
+            contentLength = n;
+            if(m_chunked){ // 同时出现时无法确定请求体边界
+                return BAD_REQUEST;
+            }
+            break;
+        }
+        case HDR_TRANSFER_ENCODING:
+            // 只支持chunked，其他传输编码无法解析请求体
+            if(strcasecmp(value, "chunked")!= 0 || m_headers.index[HDR_CONTENT_LENGTH]){
+                return BAD_REQUEST;
+            }
+            m_chunked = true;
+            break;
+        case HDR_UPGRADE:
+            // 升级到HTTP/2明文连接 Upgrade: h2c
+            if(headerHasToken(value, "h2c")){
+                m_upgradeH2c = true;
+            }
+            break;
+        case HDR_HTTP2_SETTINGS:
+            m_h2Settings = value;
+            break;
+        case HDR_HOST:
+            if(!host){
+                host = value;
+            }
+            break;
+        default:
+            break;
     }
     return NO_REQUEST;
 }
 
 // 解析HTTP请求体 ：仅判断是否完整读入
 httpConnect::HTTP_CODE httpConnect::parse_content(char* data){
+    if(m_chunked){
+        return parse_chunked();
+    }
     if(readIndex >= contentLength + checkIndex){
-        data[contentLength] = '\0'; 
+        m_requestEnd = checkIndex + contentLength;
+        m_requestEndByte = data[contentLength];
+        data[contentLength] = '\0';
+        m_content = data;
         return GET_REQUEST;
     }
     return NO_REQUEST;  
 }
 
+// 解码chunked请求体：块数据前移到已解码数据之后，释放块头占用的读缓冲，请求体只占用读缓冲
+httpConnect::HTTP_CODE httpConnect::parse_chunked(){
+    while(m_chunkPos < readIndex){
+        switch(m_chunkState){
+            case CHUNK_SIZE:
+            case CHUNK_TRAILER:{
+                char* line = readBuf + m_chunkPos;
+                char* eol = (char*)memchr(line, '\n', readIndex - m_chunkPos);
+                // 块头和trailer不会很长；完整读入的行同样限制长度，结果不随数据分几次到达而不同
+                if((eol ? eol - line : readIndex - m_chunkPos) > CHUNK_LINE_MAX){
+                    return BAD_REQUEST;
+                }
+                if(!eol){
+                    goto compact;
+                }
+                m_chunkPos = eol + 1 - readBuf;
+                if(m_chunkState == CHUNK_TRAILER){
+                    // 空行表示请求体结束，trailer字段忽略
+                    if(eol == line || (eol == line + 1 && line[0] == '\r')){
+                        readBuf[m_chunkEnd] = '\0';
+                        m_requestEnd = m_chunkPos;
+                        m_requestEndByte = readBuf[m_chunkPos];
+                        m_content = readBuf + m_chunkBody;
+                        contentLength = m_chunkEnd - m_chunkBody;
+                        return GET_REQUEST;
+                    }
+                    break;
+                }
+                // 十六进制块长度，之后可以有;扩展
+                long size = 0;
+                char* p = line;
+                for(; p < eol && isxdigit(*p); p++){
+                    size = size * 16 + (isdigit(*p) ? *p - '0' : (tolower(*p) - 'a' + 10));
+                    if(size > READ_BUFFER_SIZE){
+                        return PAYLOAD_TOO_LARGE;
+                    }
+                }
+                if(p == line || (*p != ';' && *p != '\r' && *p != ' ' && *p != '\t')){
+                    return BAD_REQUEST;
+                }
+                // 解码后的请求体和结尾的'\0'须放入读缓冲
+                if(m_chunkEnd + size >= READ_BUFFER_SIZE){
+                    return PAYLOAD_TOO_LARGE;
+                }
+                m_chunkRemain = size;
+                m_chunkState = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                break;
+            }
+            case CHUNK_DATA:{
+                int n = readIndex - m_chunkPos;
+                if(n > m_chunkRemain){
+                    n = m_chunkRemain;
+                }
+                memmove(readBuf + m_chunkEnd, readBuf + m_chunkPos, n);
+                m_chunkEnd += n;
+                m_chunkPos += n;
+                m_chunkRemain -= n;
+                if(m_chunkRemain == 0){
+                    m_chunkState = CHUNK_DATA_END;
+                }
+                break;
+            }
+            case CHUNK_DATA_END:{
+                if(readIndex - m_chunkPos < 2){
+                    goto compact;
+                }
+                if(readBuf[m_chunkPos] != '\r' || readBuf[m_chunkPos + 1] != '\n'){
+                    return BAD_REQUEST;
+                }
+                m_chunkPos += 2;
+                m_chunkState = CHUNK_SIZE;
+                break;
+            }
+        }
+    }
+compact:
+    // 未解码的数据前移，读缓冲只保存解码后的请求体和不完整的块头
+    if(m_chunkPos > m_chunkEnd){
+        memmove(readBuf + m_chunkEnd, readBuf + m_chunkPos, readIndex - m_chunkPos);
+        readIndex -= m_chunkPos - m_chunkEnd;
+        m_chunkPos = m_chunkEnd;
+    }
+    return NO_REQUEST;
+}
+
 // 解析某一行，\r\n替换为分界符'\0'
 httpConnect::LINE_STATUS httpConnect::parse_line(){
     char c;
@@ -255,9 +682,10 @@ httpConnect::LINE_STATUS httpConnect::parse_line(){
             }
             return LINE_BAD;
         }else if(c == '\n'){
-            if(checkIndex > 1 && readBuf[checkIndex - 1] == 'r'){
-                readBuf[checkIndex - 1] == '\0';
-                readBuf[checkIndex ++] == '\0';
+            // 上次读到的数据以'\r'结尾
+            if(checkIndex > 0 && readBuf[checkIndex - 1] == '\r'){
+                readBuf[checkIndex - 1] = '\0';
+                readBuf[checkIndex ++] = '\0';
                 return LINE_OK;
             }
             return LINE_BAD;
@@ -266,161 +694,1544 @@ httpConnect::LINE_STATUS httpConnect::parse_line(){
     return LINE_OPEN;
 }
 
-// 处理请求
-httpConnect::HTTP_CODE httpConnect::solve_request(){
-    strcpy(targetFile, rootDirectory);
-    int len = strlen(rootDirectory);
-    strncpy(targetFile + len, url, FILENAME_LEN - len - 1);
-    // 获取targetFile文件的相关的状态信息，-1失败，0成功
-    if(stat(targetFile, &targetFileStat)< 0){
-        return NO_RESOURCE;
+void httpConnect::addRoute(unsigned int methods, const char* pattern, HTTP_CODE (httpConnect::*handler)()){
+    routeHandler h = {handler, NULL};
+    if(!m_router.add(methods, pattern, h)){
+        printf("Invalid route %s\n", pattern);
     }
+}
 
-    // 判断访问权限
-    if(!(targetFileStat.st_mode & S_IROTH)){
-        return FORBIDDEN_REQUEST;
+void httpConnect::addRoute(unsigned int methods, const char* pattern, coHandler handler, HTTP_CODE (httpConnect::*h2handler)()){
+    routeHandler h = {h2handler, handler};
+    if(!handler || !h2handler){
+        printf("Route %s: coroutine handler needs a synchronous handler for HTTP/2\n", pattern);
+        return;
     }
-
-    // 判断是否是目录
-    if(S_ISDIR(targetFileStat.st_mode)){
-        return BAD_REQUEST;
+    if(!m_router.add(methods, pattern, h)){
+        printf("Invalid route %s\n", pattern);
     }
+}
 
-    // 以只读方式打开文件
-    int fd = open(targetFile, O_RDONLY);
-    // 创建内存映射，提高效率
-    targetFileAddress =(char*)mmap(0, targetFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+void httpConnect::compileRoutes(){
+    m_router.compile();
 }
 
-// 释放内存映射
-void httpConnect::unmap(){
-    if(targetFileAddress){
-        munmap(targetFileAddress, targetFileStat.st_size);
-        targetFileAddress = 0;
+const char* httpConnect::getParam(const char* name, int* len) const{
+    for(int i = 0; i < m_params.cnt; i++){
+        if(strcmp(m_params.name[i], name) == 0){
+            *len = m_params.len[i];
+            return m_params.value[i];
+        }
     }
+    *len = 0;
+    return NULL;
 }
 
-// 线程池的业务逻辑，处理HTTP请求
-void httpConnect::process(){
-    // 解析HTTP请求
-    HTTP_CODE read_ret = process_read();
-    if(read_ret == NO_REQUEST){
-        modfd(m_epollfd, m_socketfd, EPOLLIN);
-        return;
+const char* httpConnect::getHeader(int id, int* len) const{
+    int i = m_headers.index[id];
+    if(i == 0){
+        *len = 0;
+        return NULL;
     }
+    const headerField& f = m_headers.fields[i - 1];
+    *len = f.valueLen;
+    return readBuf + f.value;
+}
 
-    // 生成响应
-    bool write_ret = process_write(read_ret);
-    if(!write_ret){ // 失败
-        closeConnect();
+const char* httpConnect::getHeader(const char* name, int* len) const{
+    int n = strlen(name);
+    for(int i = 0; i < m_headers.cnt; i++){
+        const headerField& f = m_headers.fields[i];
+        if(f.nameLen == n && strncasecmp(readBuf + f.name, name, n) == 0){
+            *len = f.valueLen;
+            return readBuf + f.value;
+        }
     }
-    modfd(m_epollfd, m_socketfd, EPOLLOUT); //监听写事件
+    *len = 0;
+    return NULL;
 }
 
-// 写HTTP响应
-bool httpConnect::write()
-{
-    int temp = 0;    
-    if(bytes_to_send == 0){
-        // 将要发送的字节为0，这一次响应结束。
-        modfd(m_epollfd, m_socketfd, EPOLLIN); 
-        init();
-        return true;
+std::string_view httpConnect::headerValue(const char* name) const{
+    int len;
+    const char* v = getHeader(name, &len);
+    return v ? std::string_view(v, len) : std::string_view();
+}
+
+// GET请求没有请求体和Authorization时可使用动态响应缓存
+bool httpConnect::respCacheable() const{
+    int len;
+    return requestMethod == GET && contentLength == 0 && !m_chunked && !getHeader(HDR_AUTHORIZATION, &len);
+}
+
+// 按路由表分发请求
+httpConnect::HTTP_CODE httpConnect::do_request(){
+    const routeHandler* h = NULL;
+    switch(m_router.match(requestMethod, url, &m_params, &h)){
+        case router<routeHandler>::MATCH_NOT_FOUND:
+            return NO_RESOURCE;
+        case router<routeHandler>::MATCH_METHOD_NOT_ALLOWED:
+            return METHOD_NOT_ALLOWED;
+        default:
+            break;
     }
+    if(h->co){
+        // 协程在当前线程开始执行，直到第1次挂起
+        trace(tracer::HANDLER, 'e');
+        h->co(this);
+        return ASYNC_REQUEST;
+    }
+    // 转发可能长时间等待后端和客户端，交给反向代理的专用线程，其再次调用process时沿用本次的解析结果
+    if(h->sync == &httpConnect::proxy_request && !m_proxyHandoff){
+        m_proxyHandoff = true;
+        m_parsed = true;
+        m_readRet = GET_REQUEST;
+        trace(tracer::HANDLER, 'e');
+        trace(tracer::QUEUE, 'b');
+        if(upstream::handoff(this)){
+            return ASYNC_REQUEST;
+        }
+        trace(tracer::QUEUE, 'e');
+        trace(tracer::HANDLER, 'b');
+        m_parsed = false;
+    }
+    m_proxyHandoff = false;
+    return (this->*(h->sync))();
+}
 
-    while(1){
-        // 分散写
-        temp = writev(m_socketfd, m_iv, m_iv_count);
-        printf("写数据:%d 字节\n", temp);
-        if(temp <= -1){
-            // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
-            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
-            if(errno == EAGAIN){
-                modfd(m_epollfd, m_socketfd, EPOLLOUT);
-                return true;
+// 处理请求
+httpConnect::HTTP_CODE httpConnect::solve_request(){
+    return serve_file(url);
+}
+
+// 从application/x-www-form-urlencoded表单中取出key对应的值并解码
+static bool form_value(const char* form, const char* key, char* out, int outLen){
+    int keyLen = strlen(key);
+    const char* p = form;
+    while(p && *p){
+        if(strncmp(p, key, keyLen) == 0 && p[keyLen] == '='){
+            p += keyLen + 1;
+            int n = 0;
+            while(*p && *p != '&'){
+                char c = *p++;
+                if(c == '+'){
+                    c = ' ';
+                }else if(c == '%' && isxdigit(p[0]) && isxdigit(p[1])){
+                    char hex[3] = {p[0], p[1], '\0'};
+                    c = (char)strtol(hex, NULL, 16);
+                    p += 2;
+                }
+                if(n >= outLen - 1){
+                    return false;
+                }
+                out[n++] = c;
             }
-            unmap();
-            return false;
-        }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if(bytes_have_send >= m_iv[0].iov_len){ // 响应头发送介绍
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = targetFileAddress + bytes_have_send - writeIndex;
-            m_iv[1].iov_len = bytes_to_send;
-        }else{ // 未发送完毕 
-            m_iv[0].iov_base = writeBuf + bytes_have_send;
-            m_iv[0].iov_len -= temp;
+            out[n] = '\0';
+            return n > 0;
         }
-        if(bytes_to_send <= 0){
-            // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            unmap();
-            if(connectState){
-                init();
-                modfd(m_epollfd, m_socketfd, EPOLLIN);
-                return true;
-            } else {
-                modfd(m_epollfd, m_socketfd, EPOLLIN);
-                return false;
-            } 
+        p = strchr(p, '&');
+        if(p){
+            p++;
         }
     }
+    return false;
 }
 
-// 往写缓冲中写入待发送的数据
-bool httpConnect::add_response(const char* format, ...){
-    if(writeIndex >= WRITE_BUFFER_SIZE){ // 写缓冲已满
-        return false;
+// 登录：校验成功返回欢迎页，否则返回错误页
+httpConnect::HTTP_CODE httpConnect::login_request(){
+    if(requestMethod == GET){
+        return serve_file("/login.html");
     }
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = vsnprintf(writeBuf + writeIndex, WRITE_BUFFER_SIZE - 1 - writeIndex, format, arg_list);
-    if(len >=(WRITE_BUFFER_SIZE - 1 - writeIndex)){
-        return false;
+    char name[USER_NAME_LEN + 1], password[USER_PASSWORD_LEN + 1];
+    if(!m_content || !form_value(m_content, "username", name, sizeof(name))
+        || !form_value(m_content, "password", password, sizeof(password))){
+        return serve_file("/error.html");
     }
-    writeIndex += len;
-    va_end(arg_list);
-    return true;
+    if(userStore::verify(name, password) == userStore::USER_OK){
+        return serve_file("/welcome.html");
+    }
+    return serve_file("/error.html");
 }
 
-bool httpConnect::add_status_line(int status, const char* title){
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+// 登录的协程版本(HTTP/1.1)：密码哈希(PBKDF2)和缓存未命中时的数据库查询在磁盘I/O线程中进行，
+// 期间不占用工作线程；结果页的文件页也在该线程读入，reactor发送时不会缺页
+coTask httpConnect::login_co(httpConnect* conn){
+    if(conn->requestMethod == GET){
+        conn->respond(conn->login_request(), false);
+        co_return;
+    }
+    co_await runBlocking([conn]{ conn->respond(conn->login_request(), true); });
 }
 
-void httpConnect::add_headers(int content_len){
-    add_content_length(content_len);
-    add_content_type();
-    add_state();
-    add_blank_line();
+// 注册：成功后跳转登录页，用户名已存在则返回错误页
+httpConnect::HTTP_CODE httpConnect::register_request(){
+    if(requestMethod == GET){
+        return serve_file("/register.html");
+    }
+    char name[USER_NAME_LEN + 1], password[USER_PASSWORD_LEN + 1];
+    if(!m_content || !form_value(m_content, "username", name, sizeof(name))
+        || !form_value(m_content, "password", password, sizeof(password))){
+        return serve_file("/error.html");
+    }
+    if(userStore::add(name, password) == userStore::USER_OK){
+        return serve_file("/login.html");
+    }
+    return serve_file("/error.html");
 }
 
-bool httpConnect::add_content_length(int content_len){
-    return add_response("Content-Length: %d\r\n", content_len);
+// 逐跳头部由代理重新生成，不转发
+static bool hopHeader(int id){
+    switch(id){
+        case HDR_CONNECTION:
+        case HDR_KEEP_ALIVE:
+        case HDR_PROXY_CONNECTION:
+        case HDR_TRANSFER_ENCODING:
+        case HDR_TE:
+        case HDR_TRAILER:
+        case HDR_UPGRADE:
+        case HDR_HTTP2_SETTINGS:
+        case HDR_CONTENT_LENGTH:
+        case HDR_X_FORWARDED_FOR:
+        case HDR_X_FORWARDED_PROTO:
+            return true;
+        default:
+            return false;
+    }
 }
 
-bool httpConnect::add_state()
-{
-    return add_response("Connection: %s\r\n",(connectState == true)? "keep-alive" : "close");
+std::pmr::string httpConnect::proxyRequest(backend* b){
+    bool http10 = httpVersion && strcasecmp(httpVersion, "HTTP/1.0") == 0;
+    std::pmr::string req(requestArena::local());
+    req.reserve(1024 + contentLength);
+    req += methodNames[requestMethod];
+    req += ' ';
+    req += url;
+    // HTTP/1.0客户端无法接收chunked响应，以HTTP/1.0转发，后端以关闭连接结束响应体
+    req += http10 ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n";
+    // Connection中列出的字段也只对本跳有效
+    int connLen;
+    const char* conn = getHeader(HDR_CONNECTION, &connLen);
+    for(int i = 0; i < m_headers.cnt; i++){
+        const headerField& f = m_headers.fields[i];
+        if(hopHeader(f.id) || (conn && headerHasToken(conn, readBuf + f.name, f.nameLen))){
+            continue;
+        }
+        req.append(readBuf + f.name, f.value + f.valueLen - f.name);
+        req += "\r\n";
+    }
+    if(!host){
+        req += "Host: ";
+        req += b->address;
+        req += "\r\n";
+    }
+    char ip[INET6_ADDRSTRLEN] = "unix";
+    if(m_address.ss_family == AF_INET){
+        inet_ntop(AF_INET, &((struct sockaddr_in*)&m_address)->sin_addr, ip, sizeof(ip));
+    }else if(m_address.ss_family == AF_INET6){
+        // 双栈监听时IPv4客户端以::ffff:a.b.c.d表示，转发时还原
+        const struct in6_addr* a = &((struct sockaddr_in6*)&m_address)->sin6_addr;
+        if(IN6_IS_ADDR_V4MAPPED(a)){
+            inet_ntop(AF_INET, a->s6_addr + 12, ip, sizeof(ip));
+        }else{
+            inet_ntop(AF_INET6, a, ip, sizeof(ip));
+        }
+    }
+    req += "X-Forwarded-For: ";
+    req += ip;
+    req += m_ssl ? "\r\nX-Forwarded-Proto: https\r\n" : "\r\nX-Forwarded-Proto: http\r\n";
+    if(contentLength > 0 || requestMethod == POST || requestMethod == PUT){
+        char len[32];
+        snprintf(len, sizeof(len), "Content-Length: %d\r\n", contentLength);
+        req += len;
+    }
+    req += http10 ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+    if(contentLength > 0){
+        req.append(m_content, contentLength);
+    }
+    return req;
 }
 
-bool httpConnect::add_blank_line()
-{
-    return add_response("%s", "\r\n");
+bool httpConnect::proxyHead(int fd, std::pmr::string& head){
+    char buf[4096];
+    head.clear();
+    while(head.find("\r\n\r\n") == std::pmr::string::npos){
+        if(head.size() >= UPSTREAM_HEADER_SIZE){
+            return false;
+        }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return false;
+        }
+        head.append(buf, n);
+    }
+    return head.compare(0, 7, "HTTP/1.") == 0 && head.size() > 12;
 }
 
-bool httpConnect::add_content(const char* content)
-{
-    return add_response("%s", content);
+// 客户端socket为非阻塞，写满时在工作线程中等待
+static bool waitClient(int fd){
+    struct pollfd p = {fd, POLLOUT, 0};
+    return poll(&p, 1, UPSTREAM_TIMEOUT * 1000) > 0 && !(p.revents & (POLLERR | POLLHUP));
 }
 
-bool httpConnect::add_content_type(){
-    return add_response("Content-Type:%s\r\n", "text/html");
+bool httpConnect::sendAll(const char* data, size_t len, bool more){
+    while(len > 0){
+        struct iovec iv = {(void*)data, len};
+        int n = sendv(&iv, 1, more);
+        if(n < 0){
+            if(errno == EAGAIN && waitClient(m_socketfd)){
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
 }
 
-// 根据处理请求的结果，确定要写给client的内容
+bool httpConnect::proxyBody(int fd, long long len, bool* backendError){
+    *backendError = false;
+    int* p = upstream::pipe();
+    if(!p || (m_ssl && !m_ktls)){
+        // 用户态TLS需要明文经过SSL_write，只能复制
+        char buf[16384];
+        while(len != 0){
+            ssize_t n = recv(fd, buf, len < 0 || len > (long long)sizeof(buf) ? sizeof(buf) : len, 0);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                *backendError = n < 0 || len > 0;
+                return !*backendError;
+            }
+            if(!sendAll(buf, n)){
+                return false;
+            }
+            if(len > 0){
+                len -= n;
+            }
+        }
+        return true;
+    }
+    // 后端socket -> 管道 -> 客户端socket，响应体不经过用户态；kTLS连接由内核加密
+    while(len != 0){
+        size_t want = len < 0 || len > 65536 ? 65536 : len;
+        ssize_t n = splice(fd, NULL, p[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            // 读到EOF时，只有以关闭连接结束的响应体是完整的
+            *backendError = n < 0 || len > 0;
+            return !*backendError;
+        }
+        if(len > 0){
+            len -= n;
+        }
+        while(n > 0){
+            ssize_t m = splice(p[0], NULL, m_socketfd, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+            if(m < 0 && (errno == EINTR || (errno == EAGAIN && waitClient(m_socketfd)))){
+                continue;
+            }
+            if(m <= 0){
+                // 管道中残留未发送的数据
+                upstream::resetPipe();
+                return false;
+            }
+            n -= m;
+        }
+    }
+    return true;
+}
+
+// 反向代理：HTTP/1.1客户端的响应在工作线程中直接发送，响应体由splice从后端socket转到客户端socket；
+// HTTP/2客户端的响应体读完后填入流的响应
+httpConnect::HTTP_CODE httpConnect::proxy_request(){
+    int g = upstream::match(url);
+    if(g == -1){
+        return NO_RESOURCE;
+    }
+    // 查找动态响应缓存，同一个键未命中时只有1个请求填充；HTTP/1.1的其余请求挂起连接，由填充者恢复
+    responseCache::flight flight;
+    if(respCacheable() && !m_cacheBypass){
+        char key[RESP_CACHE_KEY_MAX];
+        int keyLen = responseCache::makeKey(key, methodNames[requestMethod], host, url);
+        if(keyLen > 0){
+            // 挂起后连接可能随即在其他线程恢复，处理阶段的结束由cacheFilled记录
+            respEntryPtr e = responseCache::acquire(std::string_view(key, keyLen),
+                [this](const char* name){ return headerValue(name); }, flight, m_h2Resp ? NULL : this);
+            if(flight.waiting()){
+                return ASYNC_REQUEST;
+            }
+            if(e){
+                return serve_cached(e);
+            }
+        }
+    }
+    // 缓存的连接可能已被后端关闭，此时换新连接重试；新连接失败计入被动健康检查
+    std::pmr::memory_resource* arena = requestArena::local();
+    backend* b = NULL;
+    int fd = -1;
+    std::pmr::string head(arena);
+    for(int attempt = 0; attempt < 2 && fd == -1; attempt++){
+        b = upstream::pick(g);
+        bool reused = false;
+        fd = upstream::acquire(b, &reused);
+        if(fd == -1){
+            upstream::done(b, false);
+            continue;
+        }
+        std::pmr::string req = proxyRequest(b);
+        if(send(fd, req.data(), req.size(), MSG_NOSIGNAL) == (ssize_t)req.size() && proxyHead(fd, head)){
+            break;
+        }
+        close(fd);
+        fd = -1;
+        upstream::done(b, reused);
+        if(!reused){
+            return BAD_GATEWAY;
+        }
+    }
+    if(fd == -1){
+        return BAD_GATEWAY;
+    }
+
+    // 解析响应头
+    size_t headLen = head.find("\r\n\r\n") + 4;
+    int status = atoi(head.c_str() + 9);
+    bool backendClose = head[7] == '0';
+    bool chunked = false;
+    long long length = -1;
+    std::pmr::string contentType("application/octet-stream", arena);
+    std::pmr::string cacheControl(arena);
+    std::pmr::string vary(arena);
+    bool setCookie = false;
+    size_t eol = head.find("\r\n");
+    std::pmr::string out("HTTP/1.1", arena);
+    out.append(head, 8, eol + 2 - 8);
+    std::pmr::string value(arena);
+    for(size_t pos = eol + 2; pos < headLen - 2; ){
+        size_t end = head.find("\r\n", pos);
+        const char* line = head.c_str() + pos;
+        value.assign(head, pos, end - pos);
+        const char* v = strchr(value.c_str(), ':');
+        v = v ? v + 1 + strspn(v + 1, " \t") : "";
+        if(strncasecmp(line, "Content-Length:", 15) == 0){
+            length = atoll(v);
+        }else if(strncasecmp(line, "Transfer-Encoding:", 18) == 0){
+            chunked = strcasestr(v, "chunked") != NULL;
+        }else if(strncasecmp(line, "Connection:", 11) == 0){
+            if(strcasestr(v, "close")){
+                backendClose = true;
+            }else if(strcasestr(v, "keep-alive")){
+                backendClose = false;
+            }
+        }else if(strncasecmp(line, "Content-Type:", 13) == 0){
+            contentType = v;
+        }else if(strncasecmp(line, "Cache-Control:", 14) == 0){
+            cacheControl += cacheControl.empty() ? "" : ",";
+            cacheControl += v;
+        }else if(strncasecmp(line, "Vary:", 5) == 0){
+            vary += vary.empty() ? "" : ",";
+            vary += v;
+        }else if(strncasecmp(line, "Set-Cookie:", 11) == 0){
+            setCookie = true;
+        }
+        if(strncasecmp(line, "Connection:", 11) != 0 && strncasecmp(line, "Keep-Alive:", 11) != 0
+            && strncasecmp(line, "Proxy-Connection:", 17) != 0){
+            out += value;
+            out += "\r\n";
+        }
+        pos = end + 2;
+    }
+    if(requestMethod == HEAD || status / 100 == 1 || status == 204 || status == 304){
+        length = 0;
+        chunked = false;
+    }else if(chunked){
+        length = -1;
+    }else if(length < 0){
+        // 没有长度，以关闭连接结束
+        backendClose = true;
+    }
+    const char* extra = head.data() + headLen;
+    long long extraLen = head.size() - headLen;
+
+    // 可缓存的响应：整个响应体读入缓存条目，加入缓存后按命中返回
+    long long ttl, swr;
+    if(flight.active() && !chunked && length >= 0 && !setCookie
+        && (status == 200 || status == 203 || status == 301 || status == 404 || status == 410)
+        && responseCache::policy(cacheControl, &ttl, &swr)){
+        respEntryPtr e = responseCache::create(out.size(), length);
+        std::vector<std::string> varyNames;
+        size_t pos = 0;
+        while(e && pos < vary.size()){
+            size_t end = vary.find(',', pos);
+            end = end == std::string::npos ? vary.size() : end;
+            size_t first = vary.find_first_not_of(" \t", pos);
+            size_t last = vary.find_last_not_of(" \t", end - 1);
+            if(first < end && last != std::string::npos && last >= first){
+                std::string name(vary, first, last + 1 - first);
+                if(name == "*"){
+                    // 按请求的任意特征变化，不可缓存
+                    e.reset();
+                }else{
+                    varyNames.push_back(name);
+                }
+            }
+            pos = end + 1;
+        }
+        if(e){
+            memcpy(e->data, out.data(), out.size());
+            char* body = e->data + out.size();
+            if(extraLen > length){
+                backendClose = true;
+                extraLen = length;
+            }
+            memcpy(body, extra, extraLen);
+            long long got = extraLen;
+            while(got < length){
+                ssize_t n = recv(fd, body + got, length - got, 0);
+                if(n < 0 && errno == EINTR){
+                    continue;
+                }
+                if(n <= 0){
+                    close(fd);
+                    upstream::done(b, false);
+                    return BAD_GATEWAY;
+                }
+                got += n;
+            }
+            if(backendClose){
+                close(fd);
+            }else{
+                upstream::release(b, fd);
+            }
+            upstream::done(b, true);
+            e->status = status;
+            e->contentType.assign(contentType.data(), contentType.size());
+            for(size_t i = 0; i < varyNames.size(); i++){
+                e->varyValues.emplace_back(headerValue(varyNames[i].c_str()));
+            }
+            e->vary = std::move(varyNames);
+            e->expires = fileCache::now() + ttl * 1000;
+            e->staleUntil = e->expires + swr * 1000;
+            flight.fill(e);
+            return serve_cached(e);
+        }
+    }
+
+    bool backendError = false;
+    bool clientOk = true;
+    if(m_h2Resp){
+        // HTTP/2帧自带长度：整个响应体读入内存，chunked解码
+        std::string& body = m_h2Resp->body;
+        chunkScanner scanner;
+        char buf[16384];
+        const char* data = extra;
+        long long n = extraLen;
+        while(true){
+            if(chunked){
+                int used = scanner.feed(data, n, &body);
+                if(used < 0){
+                    backendError = true;
+                    break;
+                }
+                if(scanner.done()){
+                    backendClose = backendClose || used < n;
+                    break;
+                }
+            }else{
+                if(length >= 0 && n > length - (long long)body.size()){
+                    backendClose = true;
+                    n = length - body.size();
+                }
+                body.append(data, n);
+                if(length >= 0 && (long long)body.size() == length){
+                    break;
+                }
+            }
+            if(body.size() > UPSTREAM_H2_MAX_BODY){
+                backendError = true;
+                break;
+            }
+            n = recv(fd, buf, sizeof(buf), 0);
+            if(n < 0 && errno == EINTR){
+                n = 0;
+                continue;
+            }
+            if(n <= 0){
+                // 只有以关闭连接结束的响应体在EOF时是完整的
+                backendError = n < 0 || chunked || length >= 0;
+                break;
+            }
+            data = buf;
+        }
+        if(backendError){
+            close(fd);
+            upstream::done(b, false);
+            body.clear();
+            return BAD_GATEWAY;
+        }
+        m_h2Resp->status = status;
+        m_h2Resp->typeBuf.assign(contentType.data(), contentType.size());
+    }else{
+        if(length < 0 && !chunked){
+            connectState = false;
+        }
+        out += connectState ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        if(chunked){
+            // chunked原样转发，只跟踪分帧找到响应体结束位置
+            chunkScanner scanner;
+            char buf[16384];
+            const char* data = extra;
+            long long n = extraLen;
+            // 已读到的部分响应体紧接着发送，与响应头合并为1个报文段
+            clientOk = sendAll(out.data(), out.size(), extraLen > 0);
+            while(clientOk){
+                int used = scanner.feed(data, n, NULL);
+                if(used < 0){
+                    backendError = true;
+                    break;
+                }
+                clientOk = sendAll(data, used);
+                if(scanner.done()){
+                    backendClose = backendClose || used < n;
+                    break;
+                }
+                n = recv(fd, buf, sizeof(buf), 0);
+                if(n < 0 && errno == EINTR){
+                    n = 0;
+                    continue;
+                }
+                if(n <= 0){
+                    backendError = true;
+                    break;
+                }
+                data = buf;
+            }
+        }else{
+            if(length >= 0 && extraLen > length){
+                // 后端多发了数据，连接不能复用
+                backendClose = true;
+                extraLen = length;
+            }
+            // 响应头和已读到的部分响应体1次发送
+            out.append(extra, extraLen);
+            clientOk = sendAll(out.data(), out.size())
+                && proxyBody(fd, length < 0 ? -1 : length - extraLen, &backendError);
+        }
+        if(backendError || !clientOk){
+            // 响应已部分发送，只能关闭客户端连接
+            connectState = false;
+            close(fd);
+            upstream::done(b, !backendError);
+            return PROXY_REQUEST;
+        }
+    }
+    if(backendClose){
+        close(fd);
+    }else{
+        upstream::release(b, fd);
+    }
+    upstream::done(b, true);
+    return PROXY_REQUEST;
+}
+
+// HTTP/1.1响应引用缓存条目发送，HTTP/2响应复制响应体
+httpConnect::HTTP_CODE httpConnect::serve_cached(const respEntryPtr& e){
+    if(m_h2Resp){
+        m_h2Resp->status = e->status;
+        m_h2Resp->typeBuf = e->contentType;
+        m_h2Resp->body.assign(e->data + e->headLen, e->bodyLen);
+        return PROXY_REQUEST;
+    }
+    m_respEntry = e;
+    targetFileAddress = e->data + e->headLen;
+    targetFileStat.st_size = e->bodyLen;
+    return CACHED_REQUEST;
+}
+
+// 返回网站根目录下的文件
+httpConnect::HTTP_CODE httpConnect::serve_file(const char* path){
+    strcpy(targetFile, rootDirectory);
+    int len = strlen(rootDirectory);
+    // 去掉查询字符串
+    int urlLen = strcspn(path, "?");
+    if(urlLen > FILENAME_LEN - len - 1){
+        urlLen = FILENAME_LEN - len - 1;
+    }
+    strncpy(targetFile + len, path, urlLen);
+    targetFile[len + urlLen] = '\0';
+    std::string_view key(path, urlLen);
+    // 获取targetFile文件的相关的状态信息，-1失败，0成功
+    if(stat(targetFile, &targetFileStat)< 0){
+        return NO_RESOURCE;
+    }
+
+    // 判断访问权限
+    if(!(targetFileStat.st_mode & S_IROTH)){
+        return FORBIDDEN_REQUEST;
+    }
+
+    // 目录返回默认文件或目录列表
+    if(S_ISDIR(targetFileStat.st_mode)){
+        return serve_directory(path, urlLen);
+    }
+
+    // 文件未修改，直接使用缓存内容
+    m_cacheEntry = fileCache::validate(key, targetFileStat);
+    if(m_cacheEntry){
+        targetFileAddress = m_cacheEntry->data;
+        m_mime = mimeType::lookup(targetFile);
+        return FILE_REQUEST;
+    }
+    if(targetFileStat.st_size == 0){
+        m_mime = mimeType::lookup(targetFile);
+        return FILE_REQUEST;
+    }
+
+    // 以只读方式打开文件
+    int fd = open(targetFile, O_RDONLY);
+    if(fd == -1){
+        return FORBIDDEN_REQUEST;
+    }
+    // 创建内存映射，提高效率
+    targetFileAddress =(char*)mmap(0, targetFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(targetFileAddress == MAP_FAILED){
+        targetFileAddress = 0;
+        return INTERNAL_ERROR;
+    }
+
+    // 小文件加入缓存，之后的请求由reactor直接命中；页面未驻留时不在工作线程中复制，
+    // 由磁盘I/O线程预读后加入缓存(见process)
+    if(targetFileStat.st_size <= CACHE_MAX_FILE_SIZE && diskIO::resident(targetFileAddress, targetFileStat.st_size)){
+        cacheEntryPtr e = fileCache::insert(key, targetFileStat, targetFileAddress);
+        if(e){
+            munmap(targetFileAddress, targetFileStat.st_size);
+            m_cacheEntry = e;
+            targetFileAddress = e->data;
+        }
+    }
+    m_mime = mimeType::lookup(targetFile);
+    return FILE_REQUEST;
+}
+
+// 目录：存在index.html时返回它，否则开启autoindex时返回缓存的目录列表(?format=json为JSON)，都没有则403
+httpConnect::HTTP_CODE httpConnect::serve_directory(const char* path, int urlLen){
+    std::pmr::memory_resource* arena = requestArena::local();
+    std::pmr::string dirUrl(path, urlLen, arena);
+    if(dirUrl.back() != '/'){
+        dirUrl += '/';
+    }
+    std::pmr::string fsPath(targetFile, arena);
+    while(fsPath.size() > 1 && fsPath.back() == '/'){
+        fsPath.pop_back();
+    }
+    struct stat st;
+    std::pmr::string index(fsPath, arena);
+    index += "/" DIR_INDEX_FILE;
+    if(stat(index.c_str(), &st) == 0 && S_ISREG(st.st_mode)){
+        dirUrl += DIR_INDEX_FILE;
+        return serve_file(dirUrl.c_str());
+    }
+    if(!dirIndex::enabled()){
+        return FORBIDDEN_REQUEST;
+    }
+    bool json = path[urlLen] == '?' && strstr(path + urlLen, "format=json") != NULL;
+    bool large;
+    m_cacheEntry = dirIndex::listing(fsPath, dirUrl, json, &large);
+    if(large){
+        // 条目过多的目录不缓存，列表边读取目录边分块发送
+        streamProducer producer = dirIndex::stream(fsPath, dirUrl, json);
+        if(!producer){
+            return FORBIDDEN_REQUEST;
+        }
+        return startStream(200, ok_200_title, json ? "application/json" : "text/html", std::move(producer));
+    }
+    if(!m_cacheEntry){
+        return FORBIDDEN_REQUEST;
+    }
+    targetFileAddress = m_cacheEntry->data;
+    targetFileStat.st_size = m_cacheEntry->size;
+    m_contentType = json ? "application/json" : "text/html";
+    return FILE_REQUEST;
+}
+
+// 释放内存映射
+void httpConnect::unmap(){
+    if(m_respEntry){
+        m_respEntry.reset();
+        targetFileAddress = 0;
+        return;
+    }
+    if(m_cacheEntry){
+        // 缓存内容只释放引用
+        m_cacheEntry.reset();
+        targetFileAddress = 0;
+        return;
+    }
+    if(targetFileAddress){
+        munmap(targetFileAddress, targetFileStat.st_size);
+        targetFileAddress = 0;
+    }
+}
+
+// reactor内解析请求：数据不完整则继续监听读事件，静态文件命中缓存则直接发送
+// 其余请求(缓存未命中、动态处理函数)返回false，交给线程池
+bool httpConnect::tryFastPath(){
+    m_pipelined = false;
+    if(isH2Preface()){
+        return false;
+    }
+    trace(tracer::PARSE, 'b');
+    m_readRet = process_read();
+    trace(tracer::PARSE, 'e');
+    // 用户态TLS中已解密但未读出的数据不会再触发epoll，读缓冲腾出空间后直接继续读取
+    while(m_readRet == NO_REQUEST && m_ssl && SSL_pending(m_ssl) > 0 && readIndex < READ_BUFFER_SIZE){
+        if(!read()){
+            closeConnect();
+            return true;
+        }
+        m_readRet = process_read();
+    }
+    m_parsed = true;
+    if(m_readRet == NO_REQUEST){
+        m_parsed = false;
+        rearm(EPOLLIN);
+        return true;
+    }
+    // 限流在reactor中检查，超过限制直接返回429并关闭连接
+    if(m_readRet == GET_REQUEST && !rateLimit::allow(m_address, url)){
+        m_parsed = false;
+        if(!process_write(TOO_MANY_REQUESTS) || !write()){
+            closeConnect();
+        }
+        return true;
+    }
+    if(m_readRet != GET_REQUEST || requestMethod != GET || m_upgradeH2c){
+        return false;
+    }
+    const routeHandler* h = NULL;
+    if(m_router.match(requestMethod, url, &m_params, &h) != router<routeHandler>::MATCH_OK || h->co){
+        return false;
+    }
+    if(h->sync == &httpConnect::proxy_request){
+        // 反向代理的响应命中动态响应缓存时同样直接发送
+        char key[RESP_CACHE_KEY_MAX];
+        int keyLen = respCacheable() ? responseCache::makeKey(key, methodNames[requestMethod], host, url) : 0;
+        if(keyLen == 0){
+            return false;
+        }
+        respEntryPtr e = responseCache::lookup(std::string_view(key, keyLen),
+            [this](const char* name){ return headerValue(name); });
+        if(!e){
+            return false;
+        }
+        m_parsed = false;
+        serve_cached(e);
+        if(!process_write(CACHED_REQUEST) || !write(WRITE_QUANTUM)){
+            closeConnect();
+        }else if(m_writeMore){
+            writeScheduler::add(this);
+        }
+        return true;
+    }
+    if(h->sync != &httpConnect::solve_request){
+        return false;
+    }
+    int urlLen = strcspn(url, "?");
+    cacheEntryPtr e = fileCache::lookup(std::string_view(url, urlLen));
+    if(!e){
+        return false;
+    }
+    m_parsed = false;
+    snprintf(targetFile, FILENAME_LEN, "%s%s", rootDirectory, e->path.c_str());
+    targetFileStat.st_size = e->size;
+    m_mime = mimeType::lookup(targetFile);
+    m_cacheEntry = e;
+    targetFileAddress = e->data;
+    rateLimit::consume(m_address, url, e->size);
+    if(!process_write(FILE_REQUEST) || !write(WRITE_QUANTUM)){
+        closeConnect();
+    }else if(m_writeMore){
+        writeScheduler::add(this);
+    }
+    return true;
+}
+
+// TLS握手：完成后若内核支持则由kTLS加密发送
+void httpConnect::handshake(){
+    ERR_clear_error();
+    int ret = SSL_do_handshake(m_ssl);
+    if(ret == 1){
+        m_handshakeDone = true;
+        m_ktls = sslContext::ktlsSend(m_ssl);
+        // ALPN协商为h2：立即发送服务端SETTINGS
+        const unsigned char* proto = NULL;
+        unsigned int protoLen = 0;
+        SSL_get0_alpn_selected(m_ssl, &proto, &protoLen);
+        if(protoLen == 2 && memcmp(proto, "h2", 2) == 0){
+            m_h2 = new http2Session(this);
+            processH2();
+            return;
+        }
+        rearm(EPOLLIN);
+        return;
+    }
+    int err = SSL_get_error(m_ssl, ret);
+    if(err == SSL_ERROR_WANT_READ){
+        rearm(EPOLLIN);
+    }else if(err == SSL_ERROR_WANT_WRITE){
+        rearm(EPOLLOUT);
+    }else{
+        closeConnect();
+    }
+}
+
+// 线程池的业务逻辑，处理HTTP请求
+void httpConnect::process(){
+    trace(tracer::QUEUE, 'e');
+    // 本次处理中从arena分配的内存在返回时回收
+    requestArena::scope arenaScope;
+    if(!m_handshakeDone){
+        handshake();
+        return;
+    }
+    // 流式响应的写事件
+    if(m_streaming){
+        streamWrite();
+        return;
+    }
+    // HTTP/2：已建立的会话或以连接前言开头的明文连接(prior knowledge)
+    if(m_h2 || isH2Preface()){
+        processH2();
+        return;
+    }
+    // 解析HTTP请求，reactor已解析时直接使用其结果
+    HTTP_CODE read_ret = m_parsed ? m_readRet : process_read();
+    m_parsed = false;
+    if(read_ret == NO_REQUEST){
+        rearm(EPOLLIN);
+        return;
+    }
+    if(read_ret == GET_REQUEST && m_upgradeH2c && m_h2Settings && !m_ssl && contentLength == 0 && !m_chunked){
+        // h2c升级：请求本身作为流1，读缓冲中剩余的数据为客户端连接前言
+        m_h2 = new http2Session(this);
+        m_h2->upgrade(m_h2Settings, methodNames[requestMethod], url);
+        m_h2->feed(readBuf + checkIndex, readIndex - checkIndex);
+        processH2();
+        return;
+    }
+    if(read_ret == GET_REQUEST){
+        trace(tracer::HANDLER, 'b');
+        read_ret = do_request();
+        if(read_ret == ASYNC_REQUEST){
+            // 连接已交给协程或反向代理的专用线程，由其在结束时注册事件，之后可能已被交还，不再访问
+            return;
+        }
+        trace(tracer::HANDLER, 'e');
+    }
+    if(read_ret == STREAM_REQUEST){
+        // 在工作线程中发送响应头并开始生成响应体
+        m_streaming = true;
+        process_write(read_ret);
+        streamWrite();
+        return;
+    }
+
+    if(read_ret == PROXY_REQUEST){
+        // 响应已由proxy_request发送给客户端
+        if(connectState){
+            nextRequest();
+        }else{
+            closeConnect();
+        }
+        return;
+    }
+
+    // 生成响应
+    if(read_ret == FILE_REQUEST){
+        rateLimit::consume(m_address, url, targetFileStat.st_size);
+    }
+    bool write_ret = process_write(read_ret);
+    if(!write_ret){ // 失败
+        closeConnect();
+        return;
+    }
+    // 文件页未驻留内存，交给磁盘I/O线程预读，完成后由其注册写事件；可缓存的小文件同时由其加入缓存
+    if(read_ret == FILE_REQUEST && !m_cacheEntry){
+        m_diskPending = true;
+        trace(tracer::DISK, 'b');
+        const char* cacheKey = targetFileStat.st_size <= CACHE_MAX_FILE_SIZE ? targetFile + strlen(rootDirectory) : NULL;
+        if(diskIO::submit(this, targetFileAddress, targetFileStat.st_size, cacheKey, &targetFileStat)){
+            return;
+        }
+        // 页面已驻留，该阶段只有mincore检查
+        m_diskPending = false;
+        trace(tracer::DISK, 'e');
+    }
+    sendNow();
+}
+
+// 在生成响应的线程中立即发送：多数响应1次writev即可发完，省去等待EPOLLOUT的1轮epoll_wait和epoll_ctl；
+// socket写满时由write注册EPOLLOUT，配额用完时注册EPOLLOUT，剩余部分由reactor中的写调度器轮转发送
+void httpConnect::sendNow(){
+    // 响应发送完或socket写满时write已交还连接，之后reactor可能立即修改成员，配额是否用完由more返回
+    bool more = false;
+    if(!write(WRITE_QUANTUM, &more)){
+        closeConnect();
+    }else if(more){
+        rearm(EPOLLOUT);
+    }
+}
+
+bool httpConnect::isH2Preface() const{
+    return readIndex >= 3 && memcmp(readBuf, "PRI", 3) == 0;
+}
+
+// HTTP/2连接：读取并处理帧，输出未发送完时同时监听写事件
+void httpConnect::processH2(){
+    holdBuffers();
+    if(!m_h2){
+        m_h2 = new http2Session(this);
+        m_h2->feed(readBuf, readIndex);
+    }
+    // 专用线程上只生成推迟的流的响应，新到达的帧等下次读事件
+    bool ok = m_proxyHandoff ? m_h2->resume() : m_h2->process();
+    m_proxyHandoff = false;
+    // 有转发给后端的流时整个会话交给反向代理的专用线程，期间不读取新的帧
+    if(ok && m_h2->deferred()){
+        m_proxyHandoff = true;
+        trace(tracer::QUEUE, 'b');
+        if(upstream::handoff(this)){
+            return;
+        }
+        trace(tracer::QUEUE, 'e');
+        ok = m_h2->resume();
+        m_proxyHandoff = false;
+    }
+    if(!ok){
+        closeConnect();
+        return;
+    }
+    rearm(m_h2->wantWrite() ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+// HTTP/2流的请求：复用路由表和同步处理函数，响应体的所有权转交给流
+void httpConnect::h2Dispatch(const char* method, std::string& path, std::string& body, h2Response& resp){
+    HTTP_CODE ret = BAD_REQUEST;
+    int m = 0;
+    for(; m < ROUTE_METHODS; m++){
+        if(strcmp(method, methodNames[m]) == 0){
+            break;
+        }
+    }
+    bool valid = m < ROUTE_METHODS && path[0] == '/' && normalizePath(&path[0]);
+    if(valid){
+        path.resize(strlen(path.c_str()));
+    }
+    // 推迟的流在推迟前已经限流和计数
+    if(valid && !m_proxyHandoff && !rateLimit::allow(m_address, path.c_str())){
+        ret = TOO_MANY_REQUESTS;
+    }else if(valid){
+        requestMethod = (METHOD)m;
+        url = &path[0];
+        m_content = body.empty() ? NULL : &body[0];
+        contentLength = body.size();
+        m_contentType = NULL;
+        m_mime = NULL;
+        m_headers.clear();
+        host = NULL;
+        httpVersion = NULL;
+        m_h2Resp = &resp;
+        if(!m_proxyHandoff){
+            supervisor::countRequest();
+        }
+        const routeHandler* h = NULL;
+        switch(m_router.match(requestMethod, url, &m_params, &h)){
+            case router<routeHandler>::MATCH_NOT_FOUND:
+                ret = NO_RESOURCE;
+                break;
+            case router<routeHandler>::MATCH_METHOD_NOT_ALLOWED:
+                ret = METHOD_NOT_ALLOWED;
+                break;
+            default:
+                if(h->sync == &httpConnect::proxy_request && !m_proxyHandoff){
+                    // 转发可能长时间等待后端，响应推迟到反向代理的专用线程上生成
+                    resp.deferred = true;
+                    m_h2Resp = NULL;
+                    return;
+                }
+                // 协程处理函数通过HTTP/1.1写缓冲生成响应，HTTP/2的流使用同时注册的同步处理函数
+                ret = (this->*(h->sync))();
+                break;
+        }
+        m_h2Resp = NULL;
+    }
+    switch(ret){
+        case STREAM_REQUEST:{
+            // HTTP/2帧自带长度，生产者的输出直接作为响应体
+            resp.status = m_streamStatus;
+            resp.contentType = m_streamType;
+            char buf[STREAM_CHUNK_SIZE];
+            int n;
+            while((n = m_producer(buf, sizeof(buf))) > 0){
+                resp.body.append(buf, n);
+            }
+            m_producer = nullptr;
+            if(n < 0){
+                resp.status = 500;
+                resp.contentType = "text/html";
+                resp.body = error_500_form;
+            }
+            break;
+        }
+        case FILE_REQUEST:
+            rateLimit::consume(m_address, path.c_str(), targetFileStat.st_size);
+            resp.status = 200;
+            resp.contentType = content_type();
+            resp.cacheControl = cache_control();
+            resp.data = targetFileAddress;
+            resp.size = targetFileStat.st_size;
+            if(m_cacheEntry){
+                resp.cache = std::move(m_cacheEntry);
+            }else{
+                resp.mapped = targetFileAddress;
+            }
+            targetFileAddress = 0;
+            return;
+        case NO_RESOURCE:
+            resp.status = 404;
+            resp.body = error_404_form;
+            break;
+        case FORBIDDEN_REQUEST:
+            resp.status = 403;
+            resp.body = error_403_form;
+            break;
+        case METHOD_NOT_ALLOWED:
+            resp.status = 405;
+            resp.body = error_405_form;
+            break;
+        case BAD_REQUEST:
+            resp.status = 400;
+            resp.body = error_400_form;
+            break;
+        case TOO_MANY_REQUESTS:
+            resp.status = 429;
+            resp.body = rateLimit::form();
+            break;
+        case BAD_GATEWAY:
+            resp.status = 502;
+            resp.body = error_502_form;
+            break;
+        case PROXY_REQUEST:
+            // 状态码和响应体已由proxy_request填充
+            resp.contentType = resp.typeBuf.c_str();
+            break;
+        default:
+            resp.status = 500;
+            resp.body = error_500_form;
+            break;
+    }
+    resp.data = resp.body.data();
+    resp.size = resp.body.size();
+}
+
+bool httpConnect::idle() const{
+    // 其他线程交还连接后尚未完成注册
+    if(m_rearming.load() != 0){
+        return false;
+    }
+    if(m_h2){
+        return m_h2->idle();
+    }
+    // 新连接的第1个请求可能还在路上；读缓冲非空表示请求尚未读完，bytes_to_send非0表示响应未发送完
+    return m_requestCnt > 0 && !m_streaming && !m_waitHandle && readIndex == 0 && bytes_to_send == 0;
+}
+
+bool httpConnect::prefetch(const char* path){
+    requestArena::scope arenaScope;
+    httpConnect c;
+    bool ok = c.serve_file(path) == FILE_REQUEST;
+    // 预热线程不处理请求，未驻留的小文件在这里直接读入缓存
+    if(ok && !c.m_cacheEntry && c.targetFileAddress){
+        cacheEntryPtr e = fileCache::insert(std::string_view(path, strcspn(path, "?")), c.targetFileStat, c.targetFileAddress);
+        c.unmap();
+        c.m_cacheEntry = e;
+    }
+    ok = ok && c.m_cacheEntry;
+    c.unmap();
+    return ok;
+}
+
+// 预读完成：连接仍有效则注册写事件，否则释放映射
+void httpConnect::diskDone(diskRequest* req){
+    if(req->generation == m_generation && m_diskPending.exchange(false)){
+        trace(tracer::DISK, 'e');
+        rearm(EPOLLOUT);
+        return;
+    }
+    munmap(req->address, req->length);
+}
+
+// 填充者的线程调用：连接交回反向代理的专用线程重新处理，已填充时命中缓存，否则直接访问后端
+void httpConnect::cacheFilled(bool filled){
+    trace(tracer::HANDLER, 'e');
+    m_cacheBypass = !filled;
+    m_proxyHandoff = true;
+    m_parsed = true;
+    m_readRet = GET_REQUEST;
+    trace(tracer::QUEUE, 'b');
+    if(!upstream::handoff(this)){
+        // 队列已满，不能在填充者的处理过程中嵌套处理
+        closeConnect();
+    }
+}
+
+// 挂起协程等待socket事件，由reactor在事件就绪时恢复
+bool httpConnect::waitEvent(std::coroutine_handle<> h, bool* result, int ev){
+    if(m_socketfd == -1){
+        *result = false;
+        return false;
+    }
+    m_waitHandle = h;
+    m_waitResult = result;
+    rearm(ev);
+    return true;
+}
+
+void httpConnect::resumeWaiting(bool ok){
+    std::coroutine_handle<> h = m_waitHandle;
+    m_waitHandle = nullptr;
+    *m_waitResult = ok;
+    h.resume();
+}
+
+// 由协程处理函数生成完整的响应，响应体写入写缓冲
+bool httpConnect::setResponse(int status, const char* title, const char* body){
+    if(!writeBuf){ // 连接已关闭，缓冲已归还
+        return false;
+    }
+    writeIndex = 0;
+    unmap();
+    if(!add_status_line(status, title)){
+        return false;
+    }
+    add_headers(strlen(body));
+    if(!add_content(body)){
+        return false;
+    }
+    m_iv[0].iov_base = writeBuf;
+    m_iv[0].iov_len = writeIndex;
+    m_iv_count = 1;
+    bytes_to_send = writeIndex;
+    return true;
+}
+
+// 由同步处理函数的返回码生成响应，失败时bytes_to_send为0，由handlerDone返回500
+bool httpConnect::respond(HTTP_CODE ret, bool pageIn){
+    if(ret == FILE_REQUEST){
+        rateLimit::consume(m_address, url, targetFileStat.st_size);
+    }
+    if(!process_write(ret)){
+        bytes_to_send = 0;
+        return false;
+    }
+    if(pageIn && ret == FILE_REQUEST && !m_cacheEntry){
+        diskIO::pageIn(targetFileAddress, targetFileStat.st_size);
+    }
+    return true;
+}
+
+// 协程结束：处理函数未生成响应则返回500，立即发送
+void httpConnect::handlerDone(){
+    if(bytes_to_send == 0 && !setResponse(500, error_500_title, error_500_form)){
+        closeConnect();
+        return;
+    }
+    sendNow();
+}
+
+// 开始流式响应：生成响应头，HTTP/1.0客户端不支持chunked，以关闭连接表示响应结束
+httpConnect::HTTP_CODE httpConnect::startStream(int status, const char* title, const char* contentType, streamProducer producer){
+    writeIndex = 0;
+    unmap();
+    m_chunkedOut = !httpVersion || strcasecmp(httpVersion, "HTTP/1.0") != 0;
+    if(!m_chunkedOut){
+        connectState = false;
+    }
+    add_status_line(status, title);
+    add_response("Content-Type:%s\r\n", contentType);
+    if(m_chunkedOut){
+        add_response("Transfer-Encoding: chunked\r\n");
+    }
+    add_state();
+    if(!add_blank_line()){
+        return INTERNAL_ERROR;
+    }
+    m_streamStatus = status;
+    m_streamType = contentType;
+    m_streamDone = false;
+    m_producer = std::move(producer);
+    return STREAM_REQUEST;
+}
+
+// 生成下一块：块头写在数据之前预留的空间中，数据之后追加\r\n，整块1次发送
+bool httpConnect::nextChunk(){
+    if(m_streamBuf.empty()){
+        m_streamBuf.resize(STREAM_CHUNK_SIZE + STREAM_CHUNK_EXTRA);
+    }
+    char* data = &m_streamBuf[STREAM_CHUNK_PREFIX];
+    int n = m_producer(data, STREAM_CHUNK_SIZE);
+    if(n < 0 || n > STREAM_CHUNK_SIZE){
+        return false;
+    }
+    char* begin = data;
+    int len = n;
+    if(n == 0){
+        m_streamDone = true;
+        m_producer = nullptr;
+        if(m_chunkedOut){
+            memcpy(data, "0\r\n\r\n", 5);
+            len = 5;
+        }
+    }else if(m_chunkedOut){
+        char head[STREAM_CHUNK_PREFIX + 1];
+        int h = snprintf(head, sizeof(head), "%x\r\n", n);
+        begin = data - h;
+        memcpy(begin, head, h);
+        memcpy(data + n, "\r\n", 2);
+        len = h + n + 2;
+    }
+    m_iv[0].iov_base = begin;
+    m_iv[0].iov_len = len;
+    m_iv_count = 1;
+    bytes_to_send = len;
+    return true;
+}
+
+// 发送流式响应：当前块发送完毕才生成下一块，socket写满时等待写事件，内存占用固定
+void httpConnect::streamWrite(){
+    while(1){
+        if(bytes_to_send == 0){
+            if(m_streamDone){
+                m_streaming = false;
+                if(connectState){
+                    nextRequest();
+                }else{
+                    closeConnect();
+                }
+                return;
+            }
+            if(!nextChunk()){
+                // 响应头已发出，只能关闭连接
+                closeConnect();
+                return;
+            }
+            continue;
+        }
+        // 响应头和各数据块紧接着发送，结束块之前的不满1个报文段的尾部与下一块合并
+        int n = sendv(m_iv, m_iv_count, !m_streamDone);
+        if(n < 0){
+            if(errno == EAGAIN){
+                rearm(EPOLLOUT);
+                return;
+            }
+            closeConnect();
+            return;
+        }
+        bytes_to_send -= n;
+        m_iv[0].iov_base = (char*)m_iv[0].iov_base + n;
+        m_iv[0].iov_len -= n;
+    }
+}
+
+// 写HTTP响应，最多发送quota字节；配额用完而响应未发送完时m_writeMore和*more为true，由写调度器继续发送
+bool httpConnect::write(size_t quota, bool* more)
+{
+    int temp = 0;    
+    m_writeMore = false;
+    m_lastWritten = 0;
+    if(bytes_to_send == 0){
+        // 将要发送的字节为0，这一次响应结束
+        nextRequest();
+        return true;
+    }
+
+    while(1){
+        // 分散写，按剩余配额截断
+        struct iovec iv[2];
+        int cnt = 0;
+        size_t left = quota;
+        for(int i = 0; i < m_iv_count && left > 0; i++){
+            iv[cnt] = m_iv[i];
+            if(iv[cnt].iov_len > left){
+                iv[cnt].iov_len = left;
+            }
+            left -= iv[cnt].iov_len;
+            cnt++;
+        }
+        temp = sendv(iv, cnt);
+        if(temp <= -1){
+            // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
+            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
+            if(errno == EAGAIN){
+                rearm(EPOLLOUT);
+                return true;
+            }
+            unmap();
+            return false;
+        }
+        bytes_to_send -= temp;
+        bytes_have_send += temp;
+        quota -= temp;
+        m_lastWritten += temp;
+        if(bytes_have_send >= writeIndex){ // 响应头发送完毕
+            m_iv[0].iov_len = 0;
+            m_iv[1].iov_base = targetFileAddress + bytes_have_send - writeIndex;
+            m_iv[1].iov_len = bytes_to_send;
+        }else{ // 未发送完毕 
+            m_iv[0].iov_base = writeBuf + bytes_have_send;
+            m_iv[0].iov_len = writeIndex - bytes_have_send;
+        }
+        if(bytes_to_send <= 0){
+            // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
+            trace(tracer::WRITE, 'e');
+            unmap();
+            if(connectState){
+                nextRequest();
+                return true;
+            } else {
+                // 由调用者关闭连接，不再注册事件：注册后reactor可能与调用者同时处理该连接
+                return false;
+            } 
+        }
+        if(quota == 0){
+            // 配额用完，不注册事件，连接留在写调度器的队列中
+            m_writeMore = true;
+            if(more){
+                *more = true;
+            }
+            return true;
+        }
+    }
+}
+
+// 单连接限速由内核完成：有fq队列规则时由其调度，否则由TCP内部pacing按速率发送
+void httpConnect::pace(bool on){
+    if(on == m_paced || writeScheduler::connRate() == 0 || m_address.ss_family == AF_UNIX){
+        return;
+    }
+    unsigned int rate = on ? writeScheduler::connRate() : ~0U;
+    setsockopt(m_socketfd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+    m_paced = on;
+}
+
+// 发送iovec：明文和kTLS连接由writev发送，内核负责加密；用户态TLS逐块SSL_write
+int httpConnect::sendv(struct iovec* iov, int cnt, bool more){
+    if(!m_ssl || m_ktls){
+        if(!more){
+            return writev(m_socketfd, iov, cnt);
+        }
+        // 后面紧接着还有数据：内核暂缓发送不满1个报文段的尾部，与下一次发送合并
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = cnt;
+        return sendmsg(m_socketfd, &msg, MSG_MORE);
+    }
+    for(int i = 0; i < cnt; i++){
+        if(iov[i].iov_len == 0){
+            continue;
+        }
+        ERR_clear_error();
+        int n = SSL_write(m_ssl, iov[i].iov_base, iov[i].iov_len);
+        if(n > 0){
+            return n;
+        }
+        int err = SSL_get_error(m_ssl, n);
+        errno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+// 往写缓冲中写入待发送的数据
+bool httpConnect::add_response(const char* format, ...){
+    if(writeIndex >= WRITE_BUFFER_SIZE){ // 写缓冲已满
+        return false;
+    }
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(writeBuf + writeIndex, WRITE_BUFFER_SIZE - 1 - writeIndex, format, arg_list);
+    if(len >=(WRITE_BUFFER_SIZE - 1 - writeIndex)){
+        return false;
+    }
+    writeIndex += len;
+    va_end(arg_list);
+    return true;
+}
+
+bool httpConnect::add_status_line(int status, const char* title){
+    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+}
+
+void httpConnect::add_headers(int content_len){
+    add_content_length(content_len);
+    add_content_type();
+    add_cache_control();
+    add_state();
+    add_blank_line();
+}
+
+bool httpConnect::add_content_length(int content_len){
+    return add_response("Content-Length: %d\r\n", content_len);
+}
+
+bool httpConnect::add_state()
+{
+    return add_response("Connection: %s\r\n",(connectState == true)? "keep-alive" : "close");
+}
+
+bool httpConnect::add_blank_line()
+{
+    return add_response("%s", "\r\n");
+}
+
+bool httpConnect::add_content(const char* content)
+{
+    return add_response("%s", content);
+}
+
+bool httpConnect::add_content_type(){
+    return add_response("Content-Type:%s\r\n", content_type());
+}
+
+const char* httpConnect::content_type(){
+    if(m_contentType){
+        return m_contentType;
+    }
+    return m_mime ? m_mime->type : "text/html";
+}
+
+// 目录列表等生成的内容不缓存
+const char* httpConnect::cache_control(){
+    if(m_contentType || !m_mime){
+        return NULL;
+    }
+    return mimeType::cacheControl(m_mime->category);
+}
+
+bool httpConnect::add_cache_control(){
+    const char* value = cache_control();
+    return !value || add_response("Cache-Control: %s\r\n", value);
+}
+
+// 根据处理请求的结果，确定要写给client的内容
 bool httpConnect::process_write(HTTP_CODE read_ret){
+    trace(tracer::WRITE, 'b');
     switch(read_ret)
         {
             case INTERNAL_ERROR:
@@ -451,7 +2262,40 @@ bool httpConnect::process_write(HTTP_CODE read_ret){
                     return false;
                 }
                 break;
+            case METHOD_NOT_ALLOWED:
+                add_status_line(405, error_405_title);
+                add_headers(strlen(error_405_form));
+                if(! add_content(error_405_form)){
+                    return false;
+                }
+                break;
+            case PAYLOAD_TOO_LARGE:
+                // 未读的请求体无法跳过，响应后关闭连接
+                connectState = false;
+                add_status_line(413, error_413_title);
+                add_headers(strlen(error_413_form));
+                if(! add_content(error_413_form)){
+                    return false;
+                }
+                break;
+            case BAD_GATEWAY:
+                add_status_line(502, error_502_title);
+                add_headers(strlen(error_502_form));
+                if(! add_content(error_502_form)){
+                    return false;
+                }
+                break;
+            case STREAM_REQUEST:
+                // 响应头已由startStream写入写缓冲
+                break;
+            case TOO_MANY_REQUESTS:
+                // 预先生成的完整响应，发送后关闭连接
+                memcpy(writeBuf, rateLimit::response(), rateLimit::responseLen());
+                writeIndex = rateLimit::responseLen();
+                connectState = false;
+                break;
             case FILE_REQUEST:
+                pace(targetFileStat.st_size >= PACE_MIN_SIZE);
                 add_status_line(200, ok_200_title);
                 add_headers(targetFileStat.st_size);
                 m_iv[0].iov_base = writeBuf;
@@ -461,6 +2305,19 @@ bool httpConnect::process_write(HTTP_CODE read_ret){
                 m_iv_count = 2;
                 bytes_to_send = writeIndex + targetFileStat.st_size;
                 return true;
+            case CACHED_REQUEST:
+                // 缓存的响应头之后只追加Connection字段
+                memcpy(writeBuf, m_respEntry->data, m_respEntry->headLen);
+                writeIndex = m_respEntry->headLen;
+                add_state();
+                add_blank_line();
+                m_iv[0].iov_base = writeBuf;
+                m_iv[0].iov_len = writeIndex;
+                m_iv[1].iov_base = targetFileAddress;
+                m_iv[1].iov_len = targetFileStat.st_size;
+                m_iv_count = 2;
+                bytes_to_send = writeIndex + targetFileStat.st_size;
+                return true;
             default:
                 return false;
         }
@@ -468,5 +2325,6 @@ bool httpConnect::process_write(HTTP_CODE read_ret){
         m_iv[0].iov_base = writeBuf;
         m_iv[0].iov_len = writeIndex;
         m_iv_count = 1;
+        bytes_to_send = writeIndex;
         return true;   
 }
\ No newline at end of file
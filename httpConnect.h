@@ -14,14 +14,47 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <sys/uio.h>
+#include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <functional>
 #include "locker.h"
+#include "coroutine.h"
+#include "diskIO.h"
+#include "router.h"
+#include "fileCache.h"
+#include "sslContext.h"
+#include "http2.h"
+#include "dirIndex.h"
+#include "rateLimit.h"
+#include "writeScheduler.h"
+#include "upstream.h"
+#include "tracer.h"
+#include "mime.h"
+#include "arena.h"
+#include "httpHeaders.h"
+#include "bufferPool.h"
+#include "respCache.h"
 
 #define READ_BUFFER_SIZE 4096
 #define WRITE_BUFFER_SIZE 4096
+#define MAX_KEEPALIVE_REQUESTS 1000             // 默认每个连接最多处理的请求数，之后的响应关闭连接
 #define FILENAME_LEN 200
+#define CHUNK_LINE_MAX 256                      // chunked请求体的块头和trailer行的最大长度
+#define STREAM_CHUNK_SIZE 8192                  // 流式响应每块的最大长度
+#define STREAM_CHUNK_PREFIX 10                  // 块头：十六进制长度 + \r\n
+#define STREAM_CHUNK_EXTRA 16                   // 块头和块尾预留的空间
+
+// 流式响应的生产者：向buf写入不超过len字节，返回写入的字节数，0表示结束，-1表示出错
+typedef std::function<int(char* buf, int len)> streamProducer;
 
 class httpConnect{
+    friend class http2Session;
+    friend struct parserHarness;                // 解析器的fuzz和测试驱动，见fuzz/
     public:
     // HTTP请求方法，支持GET
     enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT};
@@ -45,31 +78,78 @@ class httpConnect{
         BAD_REQUEST         :   表示客户请求语法错误
         NO_RESOURCE         :   表示服务器没有资源
         FORBIDDEN_REQUEST   :   表示客户对资源没有足够的访问权限
+        METHOD_NOT_ALLOWED  :   表示资源存在，但不支持该请求方法
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        ASYNC_REQUEST       :   请求交给协程处理函数，由其负责生成响应
+        STREAM_REQUEST      :   响应头已生成，响应体由生产者分块生成
     */
-    enum HTTP_CODE { NO_REQUEST = 0, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION };
+    enum HTTP_CODE { NO_REQUEST = 0, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, METHOD_NOT_ALLOWED, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION, ASYNC_REQUEST, STREAM_REQUEST, TOO_MANY_REQUESTS, BAD_GATEWAY, PROXY_REQUEST, CACHED_REQUEST, PAYLOAD_TOO_LARGE };
     
+    /*
+        连接的生命周期，reactor和工作线程通过EPOLLONESHOT交替持有连接
+        CONN_CLOSED     :   未使用或已关闭
+        CONN_IDLE       :   已注册事件，由reactor持有
+        CONN_BUSY       :   已交给工作线程、磁盘I/O线程或协程，重新注册事件后回到CONN_IDLE
+        CONN_CLOSING    :   正在关闭，只有CAS成功的线程执行关闭，此后不能再注册事件
+    */
+    enum CONN_STATE { CONN_CLOSED = 0, CONN_IDLE, CONN_BUSY, CONN_CLOSING };
+
+    // 路由处理函数：同步成员函数，或协程处理函数(HTTP/1.1)加同步成员函数(HTTP/2)
+    struct routeHandler{
+        HTTP_CODE (httpConnect::*sync)();
+        coHandler co;
+    };
+
     public:
         
         static int m_epollfd;                   // 所有的socket注册在1个epoll实例中
-        static int userCnt;
+        static std::atomic<int> userCnt;        // 当前连接数，reactor和工作线程都会修改
+        static std::atomic<bool> m_draining;    // 进程正在排空，之后的响应都关闭连接
+        static int m_maxRequests;               // 每个连接最多处理的请求数，0表示不限制
 
-        httpConnect(){};
+        httpConnect() : m_socketfd(-1), m_state(CONN_CLOSED), m_rearming(0), m_generation(0), m_waitResult(NULL), readBuf(NULL), m_requestEnd(0), m_pipelined(false), targetFileAddress(NULL),
+            writeBuf(NULL), m_streaming(false), m_ssl(NULL), m_handshakeDone(true), m_ktls(false), m_h2(NULL), m_proxyHandoff(false), m_diskPending(false){};
 
         ~httpConnect(){};
 
-        void init(int sockfd, const sockaddr_in &addr); // 初始新连接
+        bool init(int sockfd, const sockaddr_storage &addr, bool tls = false); // 初始新连接，HTTPS连接创建SSL失败时返回false，由调用者关闭
 
-        void closeConnect();
+        void closeConnect();                    // 关闭连接，可由任一持有连接的线程调用，只执行1次
+
+        bool acquire();                         // reactor交给线程池前调用，连接已关闭时返回false
+
+        // reactor收到事件时检查连接仍由其持有，acquire读取与工作线程重新注册前的写入同步
+        bool isActive() const { return m_state.load(std::memory_order_acquire) == CONN_IDLE; }
+
+        // reactor调用：已持有的连接上没有正在处理的请求，排空时可以关闭
+        bool idle() const;
+
+        static bool prefetch(const char* path); // 读入网站根目录下的文件加入缓存，升级时预热
 
         bool read();                            //非阻塞读数据
 
-        bool write();                           // 非阻塞写数据
+        bool write(size_t quota = SIZE_MAX, bool* more = NULL); // 非阻塞写数据，最多发送quota字节
+
+        bool writeMore() const { return m_writeMore; } // 上次write因配额用完而返回，仍有数据待发送
+
+        size_t lastWritten() const { return m_lastWritten; } // 上次write发送的字节数
+
+        bool paced() const { return m_paced; }  // 当前响应为大文件，受单连接和总速率限制
 
         void process();                         // 处理client请求
 
+        bool handshakeDone() const { return m_handshakeDone; }
+
+        void handshake();                       // TLS握手，在工作线程中进行
+
+        bool isHttp2() const { return m_h2 != NULL; } // HTTP/2连接的读写全部在工作线程中进行
+
+        bool tryFastPath();                     // reactor内解析，缓存命中则直接发送，返回false时交给线程池
+
+        bool pipelined() const { return m_pipelined; } // 读缓冲中已有下一个请求的数据，等待写事件时由reactor解析
+
         HTTP_CODE process_read();               // 解析HTTP请求
 
         HTTP_CODE parse_requsetLine(char* data); // 解析HTTP请求首行
@@ -80,7 +160,54 @@ class httpConnect{
 
         LINE_STATUS parse_line();               // 解析某一行
 
-        HTTP_CODE solve_request();               // 处理请求
+        HTTP_CODE do_request();                 // 按路由表分发请求
+
+        HTTP_CODE solve_request();               // 处理请求：静态文件
+
+        HTTP_CODE serve_file(const char* path);  // 返回网站根目录下的文件
+
+        HTTP_CODE serve_directory(const char* path, int urlLen); // 目录：默认文件或目录列表
+
+        HTTP_CODE login_request();               // 登录：GET返回登录页，POST校验表单
+
+        static coTask login_co(httpConnect* conn); // 登录的协程版本，校验在磁盘I/O线程中进行
+
+        HTTP_CODE register_request();            // 注册：GET返回注册页，POST添加用户
+
+        HTTP_CODE proxy_request();               // 反向代理：转发到路由前缀对应的后端
+        HTTP_CODE serve_cached(const respEntryPtr& e); // 返回动态响应缓存的条目
+        std::string_view headerValue(const char* name) const; // 供响应缓存按Vary比较请求头
+        bool respCacheable() const;             // 请求可使用动态响应缓存
+
+        // 注册路由，methods按位表示请求方法，如 1 << GET；全部注册后调用compileRoutes
+        static void addRoute(unsigned int methods, const char* pattern, HTTP_CODE (httpConnect::*handler)());
+        // 协程处理函数通过HTTP/1.1的写缓冲生成响应，HTTP/2的流使用h2handler，缺少时拒绝注册
+        static void addRoute(unsigned int methods, const char* pattern, coHandler handler, HTTP_CODE (httpConnect::*h2handler)());
+        static void compileRoutes();
+
+        // 以下函数供协程处理函数使用
+        unsigned int generation() const { return m_generation; }
+        int socketfd() const { return m_socketfd; }
+        METHOD getMethod() const { return requestMethod; }
+        const char* getUrl() const { return url; }
+        const char* getParam(const char* name, int* len) const; // 路由参数，不以'\0'结尾
+        const char* getHeader(int id, int* len) const; // 请求头字段的值，id为HEADER_ID，没有返回NULL
+        const char* getHeader(const char* name, int* len) const; // 按名称查找，不区分大小写
+        bool getKeepAlive() const { return connectState; }
+        bool setResponse(int status, const char* title, const char* body); // 生成完整响应
+        void handlerDone();                     // 协程结束，立即发送响应
+        bool respond(HTTP_CODE ret, bool pageIn); // 按同步处理函数的返回码生成响应，pageIn时在当前线程读入文件页
+        bool waitEvent(std::coroutine_handle<> h, bool* result, int ev); // 挂起协程等待socket事件
+        bool isWaiting() const { return (bool)m_waitHandle; }
+
+        // 流式响应：由处理函数调用并返回其结果，响应体以chunked编码发送(HTTP/1.0以关闭连接结束)，
+        // 每块发送完毕后再调用producer生成下一块；contentType须为常量字符串
+        HTTP_CODE startStream(int status, const char* title, const char* contentType, streamProducer producer);
+        bool isStreaming() const { return m_streaming; } // 流式响应的写事件交给线程池，生产者在工作线程中执行
+        void resumeWaiting(bool ok);            // reactor在事件就绪时恢复协程
+
+        void diskDone(diskRequest* req);        // 磁盘I/O线程完成预读
+        void cacheFilled(bool filled);          // 挂起等待的动态响应缓存键填充结束，filled为false时不再查找缓存
 
         bool process_write(HTTP_CODE ret);
 
@@ -91,6 +218,9 @@ class httpConnect{
         bool add_response( const char* format, ... );
         bool add_content( const char* content );
         bool add_content_type();
+        const char* content_type();             // 目标文件的Content-Type
+        const char* cache_control();            // 目标文件类别的Cache-Control，NULL表示不发送
+        bool add_cache_control();
         bool add_status_line( int status, const char* title );
         void add_headers( int content_length );
         bool add_content_length( int content_length );
@@ -99,11 +229,24 @@ class httpConnect{
 
     private:
         void init();                            // 初始化http解析的状态
+        void nextRequest();                     // 响应发送完毕，继续处理同一连接的下一个请求
+        void holdBuffers();                     // 从缓冲池取得读写缓冲，已持有时不做处理
+        void releaseBuffers();                  // 归还读写缓冲
 
         int m_socketfd;                         // 该HTTP连接的socket
-        struct sockaddr_in m_address;           // 通信的socket地址
+        std::atomic<int> m_state;               // 连接状态CONN_STATE
+        std::atomic<int> m_rearming;            // 正在rearm中的线程数
+        void rearm(int ev);                     // 重新注册事件，连接交还reactor
+        struct sockaddr_storage m_address;      // 通信的socket地址，IPv4、IPv6或Unix域
+        std::atomic<unsigned int> m_generation; // 连接代数，每次init加1，协程和磁盘I/O线程据此判断连接是否被复用
+
+        std::coroutine_handle<> m_waitHandle;   // 等待socket事件的协程
+        bool* m_waitResult;                     // 恢复时写入的等待结果
 
-        char readBuf[READ_BUFFER_SIZE];         // 读缓冲区
+        static router<routeHandler> m_router;   // 路由表，启动时编译
+        routeParams m_params;                   // 当前请求匹配到的路由参数
+
+        char* readBuf;                          // 读缓冲区，与写缓冲区连续，处理请求期间从缓冲池取得
         int readIndex;                          // 读指针，指向已读数据的下一个字节
         int lineIndex;                          // 当前解析行在读缓冲的起始位置
         int checkIndex;                         // 当前解析字符在读缓冲中的位置
@@ -113,19 +256,84 @@ class httpConnect{
         char* httpVersion;                      // http协议版本
         char* host;                             // 主机名
         bool connectState;                      // 是否保持连接
+        int m_requestCnt;                       // 该连接上已完成的请求数
         int contentLength;                      // 请求体长度
+        bool m_parsed;                          // 已由reactor解析，m_readRet为解析结果
+        int m_requestEnd;                       // 当前请求在读缓冲中的结束位置，之后为流水线发送的下一个请求
+        char m_requestEndByte;                  // 结束位置上原有的字节，请求体结尾的'\0'会覆盖它
+        bool m_pipelined;                       // init时读缓冲中留有下一个请求的数据
+        HTTP_CODE m_readRet;
+        char* m_content;                        // 请求体，POST表单数据
+        headerTable m_headers;                  // 当前请求的全部请求头字段
+
+        // chunked请求体：在读缓冲中原地解码，解码后的数据从m_chunkBody开始连续存放
+        enum CHUNK_STATE { CHUNK_SIZE = 0, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER };
+        bool m_chunked;                         // 请求头Transfer-Encoding: chunked
+        CHUNK_STATE m_chunkState;
+        int m_chunkRemain;                      // 当前块未读取的字节数
+        int m_chunkPos;                         // 待解码的原始数据位置
+        int m_chunkBody;                        // 请求体起始位置
+        int m_chunkEnd;                         // 已解码数据的结束位置
+        HTTP_CODE parse_chunked();
 
         const char* rootDirectory = "/home/yjy/linux/webserver/resources"; // 网站根目录
         char targetFile[FILENAME_LEN];          // 目标文件名称，响应体
         struct stat targetFileStat;             // 目标文件的状态
         char* targetFileAddress;                // 客户请求的目标文件被映射到内存中的起始位置
+        cacheEntryPtr m_cacheEntry;             // 响应体来自文件缓存时持有其引用，此时不需要munmap
+        respEntryPtr m_respEntry;               // 响应来自动态响应缓存时持有其引用
+        const char* m_contentType;              // 非NULL时覆盖按文件确定的Content-Type，如JSON目录列表
+        const mimeEntry* m_mime;                // 按扩展名确定的类型，返回文件时设置
 
-        char writeBuf[WRITE_BUFFER_SIZE];       // 写缓冲区:响应首行和响应头
+        char* writeBuf;                         // 写缓冲区:响应首行和响应头
         int writeIndex;                         // 写缓冲区中待发送的字节数
+        // 明文或kTLS直接writev，more为true时以MSG_MORE与下一次发送合并；用户态TLS由SSL_write加密
+        int sendv(struct iovec* iov, int cnt, bool more = false);
+        int recvBytes(char* buf, int len);      // 明文recv或SSL_read，语义同recv
+
+        streamProducer m_producer;              // 流式响应的生产者
+        bool m_streaming;                       // 正在发送流式响应
+        bool m_streamDone;                      // 生产者已结束，发送完当前数据后响应结束
+        bool m_chunkedOut;                      // 响应体使用chunked编码
+        int m_streamStatus;                     // 供HTTP/2使用的状态码和类型
+        const char* m_streamType;
+        std::vector<char> m_streamBuf;          // 当前块，首次流式响应时分配
+        bool nextChunk();                       // 调用生产者生成下一块
+        void sendNow();                         // 在当前线程立即发送响应，未发完时注册写事件
+        void streamWrite();                     // 发送流式响应，socket写满时等待写事件
+
+        SSL* m_ssl;                             // HTTPS连接的SSL对象，HTTP连接为NULL
+        bool m_handshakeDone;                   // TLS握手完成，HTTP连接始终为true
+        bool m_ktls;                            // 发送由内核TLS加密
+
+        http2Session* m_h2;                     // HTTP/2会话，HTTP/1.1连接为NULL
+        bool m_upgradeH2c;                      // 请求头Upgrade: h2c
+        char* m_h2Settings;                     // 请求头HTTP2-Settings的值
+        bool isH2Preface() const;               // 读缓冲以HTTP/2连接前言开头
+        void processH2();
+        void h2Dispatch(const char* method, std::string& path, std::string& body, h2Response& resp); // 执行HTTP/2流的请求
+        h2Response* m_h2Resp;                   // 正在执行的HTTP/2流的响应，反向代理直接填充
+
+        std::pmr::string proxyRequest(backend* b); // 转发给后端的请求，从本线程的arena分配
+        bool proxyHead(int fd, std::pmr::string& head); // 读取后端响应头，head中可能含有部分响应体
+        bool proxyBody(int fd, long long len, bool* backendError); // 后端响应体splice到客户端，len为-1时读到EOF
+        bool sendAll(const char* data, size_t len, bool more = false); // 阻塞发送给客户端，socket写满时poll等待
+        bool m_proxyHandoff;                    // 已交给反向代理的专用线程，其调用process时直接转发
+        bool m_cacheBypass;                     // 等待的填充没有得到可缓存的响应，本次请求直接访问后端
+
         struct iovec m_iv[2];                   // 采用writev来执行写操作
         int m_iv_count;                         // 2块内存，写缓冲区和targetFileAddress
         int bytes_have_send;                    // 已经发送的字节
         int bytes_to_send;                      // 还需要发送的字节
+        bool m_writeMore;
+        size_t m_lastWritten;
+        bool m_paced;                           // 已设置SO_MAX_PACING_RATE
+        void pace(bool on);                     // 大文件响应开启单连接限速，其余响应取消
+
+        uint32_t m_traceId;                     // 当前请求被采样追踪时非0
+        void trace(int stage, char phase){ if(m_traceId){ tracer::record(m_traceId, stage, phase); } }
+
+        std::atomic<bool> m_diskPending;        // 预读未完成，映射由磁盘I/O线程持有
 };
 
 #endif
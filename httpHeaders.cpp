@@ -0,0 +1,60 @@
+#include <strings.h>
+#include "httpHeaders.h"
+
+static const struct{
+    const char* name;
+    int len;
+} knownHeaders[HDR_COUNT] = {
+    {"", 0},
+    {"Host", 4},
+    {"Connection", 10},
+    {"Content-Length", 14},
+    {"Content-Type", 12},
+    {"Transfer-Encoding", 17},
+    {"Upgrade", 7},
+    {"HTTP2-Settings", 14},
+    {"Keep-Alive", 10},
+    {"Proxy-Connection", 16},
+    {"TE", 2},
+    {"Trailer", 7},
+    {"User-Agent", 10},
+    {"Accept", 6},
+    {"Accept-Encoding", 15},
+    {"Accept-Language", 15},
+    {"Cookie", 6},
+    {"Authorization", 13},
+    {"Referer", 7},
+    {"Range", 5},
+    {"If-Modified-Since", 17},
+    {"If-None-Match", 13},
+    {"X-Forwarded-For", 15},
+    {"X-Forwarded-Proto", 17},
+};
+
+int headerTable::lookupId(const char* name, int len){
+    // 先比较长度，再比较首字母，多数字段只做1次strncasecmp
+    for(int i = 1; i < HDR_COUNT; i++){
+        if(knownHeaders[i].len == len && (knownHeaders[i].name[0] | 0x20) == (name[0] | 0x20)
+            && strncasecmp(knownHeaders[i].name, name, len) == 0){
+            return i;
+        }
+    }
+    return HDR_OTHER;
+}
+
+bool headerHasToken(const char* value, const char* token, int len){
+    const char* p = value;
+    while(*p){
+        p += strspn(p, " \t,");
+        const char* end = p + strcspn(p, ",");
+        const char* tail = end;
+        while(tail > p && (tail[-1] == ' ' || tail[-1] == '\t')){
+            tail--;
+        }
+        if(tail - p == len && strncasecmp(p, token, len) == 0){
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
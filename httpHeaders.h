@@ -0,0 +1,43 @@
+// 请求头表：全部字段记录为读缓冲中的偏移和长度，不拷贝；常用字段名映射为枚举ID，按ID查找为O(1)
+#ifndef HTTPHEADERS_H
+#define HTTPHEADERS_H
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_HEADERS 64                          // 1个请求最多的字段数，超过时返回400
+
+enum HEADER_ID { HDR_OTHER = 0, HDR_HOST, HDR_CONNECTION, HDR_CONTENT_LENGTH, HDR_CONTENT_TYPE, HDR_TRANSFER_ENCODING,
+    HDR_UPGRADE, HDR_HTTP2_SETTINGS, HDR_KEEP_ALIVE, HDR_PROXY_CONNECTION, HDR_TE, HDR_TRAILER, HDR_USER_AGENT, HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING, HDR_ACCEPT_LANGUAGE, HDR_COOKIE, HDR_AUTHORIZATION, HDR_REFERER, HDR_RANGE,
+    HDR_IF_MODIFIED_SINCE, HDR_IF_NONE_MATCH, HDR_X_FORWARDED_FOR, HDR_X_FORWARDED_PROTO, HDR_COUNT };
+
+// 字段在读缓冲中的位置，值已去掉首尾空白并以'\0'结尾
+struct headerField{
+    uint16_t name;
+    uint16_t nameLen;
+    uint16_t value;
+    uint16_t valueLen;
+    uint8_t id;
+};
+
+struct headerTable{
+    int cnt;
+    uint8_t index[HDR_COUNT];                   // 该ID第1次出现的下标+1，0表示没有
+    headerField fields[MAX_HEADERS];
+
+    void clear(){
+        cnt = 0;
+        memset(index, 0, sizeof(index));
+    }
+
+    static int lookupId(const char* name, int len); // 字段名对应的ID，不区分大小写，未知字段为HDR_OTHER
+};
+
+// 逗号分隔的列表中是否含有token，不区分大小写，如 Connection: keep-alive, Upgrade
+bool headerHasToken(const char* value, const char* token, int len);
+
+inline bool headerHasToken(const char* value, const char* token){
+    return headerHasToken(value, token, strlen(token));
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include "listener.h"
+
+bool listener::parse(const char* spec){
+    const char* comma = strchr(spec, ',');
+    address.assign(spec, comma ? comma - spec : strlen(spec));
+    if(address.empty()){
+        return false;
+    }
+    // 逐个解析选项
+    while(comma){
+        const char* opt = comma + 1;
+        comma = strchr(opt, ',');
+        std::string name(opt, comma ? comma - opt : strlen(opt));
+        if(strncmp(name.c_str(), "backlog=", 8) == 0){
+            backlog = atoi(name.c_str() + 8);
+        }else if(name == "reuseport"){
+            reusePort = true;
+        }else if(strncmp(name.c_str(), "defer=", 6) == 0){
+            deferAccept = atoi(name.c_str() + 6);
+        }else if(name == "defer"){
+            deferAccept = 1;
+        }else{
+            return false;
+        }
+    }
+    struct sockaddr_storage addr;
+    bool dualStack;
+    return backlog > 0 && resolve(addr, &dualStack) != 0;
+}
+
+socklen_t listener::resolve(struct sockaddr_storage& addr, bool* dualStack) const{
+    memset(&addr, 0, sizeof(addr));
+    *dualStack = false;
+    const char* s = address.c_str();
+    if(strncmp(s, "unix:", 5) == 0){
+        struct sockaddr_un* un = (struct sockaddr_un*)&addr;
+        if(address.size() - 5 == 0 || address.size() - 5 >= sizeof(un->sun_path)){
+            return 0;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, s + 5);
+        return sizeof(struct sockaddr_un);
+    }
+
+    std::string host;
+    const char* portStr;
+    if(s[0] == '['){
+        // [IPv6地址]:端口
+        const char* end = strchr(s, ']');
+        if(!end || end[1] != ':'){
+            return 0;
+        }
+        host.assign(s + 1, end - s - 1);
+        portStr = end + 2;
+    }else{
+        const char* colon = strrchr(s, ':');
+        if(colon){
+            host.assign(s, colon - s);
+            portStr = colon + 1;
+        }else{
+            portStr = s;
+        }
+    }
+    char* endp;
+    long port = strtol(portStr, &endp, 10);
+    if(*portStr == '\0' || *endp != '\0' || port < 0 || port > 65535){
+        return 0;
+    }
+
+    struct sockaddr_in6* in6 = (struct sockaddr_in6*)&addr;
+    struct sockaddr_in* in4 = (struct sockaddr_in*)&addr;
+    if(host.empty()){
+        // 只有端口：IPv6通配地址，同时接受IPv4连接
+        *dualStack = true;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        in6->sin6_addr = in6addr_any;
+        return sizeof(struct sockaddr_in6);
+    }
+    if(inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) == 1){
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        return sizeof(struct sockaddr_in6);
+    }
+    if(inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1){
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        return sizeof(struct sockaddr_in);
+    }
+    return 0;
+}
+
+bool listener::open(){
+    struct sockaddr_storage addr;
+    bool dualStack;
+    socklen_t len = resolve(addr, &dualStack);
+    if(len == 0){
+        return false;
+    }
+    fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if(fd == -1 && dualStack && (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)){
+        // 内核不支持IPv6，退回IPv4通配地址
+        int port = ((struct sockaddr_in6*)&addr)->sin6_port;
+        memset(&addr, 0, sizeof(addr));
+        struct sockaddr_in* in4 = (struct sockaddr_in*)&addr;
+        in4->sin_family = AF_INET;
+        in4->sin_port = port;
+        in4->sin_addr.s_addr = INADDR_ANY;
+        len = sizeof(struct sockaddr_in);
+        dualStack = false;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if(fd == -1){
+        perror("socket");
+        return false;
+    }
+
+    int optval = 1;
+    if(addr.ss_family == AF_UNIX){
+        // 删除上次运行遗留的socket文件
+        unlink(((struct sockaddr_un*)&addr)->sun_path);
+    }else{
+        // 端口复用
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+        if(reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1){
+            perror("SO_REUSEPORT");
+        }
+        if(addr.ss_family == AF_INET6){
+            // 显式指定IPv6地址时只接受IPv6连接，不依赖系统的bindv6only设置
+            int v6only = dualStack ? 0 : 1;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+        if(deferAccept > 0 && setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferAccept, sizeof(deferAccept)) == -1){
+            perror("TCP_DEFER_ACCEPT");
+        }
+    }
+
+    if(bind(fd, (struct sockaddr*)&addr, len) == -1){
+        perror("bind");
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    if(::listen(fd, backlog) == -1){
+        perror("listen");
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+// 监听socket：IPv4、IPv6(可双栈)和Unix域socket，每个监听地址单独设置backlog、REUSEPORT和DEFER_ACCEPT
+#ifndef LISTENER_H
+#define LISTENER_H
+#include <sys/socket.h>
+#include <string>
+
+#define LISTEN_BACKLOG 8                        // 默认全连接队列长度
+
+/*
+    监听地址格式：地址[,选项...]
+        10000                   所有地址的10000端口，IPv6双栈，不支持IPv6时退回IPv4
+        0.0.0.0:10000           仅IPv4
+        [::]:10000              仅IPv6
+        [::1]:10000             IPv6回环地址
+        unix:/tmp/web.sock      Unix域socket，供本机sidecar访问
+    选项：
+        backlog=N               listen队列长度
+        reuseport               SO_REUSEPORT，多个进程监听同一端口
+        defer=N                 TCP_DEFER_ACCEPT，N秒内数据到达后才完成accept
+*/
+class listener{
+    public:
+        listener() : fd(-1), backlog(LISTEN_BACKLOG), reusePort(false), deferAccept(0), tls(false){}
+
+        bool parse(const char* spec);           // 解析监听地址和选项，格式错误返回false
+
+        bool open();                            // 创建socket，设置选项，bind并listen
+
+        int fd;
+        std::string address;
+        int backlog;
+        bool reusePort;
+        int deferAccept;
+        bool tls;                               // 该端口的连接需先完成TLS握手
+
+        // 转换为socket地址；dualStack表示仅指定了端口；反向代理的后端地址也用此格式
+        socklen_t resolve(struct sockaddr_storage& addr, bool* dualStack) const;
+};
+
+#endif
@@ -34,6 +34,35 @@ class locker{
         pthread_mutex_t mutex;
 };
 
+// 读写锁：读多写少的数据
+class rwlocker{
+    public:
+        rwlocker(){
+            if(pthread_rwlock_init(&rwlock, NULL) != 0){
+                throw std::exception();
+            }
+        }
+
+        ~rwlocker(){
+            pthread_rwlock_destroy(&rwlock);
+        }
+
+        bool rdlock(){
+            return pthread_rwlock_rdlock(&rwlock) == 0;
+        }
+
+        bool wrlock(){
+            return pthread_rwlock_wrlock(&rwlock) == 0;
+        }
+
+        bool unlock(){
+            return pthread_rwlock_unlock(&rwlock) == 0;
+        }
+
+    private:
+        pthread_rwlock_t rwlock;
+};
+
 // 条件变量: 阻塞或唤醒进程
 class condition{
     public:
@@ -0,0 +1,156 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <array>
+#include "mime.h"
+
+// 未配置时：页面每次请求，样式和脚本缓存1小时，图片和音视频7天，字体1年
+std::string mimeType::m_cache[MIME_CATEGORY_COUNT] = {
+    "", "public, max-age=3600", "public, max-age=604800", "public, max-age=31536000", "public, max-age=604800", ""
+};
+
+static const char* categoryNames[MIME_CATEGORY_COUNT] = {"document", "script", "image", "font", "media", "other"};
+
+static constexpr mimeEntry entries[] = {
+    {"html", "text/html", MIME_DOCUMENT},
+    {"htm", "text/html", MIME_DOCUMENT},
+    {"txt", "text/plain", MIME_DOCUMENT},
+    {"xml", "application/xml", MIME_DOCUMENT},
+    {"json", "application/json", MIME_DOCUMENT},
+    {"csv", "text/csv", MIME_DOCUMENT},
+    {"md", "text/markdown", MIME_DOCUMENT},
+    {"pdf", "application/pdf", MIME_DOCUMENT},
+    {"css", "text/css", MIME_SCRIPT},
+    {"js", "text/javascript", MIME_SCRIPT},
+    {"mjs", "text/javascript", MIME_SCRIPT},
+    {"map", "application/json", MIME_SCRIPT},
+    {"wasm", "application/wasm", MIME_SCRIPT},
+    {"jpg", "image/jpeg", MIME_IMAGE},
+    {"jpeg", "image/jpeg", MIME_IMAGE},
+    {"png", "image/png", MIME_IMAGE},
+    {"gif", "image/gif", MIME_IMAGE},
+    {"webp", "image/webp", MIME_IMAGE},
+    {"avif", "image/avif", MIME_IMAGE},
+    {"svg", "image/svg+xml", MIME_IMAGE},
+    {"ico", "image/x-icon", MIME_IMAGE},
+    {"bmp", "image/bmp", MIME_IMAGE},
+    {"woff", "font/woff", MIME_FONT},
+    {"woff2", "font/woff2", MIME_FONT},
+    {"ttf", "font/ttf", MIME_FONT},
+    {"otf", "font/otf", MIME_FONT},
+    {"eot", "application/vnd.ms-fontobject", MIME_FONT},
+    {"mp4", "video/mp4", MIME_MEDIA},
+    {"webm", "video/webm", MIME_MEDIA},
+    {"mp3", "audio/mpeg", MIME_MEDIA},
+    {"ogg", "audio/ogg", MIME_MEDIA},
+    {"wav", "audio/wav", MIME_MEDIA},
+    {"zip", "application/zip", MIME_OTHER},
+    {"gz", "application/gzip", MIME_OTHER},
+    {"tar", "application/x-tar", MIME_OTHER},
+};
+static constexpr size_t entryCount = sizeof(entries) / sizeof(entries[0]);
+static constexpr mimeEntry unknown = {"", "application/octet-stream", MIME_OTHER};
+
+// FNV-1a，|0x20把大写字母转为小写，扩展名中的数字不受影响
+static constexpr uint32_t extHash(const char* s, size_t n, uint32_t seed){
+    uint32_t h = seed;
+    for(size_t i = 0; i < n; i++){
+        h ^= (uint8_t)(s[i] | 0x20);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static constexpr size_t extLen(const char* s){
+    size_t n = 0;
+    while(s[n]){
+        n++;
+    }
+    return n;
+}
+
+struct mimeSlots{
+    uint32_t seed;                              // 使全部扩展名落在不同槽中的种子，0表示未找到
+    std::array<uint8_t, MIME_TABLE_SIZE> slot;  // 条目下标+1，0表示空槽
+};
+
+// 编译期逐个尝试种子，直到没有冲突
+static constexpr mimeSlots buildSlots(){
+    for(uint32_t seed = 2166136261u; seed != 2166136261u + 65536; seed++){
+        mimeSlots t = {seed, {}};
+        bool ok = true;
+        for(size_t i = 0; i < entryCount && ok; i++){
+            uint32_t h = extHash(entries[i].ext, extLen(entries[i].ext), seed) & (MIME_TABLE_SIZE - 1);
+            if(t.slot[h] != 0){
+                ok = false;
+            }
+            t.slot[h] = i + 1;
+        }
+        if(ok){
+            return t;
+        }
+    }
+    return mimeSlots{0, {}};
+}
+
+static constexpr mimeSlots slots = buildSlots();
+static_assert(slots.seed != 0, "no perfect hash seed for the MIME table");
+static_assert(entryCount < MIME_TABLE_SIZE && entryCount < 256, "MIME table too large");
+
+const mimeEntry* mimeType::lookup(const char* path){
+    const char* dot = strrchr(path, '.');
+    if(!dot || strchr(dot, '/')){
+        return &unknown;
+    }
+    const char* ext = dot + 1;
+    size_t n = strlen(ext);
+    if(n == 0 || n > MIME_EXT_MAX){
+        return &unknown;
+    }
+    uint8_t i = slots.slot[extHash(ext, n, slots.seed) & (MIME_TABLE_SIZE - 1)];
+    if(i == 0){
+        return &unknown;
+    }
+    const mimeEntry* e = &entries[i - 1];
+    if(strncasecmp(e->ext, ext, n) != 0 || e->ext[n] != '\0'){
+        return &unknown;
+    }
+    return e;
+}
+
+bool mimeType::setCache(const char* spec){
+    while(*spec){
+        const char* comma = strchr(spec, ',');
+        std::string item(spec, comma ? comma - spec : strlen(spec));
+        spec = comma ? comma + 1 : spec + item.size();
+        size_t eq = item.find('=');
+        if(eq == std::string::npos){
+            return false;
+        }
+        std::string name = item.substr(0, eq);
+        std::string value = item.substr(eq + 1);
+        int c = 0;
+        while(c < MIME_CATEGORY_COUNT && name != categoryNames[c]){
+            c++;
+        }
+        if(c == MIME_CATEGORY_COUNT){
+            return false;
+        }
+        if(value == "none"){
+            m_cache[c].clear();
+            continue;
+        }
+        char* end;
+        long seconds = strtol(value.c_str(), &end, 10);
+        if(value.empty() || *end != '\0' || seconds < 0){
+            return false;
+        }
+        m_cache[c] = seconds == 0 ? "no-cache" : "public, max-age=" + std::to_string(seconds);
+    }
+    return true;
+}
+
+const char* mimeType::cacheControl(int category){
+    return m_cache[category].empty() ? NULL : m_cache[category].c_str();
+}
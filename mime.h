@@ -0,0 +1,34 @@
+// 按扩展名确定静态文件的Content-Type：扩展名表在编译期生成完美哈希，查找只需1次哈希和1次比较；
+// 按类型类别配置Cache-Control，字体和图片默认长时间缓存
+#ifndef MIME_H
+#define MIME_H
+#include <string>
+
+#define MIME_EXT_MAX 8                          // 扩展名最大长度，更长的按未知类型处理
+#define MIME_TABLE_SIZE 256                     // 哈希槽数，须为2的幂
+
+// Cache-Control按类别配置
+enum MIME_CATEGORY { MIME_DOCUMENT = 0, MIME_SCRIPT, MIME_IMAGE, MIME_FONT, MIME_MEDIA, MIME_OTHER, MIME_CATEGORY_COUNT };
+
+struct mimeEntry{
+    const char* ext;
+    const char* type;
+    int category;
+};
+
+class mimeType{
+    public:
+        // 按路径最后1个'/'之后的扩展名查找，不区分大小写；未知扩展名返回application/octet-stream
+        static const mimeEntry* lookup(const char* path);
+
+        // 类别=秒数[,类别=秒数...]，类别为document、script、image、font、media、other；
+        // 秒数为0表示no-cache，none表示不发送Cache-Control
+        static bool setCache(const char* spec);
+
+        static const char* cacheControl(int category); // 该类别的Cache-Control值，NULL表示不发送
+
+    private:
+        static std::string m_cache[MIME_CATEGORY_COUNT];
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "rateLimit.h"
+#include "fileCache.h"
+
+#define RATE_SHARD_SLOTS (RATE_TABLE_SLOTS / RATE_SHARDS)
+
+std::vector<rateLimit::rule> rateLimit::rules;
+int rateLimit::globalRule = -1;
+rateLimit::shard rateLimit::shards[RATE_SHARDS];
+std::string rateLimit::m_response;
+
+static const char* too_many_429_form = "You have sent too many requests, please retry later.\n";
+
+bool rateLimit::addRule(const char* spec){
+    if(rules.size() >= RATE_MAX_RULES){
+        return false;
+    }
+    rule r;
+    r.bwRate = 0;
+    r.bwBurst = 0;
+    r.maxConn = 0;
+    const char* eq = strchr(spec, '=');
+    const char* comma = strchr(spec, ',');
+    if(spec[0] == '/' && eq && (!comma || eq < comma)){
+        r.prefix.assign(spec, eq - spec);
+        spec = eq + 1;
+    }
+    char* end;
+    double rate = strtod(spec, &end);
+    double burst = rate;
+    if(*end == ':'){
+        burst = strtod(end + 1, &end);
+    }
+    if(end == spec || rate <= 0 || burst < 1 || (*end != '\0' && *end != ',')){
+        return false;
+    }
+    r.rate = rate / 1000;
+    r.burst = burst;
+    // 逐个解析选项
+    while(*end == ','){
+        const char* opt = end + 1;
+        if(strncmp(opt, "bw=", 3) == 0){
+            double bw = strtod(opt + 3, &end);
+            if(bw <= 0){
+                return false;
+            }
+            // 突发为1秒的字节数
+            r.bwRate = bw / 1000;
+            r.bwBurst = bw;
+        }else if(strncmp(opt, "conn=", 5) == 0 && r.prefix.empty()){
+            r.maxConn = strtol(opt + 5, &end, 10);
+            if(r.maxConn <= 0){
+                return false;
+            }
+        }else{
+            return false;
+        }
+        if(*end != '\0' && *end != ','){
+            return false;
+        }
+    }
+    if(r.prefix.empty()){
+        if(globalRule != -1){
+            return false;
+        }
+        globalRule = rules.size();
+    }
+    rules.push_back(r);
+    return true;
+}
+
+const char* rateLimit::form(){
+    return too_many_429_form;
+}
+
+void rateLimit::init(){
+    if(rules.empty()){
+        return;
+    }
+    for(int i = 0; i < RATE_SHARDS; i++){
+        shards[i].slots = (bucket*)calloc(RATE_SHARD_SLOTS, sizeof(bucket));
+        if(!shards[i].slots){
+            throw std::exception();
+        }
+    }
+    char buf[256];
+    snprintf(buf, sizeof(buf), "HTTP/1.1 429 Too Many Requests\r\nContent-Length:%d\r\nContent-Type:text/html\r\n"
+        "Retry-After: 1\r\nConnection: close\r\n\r\n%s", (int)strlen(too_many_429_form), too_many_429_form);
+    m_response = buf;
+}
+
+// IPv4(含IPv4映射的IPv6地址)按单个地址，IPv6按/64网段，客户端通常持有整个/64
+uint64_t rateLimit::hashKey(const struct sockaddr_storage& addr, int ruleIdx){
+    uint64_t k = 0;
+    if(addr.ss_family == AF_INET){
+        k = ((const struct sockaddr_in*)&addr)->sin_addr.s_addr;
+    }else if(addr.ss_family == AF_INET6){
+        const struct in6_addr* a = &((const struct sockaddr_in6*)&addr)->sin6_addr;
+        if(IN6_IS_ADDR_V4MAPPED(a)){
+            uint32_t v4;
+            memcpy(&v4, a->s6_addr + 12, 4);
+            k = v4;
+        }else{
+            memcpy(&k, a->s6_addr, 8);
+            k ^= 1ULL << 63;                    // 与IPv4地址区分
+        }
+    }
+    // splitmix64混合规则序号
+    k += (uint64_t)(ruleIdx + 1) * 0x9E3779B97F4A7C15ULL;
+    k = (k ^ (k >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    k = (k ^ (k >> 27)) * 0x94D049BB133111EBULL;
+    k ^= k >> 31;
+    return k ? k : 1;
+}
+
+int rateLimit::matchRoute(const char* url){
+    int best = -1;
+    size_t bestLen = 0;
+    for(size_t i = 0; i < rules.size(); i++){
+        const std::string& p = rules[i].prefix;
+        if(!p.empty() && p.size() > bestLen && strncmp(url, p.c_str(), p.size()) == 0){
+            best = i;
+            bestLen = p.size();
+        }
+    }
+    return best;
+}
+
+void rateLimit::refill(bucket* b, uint32_t now, const rule& r){
+    uint32_t elapsed = now - b->stamp;
+    if(elapsed == 0){
+        return;
+    }
+    b->stamp = now;
+    double tokens = b->tokens + elapsed * r.rate;
+    b->tokens = tokens > r.burst ? r.burst : tokens;
+    if(r.bwRate > 0){
+        double bytes = b->bytes + elapsed * r.bwRate;
+        b->bytes = bytes > r.bwBurst ? r.bwBurst : bytes;
+    }
+}
+
+// 调用者持有分片锁；探测范围内没有空位且都有连接时返回NULL，此时不限流
+rateLimit::bucket* rateLimit::find(shard& s, uint64_t key, uint32_t now, const rule& r){
+    size_t start = (key / RATE_SHARDS) % RATE_SHARD_SLOTS;
+    bucket* victim = NULL;
+    for(int i = 0; i < RATE_PROBE; i++){
+        bucket* b = &s.slots[(start + i) % RATE_SHARD_SLOTS];
+        if(b->key == key){
+            refill(b, now, r);
+            return b;
+        }
+        if(b->key == 0){
+            victim = b;
+            break;
+        }
+        if(b->conns == 0 && (!victim || (uint32_t)(now - b->stamp) > (uint32_t)(now - victim->stamp))){
+            victim = b;
+        }
+    }
+    if(victim){
+        victim->key = key;
+        victim->stamp = now;
+        victim->tokens = r.burst;
+        victim->bytes = r.bwBurst;
+        victim->conns = 0;
+    }
+    return victim;
+}
+
+bool rateLimit::take(const struct sockaddr_storage& addr, int ruleIdx, uint32_t now){
+    const rule& r = rules[ruleIdx];
+    uint64_t key = hashKey(addr, ruleIdx);
+    shard& s = shards[key % RATE_SHARDS];
+    bool ok = true;
+    s.lock.lock();
+    bucket* b = find(s, key, now, r);
+    if(b){
+        if(b->tokens < 1 || (r.bwRate > 0 && b->bytes <= 0)){
+            ok = false;
+        }else{
+            b->tokens -= 1;
+        }
+    }
+    s.lock.unlock();
+    return ok;
+}
+
+void rateLimit::charge(const struct sockaddr_storage& addr, int ruleIdx, uint32_t now, long long bytes){
+    const rule& r = rules[ruleIdx];
+    if(r.bwRate <= 0){
+        return;
+    }
+    uint64_t key = hashKey(addr, ruleIdx);
+    shard& s = shards[key % RATE_SHARDS];
+    s.lock.lock();
+    bucket* b = find(s, key, now, r);
+    if(b){
+        b->bytes -= bytes;
+    }
+    s.lock.unlock();
+}
+
+bool rateLimit::connect(const struct sockaddr_storage& addr){
+    if(globalRule == -1 || rules[globalRule].maxConn == 0 || addr.ss_family == AF_UNIX){
+        return true;
+    }
+    const rule& r = rules[globalRule];
+    uint64_t key = hashKey(addr, globalRule);
+    shard& s = shards[key % RATE_SHARDS];
+    bool ok = true;
+    s.lock.lock();
+    bucket* b = find(s, key, (uint32_t)fileCache::now(), r);
+    if(b){
+        if(b->conns >= r.maxConn){
+            ok = false;
+        }else{
+            b->conns++;
+        }
+    }
+    s.lock.unlock();
+    return ok;
+}
+
+void rateLimit::disconnect(const struct sockaddr_storage& addr){
+    if(globalRule == -1 || rules[globalRule].maxConn == 0 || addr.ss_family == AF_UNIX){
+        return;
+    }
+    uint64_t key = hashKey(addr, globalRule);
+    shard& s = shards[key % RATE_SHARDS];
+    s.lock.lock();
+    // 有连接的桶不会被淘汰，只需按key查找
+    size_t start = (key / RATE_SHARDS) % RATE_SHARD_SLOTS;
+    for(int i = 0; i < RATE_PROBE; i++){
+        bucket* b = &s.slots[(start + i) % RATE_SHARD_SLOTS];
+        if(b->key == key){
+            if(b->conns > 0){
+                b->conns--;
+            }
+            break;
+        }
+    }
+    s.lock.unlock();
+}
+
+bool rateLimit::allow(const struct sockaddr_storage& addr, const char* url){
+    if(rules.empty() || addr.ss_family == AF_UNIX){
+        return true;
+    }
+    uint32_t now = fileCache::now();
+    if(globalRule != -1 && !take(addr, globalRule, now)){
+        return false;
+    }
+    int route = matchRoute(url);
+    return route == -1 || take(addr, route, now);
+}
+
+void rateLimit::consume(const struct sockaddr_storage& addr, const char* url, long long bytes){
+    if(rules.empty() || addr.ss_family == AF_UNIX || bytes <= 0){
+        return;
+    }
+    uint32_t now = fileCache::now();
+    if(globalRule != -1){
+        charge(addr, globalRule, now, bytes);
+    }
+    int route = matchRoute(url);
+    if(route != -1){
+        charge(addr, route, now, bytes);
+    }
+}
@@ -0,0 +1,82 @@
+// 按客户端IP限流：令牌桶存放在分片的定长哈希表中，访问时按经过的时间补充令牌，无全局锁
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+#include <stdint.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include "locker.h"
+
+#define RATE_SHARDS 64                          // 分片数，每片1把锁
+#define RATE_TABLE_SLOTS (1 << 20)              // 令牌桶总数，每个32字节，内存固定为32MB
+#define RATE_PROBE 8                            // 线性探测长度，探测不到空位时淘汰其中最久未访问的桶
+#define RATE_MAX_RULES 16
+
+/*
+    规则格式：[路由前缀=]请求数/秒[:突发][,bw=字节/秒][,conn=N]
+        100:200,bw=1048576,conn=64      每个IP每秒100个请求(突发200)，每秒1MB响应体，最多64个并发连接
+        /images/=5:10,bw=524288         每个IP访问/images/下的资源每秒5个请求，每秒512KB
+    不带前缀的规则作用于全部请求，带前缀的规则取与url匹配的最长前缀；conn只能用于不带前缀的规则
+    Unix域socket的连接来自本机，不限流
+*/
+class rateLimit{
+    public:
+        static bool addRule(const char* spec);  // 解析规则，格式错误返回false
+
+        static void init();                     // 有规则时分配令牌桶表，生成429响应
+
+        static bool enabled(){ return !rules.empty(); }
+
+        // reactor调用：连接数未超过上限时计数并返回true
+        static bool connect(const struct sockaddr_storage& addr);
+        static void disconnect(const struct sockaddr_storage& addr);
+
+        // 请求是否放行：消耗全局规则和路由规则各1个请求令牌，带宽令牌已透支时拒绝
+        static bool allow(const struct sockaddr_storage& addr, const char* url);
+
+        // 响应体字节数计入带宽，令牌可透支，透支期间的请求被拒绝
+        static void consume(const struct sockaddr_storage& addr, const char* url, long long bytes);
+
+        // 预先生成的429响应
+        static const char* response(){ return m_response.c_str(); }
+        static int responseLen(){ return m_response.size(); }
+        static const char* form();              // 429响应体，HTTP/2使用
+
+    private:
+        struct rule{
+            std::string prefix;                 // 空表示全部请求
+            double rate;                        // 每毫秒补充的请求令牌
+            double burst;
+            double bwRate;                      // 每毫秒补充的字节令牌，0表示不限
+            double bwBurst;
+            int maxConn;                        // 0表示不限
+        };
+
+        struct bucket{
+            uint64_t key;                       // 0表示空位
+            int64_t bytes;                      // 字节令牌，可为负(透支)
+            float tokens;                       // 请求令牌
+            uint32_t stamp;                     // 上次补充的时间，毫秒，回绕后按差值计算仍正确
+            int32_t conns;                      // 并发连接数，不为0的桶不被淘汰
+            uint32_t pad;
+        };
+
+        struct shard{
+            locker lock;
+            bucket* slots;
+        };
+
+        static uint64_t hashKey(const struct sockaddr_storage& addr, int ruleIdx);
+        static int matchRoute(const char* url);
+        static bucket* find(shard& s, uint64_t key, uint32_t now, const rule& r);
+        static void refill(bucket* b, uint32_t now, const rule& r);
+        static bool take(const struct sockaddr_storage& addr, int ruleIdx, uint32_t now);
+        static void charge(const struct sockaddr_storage& addr, int ruleIdx, uint32_t now, long long bytes);
+
+        static std::vector<rule> rules;
+        static int globalRule;                  // 不带前缀的规则，-1表示没有
+        static shard shards[RATE_SHARDS];
+        static std::string m_response;
+};
+
+#endif
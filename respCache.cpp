@@ -0,0 +1,304 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "respCache.h"
+#include "fileCache.h"
+#include "httpConnect.h"
+
+static_assert(RESP_SLAB_MIN << (RESP_SLAB_CLASSES - 1) == RESP_CACHE_MAX_ENTRY, "slab classes must reach the entry limit");
+
+// slab先于分片构造，退出时分片中的条目析构仍可归还slab块
+locker responseCache::slabLock;
+std::vector<char*> responseCache::slabFreeList[RESP_SLAB_CLASSES];
+size_t responseCache::slabRetained = 0;
+responseCache::shard responseCache::shards[RESP_CACHE_SHARDS];
+
+respEntry::~respEntry(){
+    responseCache::slabFree(data, capacity);
+}
+
+char* responseCache::slabAlloc(size_t size, size_t* capacity){
+    int c = 0;
+    while(((size_t)RESP_SLAB_MIN << c) < size){
+        c++;
+    }
+    *capacity = (size_t)RESP_SLAB_MIN << c;
+    char* p = NULL;
+    slabLock.lock();
+    if(!slabFreeList[c].empty()){
+        p = slabFreeList[c].back();
+        slabFreeList[c].pop_back();
+        slabRetained -= *capacity;
+    }
+    slabLock.unlock();
+    return p ? p : new char[*capacity];
+}
+
+void responseCache::slabFree(char* p, size_t capacity){
+    int c = 0;
+    while(((size_t)RESP_SLAB_MIN << c) < capacity){
+        c++;
+    }
+    slabLock.lock();
+    if(slabRetained + capacity <= RESP_SLAB_RETAIN){
+        slabFreeList[c].push_back(p);
+        slabRetained += capacity;
+        p = NULL;
+    }
+    slabLock.unlock();
+    delete [] p;
+}
+
+static bool unreserved(char c){
+    return isalnum((unsigned char)c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+static int hexValue(char c){
+    if(c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// URL按RFC 3986规范化：非保留字符的百分号编码解码，其余编码的十六进制转为大写，去掉空的查询字符串
+int responseCache::makeKey(char* buf, const char* method, const char* host, const char* url){
+    int n = snprintf(buf, RESP_CACHE_KEY_MAX, "%s ", method);
+    for(const char* p = host; p && *p && n < RESP_CACHE_KEY_MAX; p++){
+        buf[n++] = tolower((unsigned char)*p);
+    }
+    if(n < RESP_CACHE_KEY_MAX){
+        buf[n++] = ' ';
+    }
+    for(const char* p = url; *p && n < RESP_CACHE_KEY_MAX - 3; p++){
+        int hi, lo;
+        if(*p == '%' && (hi = hexValue(p[1])) >= 0 && (lo = hexValue(p[2])) >= 0){
+            char c = hi * 16 + lo;
+            if(unreserved(c)){
+                buf[n++] = c;
+            }else{
+                buf[n++] = '%';
+                buf[n++] = toupper((unsigned char)p[1]);
+                buf[n++] = toupper((unsigned char)p[2]);
+            }
+            p += 2;
+        }else if(*p == '?' && p[1] == '\0'){
+            break;
+        }else{
+            buf[n++] = *p;
+        }
+    }
+    return n < RESP_CACHE_KEY_MAX - 3 ? n : 0;
+}
+
+responseCache::shard& responseCache::shardOf(std::string_view key){
+    return shards[std::hash<std::string_view>()(key) % RESP_CACHE_SHARDS];
+}
+
+// 在分片锁内调用：找到请求头与Vary匹配的版本，超过可返回期限的版本顺便删除
+respEntryPtr responseCache::match(shard& s, std::string_view key, const headerGetter& header, long long now){
+    auto it = s.entries.find(key);
+    if(it == s.entries.end()){
+        return NULL;
+    }
+    std::vector<respEntryPtr>& variants = it->second;
+    for(size_t i = 0; i < variants.size(); i++){
+        respEntryPtr& e = variants[i];
+        if(now >= e->staleUntil && !e->revalidating){
+            s.bytes -= e->capacity;
+            variants.erase(variants.begin() + i);
+            i--;
+            continue;
+        }
+        size_t j = 0;
+        while(j < e->vary.size() && header(e->vary[j].c_str()) == e->varyValues[j]){
+            j++;
+        }
+        if(j == e->vary.size()){
+            return e;
+        }
+    }
+    return NULL;
+}
+
+respEntryPtr responseCache::lookup(std::string_view key, const headerGetter& header){
+    shard& s = shardOf(key);
+    long long now = fileCache::now();
+    s.lock.lock();
+    respEntryPtr e = match(s, key, header, now);
+    if(e && now >= e->expires && !(now < e->staleUntil && e->revalidating)){
+        e.reset();
+    }
+    s.lock.unlock();
+    return e;
+}
+
+respEntryPtr responseCache::acquire(std::string_view key, const headerGetter& header, flight& f, httpConnect* waiter){
+    shard& s = shardOf(key);
+    long long now = fileCache::now();
+    s.lock.lock();
+    respEntryPtr e = match(s, key, header, now);
+    if(e && (now < e->expires || (now < e->staleUntil && e->revalidating))){
+        s.lock.unlock();
+        return e;
+    }
+    auto it = s.inflight.find(key);
+    if(it == s.inflight.end()){
+        // 成为填充者；过期但仍可返回的条目在更新期间返回给其他请求
+        s.inflight.emplace(std::string(key), std::vector<httpConnect*>());
+        if(e){
+            e->revalidating = true;
+        }
+        memcpy(f.m_key, key.data(), key.size());
+        f.m_keyLen = key.size();
+        f.m_active = true;
+    }else if(waiter && it->second.size() < RESP_CACHE_WAITERS){
+        // 其他请求正在访问后端且没有可返回的旧响应：连接挂起在该键上，不占用线程等待
+        it->second.push_back(waiter);
+        f.m_waiting = true;
+    }
+    s.lock.unlock();
+    return NULL;
+}
+
+// 填充结束：e为NULL表示更新失败或不可缓存；挂起的连接在锁外恢复
+void responseCache::complete(std::string_view key, const respEntryPtr& e){
+    shard& s = shardOf(key);
+    std::vector<httpConnect*> waiters;
+    s.lock.lock();
+    auto f = s.inflight.find(key);
+    if(f != s.inflight.end()){
+        waiters.swap(f->second);
+        s.inflight.erase(f);
+    }
+    store(s, key, e);
+    s.lock.unlock();
+    for(size_t i = 0; i < waiters.size(); i++){
+        waiters[i]->cacheFilled(e != NULL);
+    }
+}
+
+// 持有分片锁时调用
+void responseCache::store(shard& s, std::string_view key, const respEntryPtr& e){
+    auto it = s.entries.find(key);
+    if(!e){
+        // 过期的条目恢复为可由下一个请求更新
+        if(it != s.entries.end()){
+            for(size_t i = 0; i < it->second.size(); i++){
+                it->second[i]->revalidating = false;
+            }
+        }
+        return;
+    }
+    if(it == s.entries.end()){
+        it = s.entries.emplace(std::string(key), std::vector<respEntryPtr>()).first;
+        s.fifo.push_back(it->first);
+    }
+    // 替换Vary取值相同的版本，版本数达到上限时替换最早的
+    std::vector<respEntryPtr>& variants = it->second;
+    size_t i = 0;
+    while(i < variants.size() && variants[i]->varyValues != e->varyValues){
+        i++;
+    }
+    if(i == variants.size() && variants.size() >= RESP_CACHE_VARIANTS){
+        i = 0;
+    }
+    if(i < variants.size()){
+        s.bytes -= variants[i]->capacity;
+        variants.erase(variants.begin() + i);
+    }
+    variants.push_back(e);
+    s.bytes += e->capacity;
+    // 超出分片容量时按插入顺序淘汰，正在发送的条目由连接持有的引用保证有效
+    while(s.bytes > RESP_CACHE_MAX_BYTES / RESP_CACHE_SHARDS && !s.fifo.empty()){
+        auto old = s.entries.find(s.fifo.front());
+        if(old != s.entries.end() && old->first != key){
+            for(size_t j = 0; j < old->second.size(); j++){
+                s.bytes -= old->second[j]->capacity;
+            }
+            s.entries.erase(old);
+        }else if(old != s.entries.end()){
+            // 刚填充的键放回队尾
+            s.fifo.push_back(s.fifo.front());
+            if(s.fifo.size() == 2 || s.entries.size() == 1){
+                s.fifo.pop_front();
+                break;
+            }
+        }
+        s.fifo.pop_front();
+    }
+}
+
+responseCache::flight::~flight(){
+    if(m_active){
+        complete(std::string_view(m_key, m_keyLen), NULL);
+    }
+}
+
+void responseCache::flight::fill(const respEntryPtr& e){
+    if(m_active){
+        m_active = false;
+        complete(std::string_view(m_key, m_keyLen), e);
+    }
+}
+
+bool responseCache::policy(std::string_view cacheControl, long long* ttl, long long* swr){
+    *ttl = -1;
+    *swr = 0;
+    long long sMaxAge = -1;
+    size_t pos = 0;
+    while(pos < cacheControl.size()){
+        size_t comma = cacheControl.find(',', pos);
+        if(comma == std::string_view::npos){
+            comma = cacheControl.size();
+        }
+        std::string_view item = cacheControl.substr(pos, comma - pos);
+        pos = comma + 1;
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')){
+            item.remove_prefix(1);
+        }
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t')){
+            item.remove_suffix(1);
+        }
+        size_t eq = item.find('=');
+        std::string_view name = item.substr(0, eq);
+        long long value = eq == std::string_view::npos ? -1 : atoll(std::string(item.substr(eq + 1)).c_str());
+        if(name.size() == 8 && strncasecmp(name.data(), "no-store", 8) == 0){
+            return false;
+        }
+        if(name.size() == 8 && strncasecmp(name.data(), "no-cache", 8) == 0){
+            return false;
+        }
+        if(name.size() == 7 && strncasecmp(name.data(), "private", 7) == 0){
+            return false;
+        }
+        if(name.size() == 7 && strncasecmp(name.data(), "max-age", 7) == 0){
+            *ttl = value;
+        }else if(name.size() == 8 && strncasecmp(name.data(), "s-maxage", 8) == 0){
+            sMaxAge = value;
+        }else if(name.size() == 22 && strncasecmp(name.data(), "stale-while-revalidate", 22) == 0 && value > 0){
+            *swr = value;
+        }
+    }
+    // 共享缓存优先使用s-maxage
+    if(sMaxAge >= 0){
+        *ttl = sMaxAge;
+    }
+    return *ttl > 0;
+}
+
+respEntryPtr responseCache::create(size_t headLen, size_t bodyLen){
+    if(headLen > RESP_CACHE_HEAD_MAX || headLen + bodyLen > RESP_CACHE_MAX_ENTRY){
+        return NULL;
+    }
+    respEntryPtr e = std::make_shared<respEntry>();
+    e->data = slabAlloc(headLen + bodyLen, &e->capacity);
+    e->headLen = headLen;
+    e->bodyLen = bodyLen;
+    e->status = 200;
+    e->expires = 0;
+    e->staleUntil = 0;
+    e->revalidating = false;
+    return e;
+}
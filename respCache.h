@@ -0,0 +1,121 @@
+// 动态响应缓存：反向代理的GET响应按 方法+主机+规范化的URL+Vary列出的请求头 缓存，
+// 响应头和响应体序列化后存放在按大小分级的slab块中，reactor命中时直接发送；
+// 新鲜期由后端的Cache-Control决定，过期后stale-while-revalidate期间由1个请求更新，其余请求返回旧响应；
+// 同一个键同时未命中时只有1个请求访问后端，其余HTTP/1.1请求的连接挂起在该键上，不占用线程，填充结束后恢复
+#ifndef RESPCACHE_H
+#define RESPCACHE_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include "locker.h"
+
+#define RESP_CACHE_SHARDS 16                    // 分片数，每片1把锁
+#define RESP_CACHE_MAX_BYTES (64 * 1024 * 1024) // 缓存总容量，平均分给各分片
+#define RESP_CACHE_MAX_ENTRY (1024 * 1024)      // 可缓存的最大响应(响应头+响应体)
+#define RESP_CACHE_HEAD_MAX 3072                // 响应头上限，发送时与Connection字段一起放入写缓冲
+#define RESP_CACHE_KEY_MAX 1024
+#define RESP_CACHE_VARIANTS 4                   // 同一个URL按Vary缓存的最多版本数
+#define RESP_CACHE_WAITERS 1024                 // 每个键挂起等待填充的最多连接数，超过的直接访问后端
+#define RESP_SLAB_MIN 1024                      // 最小的slab块，逐级翻倍到RESP_CACHE_MAX_ENTRY
+#define RESP_SLAB_CLASSES 11                    // 1KB到1MB
+#define RESP_SLAB_RETAIN (8 * 1024 * 1024)      // 空闲slab块保留的总字节数，超出的归还全局堆
+
+struct respEntry{
+    std::vector<std::string> vary;              // 响应Vary中的请求头名
+    std::vector<std::string> varyValues;        // 缓存时这些请求头的值
+    char* data;                                 // 响应头(不含Connection和结尾的空行) + 响应体
+    size_t capacity;                            // slab块大小
+    size_t headLen;
+    size_t bodyLen;
+    int status;
+    std::string contentType;                    // HTTP/2响应使用
+    long long expires;                          // 此前为新鲜
+    long long staleUntil;                       // 此前过期的响应仍可在更新期间返回
+    std::atomic<bool> revalidating;             // 已有请求正在更新
+    ~respEntry();
+};
+
+typedef std::shared_ptr<respEntry> respEntryPtr;
+
+class httpConnect;
+
+// 按名称取请求头的值，没有该字段时返回空
+typedef std::function<std::string_view(const char* name)> headerGetter;
+
+class responseCache{
+    public:
+        // 未命中的请求：持有时该键只由它填充，析构时未填充则以不可缓存结束
+        class flight{
+            public:
+                flight() : m_active(false), m_waiting(false){}
+                ~flight();
+                bool active() const { return m_active; }
+
+                // 已挂起在其他请求的填充上，填充结束时由httpConnect::cacheFilled恢复；此后调用者不能再访问连接
+                bool waiting() const { return m_waiting; }
+
+                // 后端响应可缓存：加入缓存
+                void fill(const respEntryPtr& e);
+
+            private:
+                friend class responseCache;
+                char m_key[RESP_CACHE_KEY_MAX];
+                int m_keyLen;
+                bool m_active;
+                bool m_waiting;
+        };
+
+        // 缓存键：方法 主机 规范化的URL；超过RESP_CACHE_KEY_MAX时返回0，不缓存
+        static int makeKey(char* buf, const char* method, const char* host, const char* url);
+
+        // reactor调用：新鲜的条目，或其他请求正在更新的过期条目；不等待
+        static respEntryPtr lookup(std::string_view key, const headerGetter& header);
+
+        // 工作线程调用：命中同lookup；未命中时成为填充者(f.active()为true)并返回NULL；
+        // 该键已有填充者时，给出waiter则将其挂起(f.waiting()为true)，否则不等待，直接访问后端
+        static respEntryPtr acquire(std::string_view key, const headerGetter& header, flight& f, httpConnect* waiter = NULL);
+
+        // 解析后端响应的Cache-Control，可缓存时返回true及新鲜期和过期后可返回的时长(秒)
+        static bool policy(std::string_view cacheControl, long long* ttl, long long* swr);
+
+        // 分配条目，data有headLen + bodyLen字节；超过RESP_CACHE_MAX_ENTRY时返回NULL
+        static respEntryPtr create(size_t headLen, size_t bodyLen);
+
+    private:
+        struct keyHash{
+            typedef void is_transparent;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+        };
+
+        struct shard{
+            locker lock;
+            std::unordered_map<std::string, std::vector<respEntryPtr>, keyHash, std::equal_to<> > entries;
+            // 正在访问后端的键及挂起等待其结果的连接
+            std::unordered_map<std::string, std::vector<httpConnect*>, keyHash, std::equal_to<> > inflight;
+            std::list<std::string> fifo;        // 插入顺序，用于淘汰
+            size_t bytes;
+            shard() : bytes(0){}
+        };
+
+        static shard& shardOf(std::string_view key);
+        static respEntryPtr match(shard& s, std::string_view key, const headerGetter& header, long long now);
+        static void complete(std::string_view key, const respEntryPtr& e);
+        static void store(shard& s, std::string_view key, const respEntryPtr& e);
+
+        static shard shards[RESP_CACHE_SHARDS];
+
+        // slab：按2的幂分级，释放的块留给同级复用
+        friend struct respEntry;
+        static char* slabAlloc(size_t size, size_t* capacity);
+        static void slabFree(char* p, size_t capacity);
+        static locker slabLock;
+        static std::vector<char*> slabFreeList[RESP_SLAB_CLASSES];
+        static size_t slabRetained;
+};
+
+#endif
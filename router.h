@@ -0,0 +1,301 @@
+// 路由表：启动时注册，编译为紧凑的基数树(radix trie)，查找不分配内存，复杂度O(路径长度)
+#ifndef ROUTER_H
+#define ROUTER_H
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#define MAX_ROUTE_PARAMS 8                      // 单个路由的最大参数数量
+#define ROUTE_METHODS 8                         // 与httpConnect::METHOD一致
+
+// 路由参数，指向请求url中的片段，不拷贝
+struct routeParams{
+    int cnt;
+    const char* name[MAX_ROUTE_PARAMS];
+    const char* value[MAX_ROUTE_PARAMS];
+    int len[MAX_ROUTE_PARAMS];
+};
+
+// 路由规则：
+//  /login          精确匹配
+//  /user/:id       参数匹配，:id匹配1个路径段(不含'/')
+//  /static/*       前缀匹配，*匹配剩余路径，须位于末尾，参数名为"*"
+// 匹配优先级：静态 > 参数 > 前缀，失败时回溯
+template<typename H>
+class router{
+    public:
+        // 路由查找的结果
+        enum MATCH_RESULT { MATCH_OK = 0, MATCH_NOT_FOUND, MATCH_METHOD_NOT_ALLOWED };
+
+        router() : root(new buildNode()), compiled(false){}
+
+        // methods: 按位表示允许的请求方法，1 << httpConnect::GET
+        bool add(unsigned int methods, const char* pattern, const H& handler);
+
+        // 将构建时的树展开为连续数组，之后才能查找
+        void compile();
+
+        // path至'?'或'\0'结束；参数写入params
+        MATCH_RESULT match(int method, const char* path, routeParams* params, const H** handler) const;
+
+    private:
+        // 构建阶段的节点
+        struct buildNode{
+            std::string label;                  // 静态边的标签
+            std::vector<std::unique_ptr<buildNode> > children;
+            std::unique_ptr<buildNode> paramChild;
+            std::unique_ptr<buildNode> wildChild;
+            std::string paramName;
+            int handlers[ROUTE_METHODS];
+            buildNode(){
+                for(int i = 0; i < ROUTE_METHODS; i++){
+                    handlers[i] = -1;
+                }
+            }
+        };
+
+        // 编译后的节点，子节点连续存放并按首字符排序
+        struct node{
+            int labelOff;                       // 标签在labels中的偏移
+            int labelLen;
+            int firstChild;                     // 静态子节点在nodes中的起始位置
+            int childCnt;
+            int paramChild;                     // -1表示没有
+            int wildChild;
+            int paramName;                      // 参数名在labels中的偏移
+            bool terminal;
+            int handlers[ROUTE_METHODS];
+        };
+
+        buildNode* insertStatic(buildNode* cur, const std::string& text);
+        int flatten(buildNode* b);
+        int lookup(int idx, const char* path, const char* end, routeParams* params) const;
+
+    private:
+        std::unique_ptr<buildNode> root;
+        std::vector<H> handlerTable;
+        std::vector<node> nodes;
+        std::string labels;                     // 所有标签和参数名，以'\0'分隔
+        bool compiled;
+};
+
+// 在cur下插入静态文本，必要时分裂已有的边
+template<typename H>
+typename router<H>::buildNode* router<H>::insertStatic(buildNode* cur, const std::string& text){
+    size_t pos = 0;
+    while(pos < text.size()){
+        buildNode* next = NULL;
+        for(size_t i = 0; i < cur->children.size(); i++){
+            buildNode* child = cur->children[i].get();
+            if(child->label[0] != text[pos]){
+                continue;
+            }
+            // 公共前缀长度
+            size_t k = 0;
+            while(k < child->label.size() && pos + k < text.size() && child->label[k] == text[pos + k]){
+                k++;
+            }
+            if(k < child->label.size()){
+                // 分裂：child的前k个字符成为新的中间节点
+                std::unique_ptr<buildNode> mid(new buildNode());
+                mid->label = child->label.substr(0, k);
+                child->label = child->label.substr(k);
+                mid->children.push_back(std::move(cur->children[i]));
+                cur->children[i] = std::move(mid);
+            }
+            next = cur->children[i].get();
+            pos += k;
+            break;
+        }
+        if(!next){
+            std::unique_ptr<buildNode> leaf(new buildNode());
+            leaf->label = text.substr(pos);
+            next = leaf.get();
+            cur->children.push_back(std::move(leaf));
+            pos = text.size();
+        }
+        cur = next;
+    }
+    return cur;
+}
+
+template<typename H>
+bool router<H>::add(unsigned int methods, const char* pattern, const H& handler){
+    if(compiled || !pattern || pattern[0] != '/'){
+        return false;
+    }
+    buildNode* cur = root.get();
+    const char* p = pattern;
+    while(*p){
+        if(*p == ':'){
+            // 参数段
+            const char* e = strchr(p, '/');
+            if(!e){
+                e = p + strlen(p);
+            }
+            std::string name(p + 1, e - p - 1);
+            if(name.empty()){
+                return false;
+            }
+            if(!cur->paramChild){
+                cur->paramChild.reset(new buildNode());
+                cur->paramChild->paramName = name;
+            }else if(cur->paramChild->paramName != name){
+                return false; // 同一位置的参数名冲突
+            }
+            cur = cur->paramChild.get();
+            p = e;
+        }else if(*p == '*'){
+            // 前缀匹配，必须位于末尾
+            if(p[1] != '\0'){
+                return false;
+            }
+            if(!cur->wildChild){
+                cur->wildChild.reset(new buildNode());
+                cur->wildChild->paramName.push_back('*');
+            }
+            cur = cur->wildChild.get();
+            p++;
+        }else{
+            const char* e = p + strcspn(p, ":*");
+            cur = insertStatic(cur, std::string(p, e - p));
+            p = e;
+        }
+    }
+    int index = handlerTable.size();
+    handlerTable.push_back(handler);
+    for(int m = 0; m < ROUTE_METHODS; m++){
+        if(methods & (1u << m)){
+            cur->handlers[m] = index;
+        }
+    }
+    return true;
+}
+
+// 追加1个编译后的节点，子节点引用由compile填充
+template<typename H>
+int router<H>::flatten(buildNode* b){
+    node n;
+    n.labelOff = labels.size();
+    n.labelLen = b->label.size();
+    labels += b->label;
+    labels += '\0';
+    n.paramName = labels.size();
+    labels += b->paramName;
+    labels += '\0';
+    n.terminal = false;
+    for(int m = 0; m < ROUTE_METHODS; m++){
+        n.handlers[m] = b->handlers[m];
+        n.terminal = n.terminal || b->handlers[m] >= 0;
+    }
+    n.firstChild = -1;
+    n.childCnt = 0;
+    n.paramChild = -1;
+    n.wildChild = -1;
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+// 广度优先展开，保证兄弟节点连续存放
+template<typename H>
+void router<H>::compile(){
+    nodes.clear();
+    labels.clear();
+    std::vector<std::pair<buildNode*, int> > queue;
+    queue.push_back(std::make_pair(root.get(), flatten(root.get())));
+    for(size_t q = 0; q < queue.size(); q++){
+        buildNode* b = queue[q].first;
+        int idx = queue[q].second;
+        std::sort(b->children.begin(), b->children.end(),
+            [](const std::unique_ptr<buildNode>& x, const std::unique_ptr<buildNode>& y){ return x->label < y->label; });
+        if(!b->children.empty()){
+            nodes[idx].firstChild = nodes.size();
+            nodes[idx].childCnt = b->children.size();
+            for(size_t i = 0; i < b->children.size(); i++){
+                queue.push_back(std::make_pair(b->children[i].get(), flatten(b->children[i].get())));
+            }
+        }
+        if(b->paramChild){
+            int c = flatten(b->paramChild.get());
+            nodes[idx].paramChild = c;
+            queue.push_back(std::make_pair(b->paramChild.get(), c));
+        }
+        if(b->wildChild){
+            int c = flatten(b->wildChild.get());
+            nodes[idx].wildChild = c;
+            queue.push_back(std::make_pair(b->wildChild.get(), c));
+        }
+    }
+    root.reset();
+    compiled = true;
+}
+
+// 在节点idx处匹配剩余路径[path, end)，返回终止节点下标，失败返回-1
+template<typename H>
+int router<H>::lookup(int idx, const char* path, const char* end, routeParams* params) const{
+    const node& n = nodes[idx];
+    if(path == end && n.terminal){
+        return idx;
+    }
+    if(path < end && n.childCnt > 0){
+        // 子节点按首字符有序，首字符不同的边至多1条匹配
+        const node* lo = &nodes[n.firstChild];
+        const node* hi = lo + n.childCnt;
+        const node* c = std::lower_bound(lo, hi, *path, [this](const node& x, char ch){
+            return (unsigned char)labels[x.labelOff] < (unsigned char)ch;
+        });
+        if(c != hi && labels[c->labelOff] == *path && end - path >= c->labelLen
+            && memcmp(labels.data() + c->labelOff, path, c->labelLen) == 0){
+            int r = lookup(c - &nodes[0], path + c->labelLen, end, params);
+            if(r >= 0){
+                return r;
+            }
+        }
+    }
+    if(n.paramChild >= 0 && path < end && *path != '/' && params->cnt < MAX_ROUTE_PARAMS){
+        const char* e = path;
+        while(e < end && *e != '/'){
+            e++;
+        }
+        int k = params->cnt++;
+        params->name[k] = labels.data() + nodes[n.paramChild].paramName;
+        params->value[k] = path;
+        params->len[k] = e - path;
+        int r = lookup(n.paramChild, e, end, params);
+        if(r >= 0){
+            return r;
+        }
+        params->cnt--;
+    }
+    if(n.wildChild >= 0 && nodes[n.wildChild].terminal && params->cnt < MAX_ROUTE_PARAMS){
+        int k = params->cnt++;
+        params->name[k] = "*";
+        params->value[k] = path;
+        params->len[k] = end - path;
+        return n.wildChild;
+    }
+    return -1;
+}
+
+template<typename H>
+typename router<H>::MATCH_RESULT router<H>::match(int method, const char* path, routeParams* params, const H** handler) const{
+    params->cnt = 0;
+    if(!compiled || nodes.empty() || method < 0 || method >= ROUTE_METHODS){
+        return MATCH_NOT_FOUND;
+    }
+    const char* end = path + strcspn(path, "?");
+    int idx = lookup(0, path, end, params);
+    if(idx < 0){
+        return MATCH_NOT_FOUND;
+    }
+    int h = nodes[idx].handlers[method];
+    if(h < 0){
+        return MATCH_METHOD_NOT_ALLOWED;
+    }
+    *handler = &handlerTable[h];
+    return MATCH_OK;
+}
+
+#endif
@@ -4,18 +4,43 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <error.h>
 #include <sys/epoll.h>
 #include <signal.h>
+#include <getopt.h>
+#include <vector>
 #include "locker.h"
 #include "threadPool.h"
 #include "httpConnect.h"
+#include "coroutine.h"
+#include "diskIO.h"
+#include "userStore.h"
+#include "sslContext.h"
+#include "listener.h"
+#include "dirIndex.h"
+#include "rateLimit.h"
+#include "writeScheduler.h"
+#include "upstream.h"
+#include "tracer.h"
+#include "handoff.h"
+#include "supervisor.h"
 
 #define MAX_CONN 65535 // 最大连接数
 #define MAX_EVENT 10000 // 最大监听事件数量
+#define USER_DB "user.db" // 默认的用户数据库文件，相对于启动目录
+#define DRAIN_TIMEOUT 30000 // 毫秒，排空时等待进行中请求的最长时间
+#define DRAIN_CHECK_INTERVAL 100 // 毫秒，排空时检查空闲连接的间隔
+
+// SIGTERM或新进程接管后置位，reactor停止accept并排空连接
+static volatile sig_atomic_t stopRequested = 0;
+void requestStop(int){
+    stopRequested = 1;
+}
+
 // 信号捕捉
 void addsig(int sig, void(*handler)(int)){
     struct sigaction sa;
@@ -34,17 +59,215 @@ extern void modfd(int epollfd, int fd, int event);
 // 设置文件描述符非阻塞
 extern void setNonblock(int fd);
 
+// 打开监听socket并加入epoll，已从旧进程接管的socket直接加入
+void addListen(int epollfd, listener& l){
+    if(l.fd == -1 && !l.open()){
+        printf("Failed to listen on %s.\n", l.address.c_str());
+        exit(-1);
+    }
+    // 将监听的文件描述符添加到epoll
+    struct epoll_event event;
+    setNonblock(l.fd);
+    event.data.fd = l.fd;
+    event.events =  EPOLLIN | EPOLLRDHUP;//EPOLLRDHUP事件判断client断开连接
+    if(supervisor::enabled()){
+        // 多个工作进程共享监听socket：每个新连接只唤醒1个进程
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    }
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, l.fd, &event);
+}
+
+// 查找监听socket，监听地址只有几个，顺序查找即可
+listener* findListen(std::vector<listener>& listeners, int fd){
+    for(size_t i = 0; i < listeners.size(); i++){
+        if(listeners[i].fd == fd){
+            return &listeners[i];
+        }
+    }
+    return NULL;
+}
+
+void usage(const char* name){
+    printf("Please input in the following format: %s port number.\n", name);
+    printf("HTTPS: %s port tlsPort certFile keyFile [user], user表示不使用kTLS.\n", name);
+    printf("Listeners: %s -l addr[,opts] [-l ...] [-s addr[,opts] -c certFile -k keyFile [-u]]\n", name);
+    printf("    addr: port | ip:port | [ipv6]:port | unix:path, opts: backlog=N,reuseport,defer=N\n");
+    printf("    -a: 目录中没有index.html时返回目录列表\n");
+    printf("    -m: 每次处理请求后输出arena用量和operator new次数，用于检查稳定状态下没有堆分配\n");
+    printf("    -r [/prefix=]req/s[:burst][,bw=bytes/s][,conn=N]: 按客户端IP限流，可重复\n");
+    printf("    -p connRate[:totalRate]: 大文件响应的单连接速率和全部连接的总速率，字节/秒\n");
+    printf("    -x /prefix/=addr[,addr...]: 反向代理，addr格式同监听地址，可重复\n");
+    printf("    -t N: 每N个请求追踪1个，kill -USR2导出；-T trace.bin: 转换为Chrome trace JSON并退出\n");
+    printf("    -C type=seconds[,...]: 静态文件的Cache-Control，type为document、script、image、font、media、other，0为no-cache，none为不发送\n");
+    printf("    -K N: 每个keep-alive连接最多处理N个请求，默认%d，0为不限制\n", MAX_KEEPALIVE_REQUESTS);
+    printf("    -U path: 升级控制socket，启动时从path上运行的旧进程接管监听socket和缓存清单；SIGTERM时排空连接后退出\n");
+    printf("    -d path: 用户数据库文件，默认为当前目录下的%s\n", USER_DB);
+    printf("    -w N: 多进程模式，主进程监管N个共享监听socket的工作进程，异常退出时重启；kill -USR1主进程输出各进程的连接数和请求数\n");
+}
+
 int main(int argc, char* argv[]){// argc: 参数个数 argv[]: 存储各个参数
     if(argc <= 1){
-        printf("Please input in the following format: %s port number.\n", argv[0]);
+        usage(argv[0]);
         exit(-1);
     }
 
-    // 获取端口号
-    int port = atoi(argv[1]);
-
     // 处理SIGPIPE信号
     addsig(SIGPIPE, SIG_IGN);
+    // 导出追踪记录
+    addsig(SIGUSR2, tracer::requestDump);
+    // 优雅退出
+    addsig(SIGTERM, requestStop);
+
+    // 监听地址：-l为HTTP，-s为HTTPS；旧格式的端口参数等价于只指定端口的监听地址
+    std::vector<listener> listeners;
+    const char* certFile = NULL;
+    const char* keyFile = NULL;
+    bool ktls = true;
+    bool autoindex = false;
+    int traceSample = 0;
+    const char* controlPath = NULL;
+    unsigned int paceRate = 0;
+    long long totalRate = 0;
+    int workers = 0;
+    const char* userDb = USER_DB;
+    if(argv[1][0] != '-'){
+        listeners.emplace_back();
+        listeners.back().parse(argv[1]);
+        if(argc >= 5){
+            listeners.emplace_back();
+            listeners.back().parse(argv[2]);
+            listeners.back().tls = true;
+            certFile = argv[3];
+            keyFile = argv[4];
+            ktls = !(argc >= 6 && strcmp(argv[5], "user") == 0);
+        }
+    }else{
+        int opt;
+        while((opt = getopt(argc, argv, "l:s:c:k:uamr:p:x:t:T:U:C:K:w:d:")) != -1){
+            switch(opt){
+                case 'l':
+                case 's':
+                    listeners.emplace_back();
+                    if(!listeners.back().parse(optarg)){
+                        printf("Invalid listen address %s.\n", optarg);
+                        exit(-1);
+                    }
+                    listeners.back().tls = opt == 's';
+                    break;
+                case 'c':
+                    certFile = optarg;
+                    break;
+                case 'k':
+                    keyFile = optarg;
+                    break;
+                case 'u':
+                    ktls = false;
+                    break;
+                case 'a':
+                    autoindex = true;
+                    break;
+                case 'm':
+                    requestArena::setDebug(true);
+                    break;
+                case 'p':{
+                    char* end;
+                    paceRate = strtoul(optarg, &end, 10);
+                    if(*end == ':'){
+                        totalRate = strtoll(end + 1, &end, 10);
+                    }
+                    if(*end != '\0'){
+                        printf("Invalid pacing rate %s.\n", optarg);
+                        exit(-1);
+                    }
+                    break;
+                }
+                case 'K':{
+                    char* end;
+                    long n = strtol(optarg, &end, 10);
+                    if(*end != '\0' || n < 0 || n > INT_MAX){
+                        printf("Invalid max requests %s.\n", optarg);
+                        exit(-1);
+                    }
+                    httpConnect::m_maxRequests = n;
+                    break;
+                }
+                case 't':
+                    traceSample = atoi(optarg);
+                    break;
+                case 'T':
+                    if(!tracer::convert(optarg, stdout)){
+                        printf("Invalid trace file %s.\n", optarg);
+                        exit(-1);
+                    }
+                    exit(0);
+                case 'C':
+                    if(!mimeType::setCache(optarg)){
+                        printf("Invalid cache policy %s.\n", optarg);
+                        exit(-1);
+                    }
+                    break;
+                case 'U':
+                    controlPath = optarg;
+                    break;
+                case 'd':
+                    userDb = optarg;
+                    break;
+                case 'w':{
+                    char* end;
+                    workers = strtol(optarg, &end, 10);
+                    if(*end != '\0' || workers < 1 || workers > SUPERVISOR_MAX_WORKERS){
+                        printf("Invalid worker count %s.\n", optarg);
+                        exit(-1);
+                    }
+                    break;
+                }
+                case 'x':
+                    if(!upstream::addGroup(optarg)){
+                        printf("Invalid upstream %s.\n", optarg);
+                        exit(-1);
+                    }
+                    break;
+                case 'r':
+                    if(!rateLimit::addRule(optarg)){
+                        printf("Invalid rate limit %s.\n", optarg);
+                        exit(-1);
+                    }
+                    break;
+                default:
+                    usage(argv[0]);
+                    exit(-1);
+            }
+        }
+    }
+
+    // HTTPS监听地址需要证书
+    for(size_t i = 0; i < listeners.size(); i++){
+        if(listeners[i].tls && !sslContext::enabled()){
+            if(!certFile || !keyFile || !sslContext::init(certFile, keyFile, ktls)){
+                printf("Failed to load certificate %s or key %s.\n", certFile ? certFile : "", keyFile ? keyFile : "");
+                exit(-1);
+            }
+        }
+    }
+
+    // 多进程模式：主进程接管或打开监听socket，fork出工作进程后只负责监管，以下的初始化在各工作进程中进行；
+    // 旧进程传来的缓存清单由每个工作进程各自预热
+    std::vector<std::string> manifest;
+    if(workers > 0){
+        if(controlPath && handoff::receive(controlPath, listeners, manifest)){
+            printf("handoff: took over listeners from %s, %d cached files\n", controlPath, (int)manifest.size());
+        }
+        for(size_t i = 0; i < listeners.size(); i++){
+            if(listeners[i].fd == -1 && !listeners[i].open()){
+                printf("Failed to listen on %s.\n", listeners[i].address.c_str());
+                exit(-1);
+            }
+        }
+        if(supervisor::run(workers, listeners, controlPath) < 0){
+            return 0;
+        }
+        controlPath = NULL;
+    }
 
     // 线程池，任务类型HTTP通信
     threadPool<httpConnect>* pool = NULL;
@@ -54,56 +277,93 @@ int main(int argc, char* argv[]){// argc: 参数个数 argv[]: 存储各个参
         exit(-1);
     }
 
-    // http数组记录客户端信息
-    httpConnect * clients = new httpConnect[MAX_CONN];
-
-    // 套接字通信
-    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
-    if(listenfd == -1){
-        perror("socket");
+    // 用户数据库，连接池句柄数与工作线程数一致
+    if(!userStore::init(userDb, 8)){
         exit(-1);
     }
-    // 端口复用
-    int optval = 1;
-    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
-
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
-    address.sin_addr.s_addr = INADDR_ANY;
-    int ret = bind(listenfd, (struct sockaddr*) &address, sizeof(address));
-    if(ret == -1){
-        perror("bind");
-        exit(-1);
+
+    // 注册路由：静态文件作为默认处理函数
+    httpConnect::addRoute(1 << httpConnect::GET, "/*", &httpConnect::solve_request);
+    httpConnect::addRoute(1 << httpConnect::GET | 1 << httpConnect::POST, "/login", &httpConnect::login_co, &httpConnect::login_request);
+    httpConnect::addRoute(1 << httpConnect::GET | 1 << httpConnect::POST, "/register", &httpConnect::register_request);
+    // 反向代理：前缀下的全部请求方法都转发给后端
+    for(int i = 0; i < upstream::groupCount(); i++){
+        httpConnect::addRoute((1 << ROUTE_METHODS) - 1, (upstream::prefix(i) + "*").c_str(), &httpConnect::proxy_request);
     }
-    listen(listenfd, 8);
-    
+    httpConnect::compileRoutes();
+
+    // http数组记录客户端信息
+    httpConnect * clients = new httpConnect[MAX_CONN];
+
     // epoll实例，监听文件描述符
     struct epoll_event events[MAX_EVENT];// 文件描述符数组
+    httpConnect* batch[MAX_EVENT];       // 本轮交给线程池的连接，事件处理完后一起入队
+    int batchCnt = 0;
     int epollfd = epoll_create(1);
 
-    // 将监听的文件描述符添加到epoll
-    struct epoll_event event;
-    setNonblock(listenfd);
-    event.data.fd = listenfd;
-    event.events =  EPOLLIN | EPOLLRDHUP;//EPOLLRDHUP事件判断client断开连接
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &event);
     httpConnect::m_epollfd = epollfd;
+    // 升级：从旧进程接管监听socket，旧进程在本进程就绪前继续accept
+    if(controlPath && handoff::receive(controlPath, listeners, manifest)){
+        printf("handoff: took over listeners from %s, %d cached files\n", controlPath, (int)manifest.size());
+    }
+    // 协程调度器：定时器和跨线程恢复；磁盘I/O线程：冷文件预读和协程文件读取；目录列表的inotify监视；反向代理的专用线程
+    try{
+        coScheduler::init(epollfd);
+        diskIO::init();
+        dirIndex::init(epollfd, autoindex);
+        rateLimit::init();
+        writeScheduler::init(paceRate, totalRate);
+        if(upstream::groupCount() > 0){
+            upstream::init();
+        }
+        tracer::init(traceSample);
+        bufferPool::init(READ_BUFFER_SIZE + WRITE_BUFFER_SIZE);
+    }catch(...){
+        exit(-1);
+    }
+    // 旧进程的热点文件预热后再accept
+    int warmed = 0;
+    for(size_t i = 0; i < manifest.size(); i++){
+        warmed += httpConnect::prefetch(manifest[i].c_str());
+    }
+    if(!manifest.empty()){
+        printf("handoff: prefetched %d files\n", warmed);
+    }
+
+    // 套接字通信，每个监听地址1个socket
+    for(size_t i = 0; i < listeners.size(); i++){
+        addListen(epollfd, listeners[i]);
+    }
+    // 通知旧进程排空，然后等待下一次升级；多进程模式由主进程在全部工作进程就绪后通知
+    handoff::ready();
+    supervisor::ready();
+    if(controlPath && !handoff::listen(controlPath, epollfd)){
+        printf("Failed to listen on control socket %s.\n", controlPath);
+        exit(-1);
+    }
+    long long drainDeadline = 0;
+    long long lastSweep = 0;
 
     while(1){
-        int num = epoll_wait(epollfd, events, MAX_EVENT, -1);
+        int timeout = writeScheduler::nextTimeout(coScheduler::nextTimeout());
+        if(drainDeadline && (timeout < 0 || timeout > DRAIN_CHECK_INTERVAL)){
+            timeout = DRAIN_CHECK_INTERVAL;
+        }
+        int num = epoll_wait(epollfd, events, MAX_EVENT, timeout);
         if(num < 0 && errno != EINTR){
             perror("epoll_wait");
             break;
         }
+        tracer::wake();
 
         // 处理事件
         for(int i = 0; i < num; i++){
             int sockfd = events[i].data.fd;
-            if(sockfd == listenfd){ // 新连接
-                struct sockaddr_in clientAddr;
+            listener* l = findListen(listeners, sockfd);
+            if(l){ // 新连接
+                struct sockaddr_storage clientAddr;
                 socklen_t len = sizeof(clientAddr);
-                int connectfd = accept(listenfd, (sockaddr*) &clientAddr, &len);
+                int connectfd = accept(sockfd, (sockaddr*) &clientAddr, &len);
                 if(connectfd == -1){
                     continue;
                 }
@@ -113,30 +373,127 @@ int main(int argc, char* argv[]){// argc: 参数个数 argv[]: 存储各个参
                     close(connectfd);
                     continue;
                 }
-                // 客户数据初始化
-                clients[connectfd].init(connectfd, clientAddr);
+                if(!rateLimit::connect(clientAddr)){
+                    // 该IP的并发连接数达到上限，明文连接尽力发送429
+                    if(!l->tls){
+                        send(connectfd, rateLimit::response(), rateLimit::responseLen(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                    }
+                    close(connectfd);
+                    continue;
+                }
+                // 客户数据初始化，HTTPS连接无法创建SSL时直接关闭
+                if(!clients[connectfd].init(connectfd, clientAddr, l->tls)){
+                    rateLimit::disconnect(clientAddr);
+                    close(connectfd);
+                }
+            }else if(sockfd == coScheduler::m_eventfd){
+                // I/O线程完成或新增定时器，恢复就绪的协程
+                coScheduler::runReady();
+            }else if(sockfd == dirIndex::m_inotifyfd){
+                // 已缓存的目录有变化，增量更新目录列表
+                dirIndex::onNotify();
+            }else if(sockfd == handoff::m_controlfd || sockfd == handoff::m_peerfd){
+                // 新进程请求接管，或已接管完毕
+                if(handoff::onEvent(sockfd, listeners)){
+                    stopRequested = 1;
+                }
+            }else if(!clients[sockfd].isActive()){
+                // 已关闭连接的残留事件
+                continue;
             }else if(events[i].events & (EPOLLERR | EPOLLRDHUP | EPOLLHUP)){
                 // 客户端异常或断开连接
                 clients[sockfd].closeConnect();
+            }else if(!clients[sockfd].handshakeDone()){
+                // TLS握手在工作线程中进行
+                if(clients[sockfd].acquire()){
+                    batch[batchCnt++] = &clients[sockfd];
+                }
+            }else if(clients[sockfd].isHttp2() || clients[sockfd].isStreaming()){
+                // HTTP/2多路复用和流式响应，读写都交给线程池
+                if(clients[sockfd].acquire()){
+                    batch[batchCnt++] = &clients[sockfd];
+                }
+            }else if(clients[sockfd].isWaiting()){
+                // 协程等待的socket事件就绪
+                clients[sockfd].resumeWaiting(true);
             }else if(events[i].events & EPOLLIN){ // 读事件就绪
                 if(clients[sockfd].read()){
-                    // 1次读完数据
-                    pool->append(&clients[sockfd]);
+                    // 1次读完数据，reactor内解析，缓存命中直接发送，否则交给线程池
+                    if(!clients[sockfd].tryFastPath() && clients[sockfd].acquire()){
+                        batch[batchCnt++] = &clients[sockfd];
+                    }
                 }else{ // 读失败
                     clients[sockfd].closeConnect();
                 }
             }else if(events[i].events & EPOLLOUT){ //写事件就绪
-                if(!clients[sockfd].write()){ 
-                    // 写数据失败
-                    clients[sockfd].closeConnect();
+                if(clients[sockfd].pipelined()){
+                    // 上一个响应已发送完，解析读缓冲中流水线发送的请求
+                    if(!clients[sockfd].tryFastPath() && clients[sockfd].acquire()){
+                        batch[batchCnt++] = &clients[sockfd];
+                    }
+                    continue;
                 }
+                // 由写调度器在本轮事件处理后轮转发送
+                writeScheduler::add(&clients[sockfd]);
             }
         }
+        // 本轮就绪的连接1次入队，请求队列已满时关闭未入队的连接
+        if(batchCnt > 0){
+            int queued = pool->append(batch, batchCnt);
+            for(int j = queued; j < batchCnt; j++){
+                batch[j]->closeConnect();
+            }
+            batchCnt = 0;
+        }
+        // 可写的连接各发送1个配额
+        writeScheduler::run();
+        supervisor::publish(httpConnect::userCnt);
+        if(tracer::dumpRequested()){
+            tracer::dump();
+        }
+        // 恢复定时器到期的协程
+        coScheduler::runTimers();
+
+        // 排空：停止accept，此后的响应都关闭连接，空闲的keep-alive连接直接关闭，进行中的请求完成或超时后退出
+        if(stopRequested && !drainDeadline){
+            for(size_t i = 0; i < listeners.size(); i++){
+                if(listeners[i].fd != -1){
+                    removefd(epollfd, listeners[i].fd);
+                    listeners[i].fd = -1;
+                }
+            }
+            handoff::close();
+            httpConnect::m_draining = true;
+            drainDeadline = fileCache::now() + DRAIN_TIMEOUT;
+            printf("draining %d connections\n", (int)httpConnect::userCnt);
+        }
+        if(drainDeadline && fileCache::now() - lastSweep >= DRAIN_CHECK_INTERVAL){
+            lastSweep = fileCache::now();
+            for(int fd = 0; fd < MAX_CONN; fd++){
+                if(clients[fd].isActive() && clients[fd].idle()){
+                    clients[fd].closeConnect();
+                }
+            }
+            if(httpConnect::userCnt == 0 || lastSweep >= drainDeadline){
+                break;
+            }
+        }
+    }
+    // 超时仍未完成的连接直接断开，工作线程中阻塞的读写随之返回
+    for(int fd = 0; fd < MAX_CONN; fd++){
+        if(clients[fd].socketfd() != -1){
+            shutdown(fd, SHUT_RDWR);
+        }
     }
+    printf("exit with %d connections\n", (int)httpConnect::userCnt);
     close(epollfd);
-    close(listenfd);
+    for(size_t i = 0; i < listeners.size(); i++){
+        if(listeners[i].fd != -1){
+            close(listeners[i].fd);
+        }
+    }
+    // 等待工作线程处理完队列中的任务；磁盘I/O线程可能仍持有连接，连接数组随进程退出释放
     delete pool;
-    delete [] clients;
 
     return 0;
 }
\ No newline at end of file
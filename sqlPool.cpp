@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include "sqlPool.h"
+
+sqlPool::sqlPool() : maxConn(0), freeConn(NULL){
+}
+
+sqlPool::~sqlPool(){
+    destroy();
+}
+
+sqlPool* sqlPool::getInstance(){
+    static sqlPool pool;
+    return &pool;
+}
+
+// 打开connNum个句柄，WAL模式下读写互不阻塞
+bool sqlPool::init(const char* dbFile, int connNum){
+    for(int i = 0; i < connNum; i++){
+        sqlite3* conn = NULL;
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+        if(sqlite3_open_v2(dbFile, &conn, flags, NULL) != SQLITE_OK){
+            printf("sqlite3_open %s: %s\n", dbFile, conn ? sqlite3_errmsg(conn) : "out of memory");
+            sqlite3_close(conn);
+            destroy();
+            return false;
+        }
+        sqlite3_busy_timeout(conn, 1000);
+        sqlite3_exec(conn, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+        connList.push_back(conn);
+    }
+    maxConn = connNum;
+    freeConn = new semaphore(connNum);
+    return true;
+}
+
+sqlite3* sqlPool::getConnection(){
+    if(!freeConn){
+        return NULL;
+    }
+    freeConn->wait();
+    poolLock.lock();
+    sqlite3* conn = connList.front();
+    connList.pop_front();
+    poolLock.unlock();
+    return conn;
+}
+
+bool sqlPool::releaseConnection(sqlite3* conn){
+    if(!conn){
+        return false;
+    }
+    poolLock.lock();
+    connList.push_back(conn);
+    poolLock.unlock();
+    freeConn->signal();
+    return true;
+}
+
+void sqlPool::destroy(){
+    poolLock.lock();
+    for(std::list<sqlite3*>::iterator it = connList.begin(); it != connList.end(); ++it){
+        sqlite3_close(*it);
+    }
+    connList.clear();
+    maxConn = 0;
+    poolLock.unlock();
+}
+
+sqlConnRAII::sqlConnRAII(sqlite3** conn, sqlPool* pool){
+    *conn = pool->getConnection();
+    connRAII = *conn;
+    poolRAII = pool;
+}
+
+sqlConnRAII::~sqlConnRAII(){
+    poolRAII->releaseConnection(connRAII);
+}
@@ -0,0 +1,44 @@
+// 数据库连接池：固定数量的sqlite3句柄，由工作线程共享
+#ifndef SQLPOOL_H
+#define SQLPOOL_H
+#include <list>
+#include <sqlite3.h>
+#include "locker.h"
+
+class sqlPool{
+    public:
+        // 单例
+        static sqlPool* getInstance();
+
+        bool init(const char* dbFile, int connNum);
+
+        // 获取空闲句柄，无空闲时阻塞
+        sqlite3* getConnection();
+
+        bool releaseConnection(sqlite3* conn);
+
+        void destroy();
+
+    private:
+        sqlPool();
+        ~sqlPool();
+
+    private:
+        int maxConn;                            // 句柄数量
+        std::list<sqlite3*> connList;           // 空闲句柄
+        locker poolLock;                        // 互斥访问connList
+        semaphore* freeConn;                    // 记录空闲句柄数量
+};
+
+// RAII：作用域结束时归还句柄
+class sqlConnRAII{
+    public:
+        sqlConnRAII(sqlite3** conn, sqlPool* pool);
+        ~sqlConnRAII();
+
+    private:
+        sqlite3* connRAII;
+        sqlPool* poolRAII;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <openssl/err.h>
+#include "sslContext.h"
+
+SSL_CTX* sslContext::m_ctx = NULL;
+
+// ALPN：客户端支持时优先选择h2，否则http/1.1
+static int alpnSelect(SSL*, const unsigned char** out, unsigned char* outlen,
+    const unsigned char* in, unsigned int inlen, void*){
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    if(SSL_select_next_proto((unsigned char**)out, outlen, protos, sizeof(protos) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED){
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+bool sslContext::init(const char* certFile, const char* keyFile, bool ktls){
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if(!ctx){
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if(SSL_CTX_use_certificate_chain_file(ctx, certFile) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1){
+        ERR_print_errors_fp(stdout);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // 会话复用：服务端会话缓存 + session ticket，减少完整握手
+    static const unsigned char sidCtx[] = "webserver";
+    SSL_CTX_set_session_id_context(ctx, sidCtx, sizeof(sidCtx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SSL_SESSION_CACHE_SIZE);
+
+    // 非阻塞socket：允许部分写入，重试时缓冲区地址可以变化
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    if(ktls){
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+    SSL_CTX_set_alpn_select_cb(ctx, alpnSelect, NULL);
+    m_ctx = ctx;
+    return true;
+}
+
+SSL* sslContext::newSSL(int fd){
+    SSL* ssl = SSL_new(m_ctx);
+    if(!ssl){
+        return NULL;
+    }
+    if(!SSL_set_fd(ssl, fd)){
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+bool sslContext::ktlsSend(SSL* ssl){
+    return BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
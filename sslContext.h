@@ -0,0 +1,26 @@
+// TLS：OpenSSL完成握手，ALPN协商h2或http/1.1，握手后优先启用内核TLS(kTLS)加密，发送路径仍为writev零拷贝
+#ifndef SSLCONTEXT_H
+#define SSLCONTEXT_H
+#include <openssl/ssl.h>
+
+#define SSL_SESSION_CACHE_SIZE 20480            // 服务端会话缓存条目数
+
+class sslContext{
+    public:
+        // 加载证书和私钥，ktls为false时全部在用户态加密，用于对比测试
+        static bool init(const char* certFile, const char* keyFile, bool ktls = true);
+
+        static bool enabled(){ return m_ctx != NULL; }
+
+        // 为新连接创建SSL对象，服务端模式
+        static SSL* newSSL(int fd);
+
+        // 握手完成后判断是否由内核加密发送
+        static bool ktlsSend(SSL* ssl);
+
+    private:
+        // 所有连接共用1个SSL_CTX，会话缓存和ticket密钥在线程间共享，会话可复用
+        static SSL_CTX* m_ctx;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include "supervisor.h"
+#include "handoff.h"
+#include "fileCache.h"
+
+workerSlot* supervisor::m_slots = NULL;
+workerSlot* supervisor::m_slot = NULL;
+int supervisor::m_worker = -1;
+
+// 主进程的信号处理，fork后在工作进程中恢复为启动时的设置
+static const int masterSignals[] = {SIGTERM, SIGINT, SIGUSR1, SIGUSR2, SIGCHLD};
+#define MASTER_SIGNALS (int)(sizeof(masterSignals) / sizeof(masterSignals[0]))
+static struct sigaction savedActions[MASTER_SIGNALS];
+static volatile sig_atomic_t stopRequested = 0;
+static volatile sig_atomic_t reportRequested = 0;
+static volatile sig_atomic_t dumpRequested = 0;
+static pid_t masterPid = 0;
+static int masterEpoll = -1;
+
+static void onSignal(int sig){
+    if(sig == SIGTERM || sig == SIGINT){
+        stopRequested = 1;
+    }else if(sig == SIGUSR1){
+        reportRequested = 1;
+    }else if(sig == SIGUSR2){
+        dumpRequested = 1;
+    }
+    // SIGCHLD只用于打断epoll_wait
+}
+
+pid_t supervisor::spawn(int id){
+    workerSlot& s = m_slots[id];
+    s.ready.store(false);
+    s.connections.store(0);
+    s.requests.store(0);
+    s.startTime = fileCache::now();
+    // 缓冲中未输出的内容不复制到子进程
+    fflush(stdout);
+    // fork前后屏蔽信号，子进程恢复信号处理之前不会执行主进程的处理函数
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    pid_t pid = fork();
+    if(pid == 0){
+        for(int i = 0; i < MASTER_SIGNALS; i++){
+            sigaction(masterSignals[i], &savedActions[i], NULL);
+        }
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        // 主进程退出时工作进程随之排空退出
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if(getppid() != masterPid){
+            exit(0);
+        }
+        // 控制socket和升级连接只由主进程使用
+        if(masterEpoll != -1){
+            close(masterEpoll);
+        }
+        handoff::detach();
+        m_slot = &s;
+        m_worker = id;
+        s.pid.store(getpid());
+        return 0;
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    if(pid < 0){
+        perror("fork");
+        return -1;
+    }
+    s.pid.store(pid);
+    return pid;
+}
+
+// 升级时等待全部工作进程开始accept，再通知旧进程排空
+bool supervisor::waitReady(int n){
+    long long deadline = fileCache::now() + SUPERVISOR_READY_TIMEOUT;
+    while(fileCache::now() < deadline){
+        int ready = 0;
+        for(int i = 0; i < n; i++){
+            if(m_slots[i].pid.load() > 0 && m_slots[i].ready.load(std::memory_order_acquire)){
+                ready++;
+            }
+        }
+        if(ready == n){
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+void supervisor::report(int n){
+    int connections = 0;
+    long long requests = 0;
+    for(int i = 0; i < n; i++){
+        workerSlot& s = m_slots[i];
+        printf("worker %d: pid %d, %d connections, %lld requests, %d restarts\n", i, (int)s.pid.load(),
+            s.connections.load(), s.requests.load(), s.restarts.load());
+        connections += s.connections.load();
+        requests += s.requests.load();
+    }
+    printf("total: %d connections, %lld requests\n", connections, requests);
+    fflush(stdout);
+}
+
+int supervisor::run(int n, std::vector<listener>& listeners, const char* controlPath){
+    void* mem = mmap(NULL, sizeof(workerSlot) * n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED){
+        perror("mmap");
+        exit(-1);
+    }
+    m_slots = (workerSlot*)mem;
+    for(int i = 0; i < n; i++){
+        new(&m_slots[i]) workerSlot();
+        m_slots[i].pid.store(0);
+        m_slots[i].restarts.store(0);
+    }
+    masterPid = getpid();
+    for(int i = 0; i < MASTER_SIGNALS; i++){
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSignal;
+        sigfillset(&sa.sa_mask);
+        sigaction(masterSignals[i], &sa, &savedActions[i]);
+    }
+
+    std::vector<long long> restartAt(n, 0);     // 待重启的时间，0表示正在运行
+    int alive = 0;
+    for(int i = 0; i < n; i++){
+        pid_t pid = spawn(i);
+        if(pid == 0){
+            return m_worker;
+        }
+        if(pid < 0){
+            restartAt[i] = fileCache::now() + SUPERVISOR_RESTART_DELAY;
+        }else{
+            alive++;
+        }
+    }
+    printf("supervisor: %d workers\n", alive);
+    if(controlPath){
+        if(!waitReady(n)){
+            printf("supervisor: not all workers ready, handing over anyway\n");
+        }
+        handoff::ready();
+    }
+    masterEpoll = epoll_create(1);
+    if(controlPath && !handoff::listen(controlPath, masterEpoll)){
+        printf("Failed to listen on control socket %s.\n", controlPath);
+        stopRequested = 1;
+    }
+
+    bool stopping = false;
+    while(alive > 0 || !stopping){
+        if(stopRequested && !stopping){
+            // 工作进程各自停止accept并排空；主进程的监听socket随之关闭，端口在工作进程全部退出后释放
+            stopping = true;
+            handoff::close();
+            for(int i = 0; i < n; i++){
+                pid_t pid = m_slots[i].pid.load();
+                if(pid > 0){
+                    kill(pid, SIGTERM);
+                }
+            }
+            for(size_t i = 0; i < listeners.size(); i++){
+                if(listeners[i].fd != -1){
+                    close(listeners[i].fd);
+                    listeners[i].fd = -1;
+                }
+            }
+            printf("supervisor: stopping %d workers\n", alive);
+        }
+        if(reportRequested){
+            reportRequested = 0;
+            report(n);
+        }
+        if(dumpRequested){
+            // 追踪记录在各工作进程中，各自导出
+            dumpRequested = 0;
+            for(int i = 0; i < n; i++){
+                pid_t pid = m_slots[i].pid.load();
+                if(pid > 0){
+                    kill(pid, SIGUSR2);
+                }
+            }
+        }
+        // 回收退出的工作进程，非停止期间安排重启
+        int status;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0){
+            int i = 0;
+            while(i < n && m_slots[i].pid.load() != pid){
+                i++;
+            }
+            if(i == n){
+                continue;
+            }
+            m_slots[i].pid.store(0);
+            alive--;
+            if(stopping){
+                continue;
+            }
+            if(WIFSIGNALED(status)){
+                printf("supervisor: worker %d (pid %d) killed by signal %d, restarting\n", i, (int)pid, WTERMSIG(status));
+            }else{
+                printf("supervisor: worker %d (pid %d) exited with status %d, restarting\n", i, (int)pid, WEXITSTATUS(status));
+            }
+            fflush(stdout);
+            long long now = fileCache::now();
+            restartAt[i] = now - m_slots[i].startTime < SUPERVISOR_RESTART_DELAY ? now + SUPERVISOR_RESTART_DELAY : now;
+        }
+        int timeout = 1000;
+        long long now = fileCache::now();
+        for(int i = 0; i < n && !stopping; i++){
+            if(!restartAt[i]){
+                continue;
+            }
+            if(now < restartAt[i]){
+                timeout = restartAt[i] - now < timeout ? restartAt[i] - now : timeout;
+                continue;
+            }
+            restartAt[i] = 0;
+            m_slots[i].restarts.fetch_add(1);
+            pid_t pid = spawn(i);
+            if(pid == 0){
+                return m_worker;
+            }
+            if(pid < 0){
+                restartAt[i] = now + SUPERVISOR_RESTART_DELAY;
+            }else{
+                alive++;
+            }
+        }
+        if(stopping && alive == 0){
+            break;
+        }
+        // 信号打断等待；升级连接的事件由handoff处理，新进程就绪后开始停止
+        struct epoll_event events[4];
+        int num = epoll_wait(masterEpoll, events, 4, timeout);
+        for(int i = 0; i < num; i++){
+            if(handoff::onEvent(events[i].data.fd, listeners)){
+                stopRequested = 1;
+            }
+        }
+    }
+    printf("supervisor: all workers exited\n");
+    close(masterEpoll);
+    return -1;
+}
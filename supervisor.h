@@ -0,0 +1,61 @@
+// 多进程模式：主进程打开监听socket后fork出N个工作进程，各自运行reactor和线程池，
+// 共享同一组监听socket(EPOLLEXCLUSIVE，每个新连接只唤醒1个进程)；主进程只负责监管：
+// 工作进程退出后重新fork，SIGTERM转发给全部工作进程并等待其排空，不停机升级的控制socket由主进程持有；
+// 各工作进程的连接数和请求数写在共享内存中，主进程收到SIGUSR1时汇总输出
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+#include <sys/types.h>
+#include <atomic>
+#include <vector>
+#include "listener.h"
+
+#define SUPERVISOR_MAX_WORKERS 64
+#define SUPERVISOR_RESTART_DELAY 1000           // 毫秒，启动后此时间内退出的工作进程延迟重启，避免反复fork
+#define SUPERVISOR_READY_TIMEOUT 5000           // 毫秒，升级时等待全部工作进程开始accept的最长时间
+
+// 每个工作进程1个，位于主进程fork前映射的共享内存中
+struct workerSlot{
+    std::atomic<pid_t> pid;
+    std::atomic<bool> ready;                    // 已开始accept
+    std::atomic<int> connections;               // 当前连接数，reactor每轮写入
+    std::atomic<long long> requests;            // 累计请求数，重启后清零
+    std::atomic<int> restarts;                  // 主进程写入
+    long long startTime;                        // 主进程写入
+};
+
+class supervisor{
+    public:
+        // 主进程调用：fork n个工作进程并监管，controlPath非NULL时在其上等待下一次升级；
+        // 在工作进程中返回其编号，主进程在全部工作进程退出后返回-1
+        static int run(int n, std::vector<listener>& listeners, const char* controlPath);
+
+        static bool enabled(){ return m_slot != NULL; }
+
+        // 工作进程调用，单进程模式下不做处理
+        static void ready(){
+            if(m_slot){
+                m_slot->ready.store(true, std::memory_order_release);
+            }
+        }
+        static void publish(int connections){
+            if(m_slot){
+                m_slot->connections.store(connections, std::memory_order_relaxed);
+            }
+        }
+        static void countRequest(){
+            if(m_slot){
+                m_slot->requests.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static pid_t spawn(int id);             // fork第id个工作进程，子进程中不返回到监管循环
+        static bool waitReady(int n);
+        static void report(int n);
+
+        static workerSlot* m_slots;
+        static workerSlot* m_slot;              // 本工作进程的槽位，主进程和单进程模式为NULL
+        static int m_worker;                    // spawn在子进程中设置的编号
+};
+
+#endif
@@ -0,0 +1,164 @@
+# 登录测试：/login的HTTP/1.1请求由协程处理函数在磁盘I/O线程中校验密码，HTTP/2的流使用同步处理函数。
+# 注册1个用户后校验正确和错误密码的结果页、同一连接上的后续请求和流水线请求、发送后立即关闭的连接、
+# 多个线程并发登录期间静态文件请求的延迟，以及HTTP/2(需要curl)的结果。
+# 用法: python3 login.py 端口 [资源目录] [线程数] [每线程登录次数]
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+port = int(sys.argv[1])
+root = sys.argv[2] if len(sys.argv) > 2 else '../resources'
+threads = int(sys.argv[3]) if len(sys.argv) > 3 else 16
+n = int(sys.argv[4]) if len(sys.argv) > 4 else 20
+
+user = 'co%d' % os.getpid()
+password = 'pw%d' % os.getpid()
+pages = {}
+for p in ('welcome.html', 'error.html', 'login.html'):
+    with open(os.path.join(root, p), 'rb') as f:
+        pages[p] = f.read()
+
+failures = []
+lock = threading.Lock()
+
+
+def fail(msg):
+    with lock:
+        failures.append(msg)
+    print('FAIL', msg)
+
+
+class reader:
+    def __init__(self, s):
+        self.s = s
+        self.buf = b''
+
+    def more(self):
+        x = self.s.recv(65536)
+        if not x:
+            raise EOFError()
+        self.buf += x
+
+    def response(self):
+        while b'\r\n\r\n' not in self.buf:
+            self.more()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        length = 0
+        for line in head.split(b'\r\n'):
+            if line.lower().startswith(b'content-length:'):
+                length = int(line.split(b':')[1])
+        while len(self.buf) < length:
+            self.more()
+        body, self.buf = self.buf[:length], self.buf[length:]
+        return int(head.split(b' ')[1]), body
+
+
+def connect():
+    s = socket.create_connection(('127.0.0.1', port))
+    s.settimeout(30)
+    return s
+
+
+def post(path, name, pw):
+    body = 'username=%s&password=%s' % (name, pw)
+    return ('POST %s HTTP/1.1\r\nHost: x\r\nContent-Type: application/x-www-form-urlencoded\r\n'
+            'Content-Length: %d\r\n\r\n%s' % (path, len(body), body)).encode()
+
+
+def get(path):
+    return ('GET %s HTTP/1.1\r\nHost: x\r\n\r\n' % path).encode()
+
+
+def expect(r, page, what):
+    code, body = r
+    if code != 200 or body != pages[page]:
+        fail('%s: status %d, %d bytes, expected %s' % (what, code, len(body), page))
+
+
+def basic():
+    s = connect()
+    r = reader(s)
+    s.sendall(post('/register', user, password))
+    expect(r.response(), 'login.html', 'register')
+    s.sendall(post('/login', user, password))
+    expect(r.response(), 'welcome.html', 'login')
+    # 同一连接上的后续请求
+    s.sendall(post('/login', user, 'wrong'))
+    expect(r.response(), 'error.html', 'wrong password')
+    s.sendall(get('/login'))
+    expect(r.response(), 'login.html', 'GET /login')
+    # 流水线：协程处理的请求之后的请求在读缓冲中等待
+    s.sendall(post('/login', user, password) + get('/login.html') + post('/login', 'nobody', 'x'))
+    expect(r.response(), 'welcome.html', 'pipelined login')
+    expect(r.response(), 'login.html', 'pipelined GET')
+    expect(r.response(), 'error.html', 'pipelined unknown user')
+    s.close()
+
+
+def abandoned():
+    # 校验期间客户端已关闭，协程恢复后发送失败并关闭连接
+    for i in range(50):
+        s = connect()
+        s.sendall(post('/login', user, password))
+        s.close()
+
+
+def worker(k):
+    try:
+        s = connect()
+        r = reader(s)
+        for i in range(n):
+            good = (i + k) % 2 == 0
+            s.sendall(post('/login', user, password if good else 'bad'))
+            expect(r.response(), 'welcome.html' if good else 'error.html', 'concurrent login')
+        s.close()
+    except Exception as e:
+        fail('concurrent login: %r' % e)
+
+
+def concurrent():
+    ws = [threading.Thread(target=worker, args=(k,)) for k in range(threads)]
+    for w in ws:
+        w.start()
+    # 登录占用磁盘I/O线程，工作线程仍能及时处理静态文件
+    worst = 0
+    while any(w.is_alive() for w in ws):
+        t = time.time()
+        s = connect()
+        s.sendall(get('/index.html'))
+        reader(s).response()
+        s.close()
+        worst = max(worst, time.time() - t)
+        time.sleep(0.05)
+    for w in ws:
+        w.join()
+    if worst > 0.5:
+        fail('static request took %.2fs during logins' % worst)
+    print('concurrent: %d logins, slowest static request %.1fms' % (threads * n, worst * 1000))
+
+
+def h2():
+    if not shutil.which('curl'):
+        print('h2: curl not found, skipped')
+        return
+    out = subprocess.run(['curl', '-s', '--http2-prior-knowledge', '-d', 'username=%s&password=%s' % (user, password),
+                          'http://127.0.0.1:%d/login' % port], capture_output=True).stdout
+    if out != pages['welcome.html']:
+        fail('h2 login: %d bytes' % len(out))
+
+
+basic()
+abandoned()
+concurrent()
+h2()
+# 服务器仍然正常
+s = connect()
+s.sendall(post('/login', user, password))
+expect(reader(s).response(), 'welcome.html', 'after test')
+s.close()
+print('login: %d failure(s)' % len(failures))
+sys.exit(1 if failures else 0)
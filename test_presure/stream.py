@@ -0,0 +1,201 @@
+# 流式响应测试：在资源目录下建立条目超过DIR_INDEX_MAX_ENTRIES的目录，服务器(带-a)流式生成其列表。
+# 校验chunked的分块格式、JSON内容完整、HTTP/1.0以关闭连接结束响应、之后的keep-alive请求；
+# 多个连接读完响应头后暂停读取，socket写满后服务器等待写事件，此时其他请求仍能及时处理(不占用工作线程)。
+# 用法: python3 stream.py 端口 [资源目录] [文件数]
+import json
+import os
+import shutil
+import socket
+import sys
+import threading
+import time
+
+port = int(sys.argv[1])
+root = sys.argv[2] if len(sys.argv) > 2 else '../resources'
+count = int(sys.argv[3]) if len(sys.argv) > 3 else 12000
+stalled = 16                    # 超过工作线程数(8)
+
+failures = []
+
+
+def fail(msg):
+    failures.append(msg)
+    print('FAIL', msg)
+
+
+def connect(rcvbuf=0):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if rcvbuf:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    s.settimeout(30)
+    s.connect(('127.0.0.1', port))
+    return s
+
+
+class reader:
+    def __init__(self, s):
+        self.s = s
+        self.buf = b''
+
+    def more(self):
+        x = self.s.recv(65536)
+        if not x:
+            raise EOFError()
+        self.buf += x
+
+    def until(self, sep):
+        while sep not in self.buf:
+            self.more()
+        head, self.buf = self.buf.split(sep, 1)
+        return head
+
+    def take(self, n):
+        while len(self.buf) < n:
+            self.more()
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def head(self):
+        lines = self.until(b'\r\n\r\n').split(b'\r\n')
+        fields = {}
+        for line in lines[1:]:
+            k, v = line.split(b':', 1)
+            fields[k.strip().lower()] = v.strip()
+        return int(lines[0].split(b' ')[1]), fields
+
+    def chunked(self):
+        # 每块为"十六进制长度\r\n数据\r\n"，长度为0的块和空行结束
+        body = b''
+        chunks = 0
+        while True:
+            size = self.until(b'\r\n')
+            n = int(size, 16)
+            if size != (b'%x' % n):
+                raise ValueError('bad chunk size line %r' % size)
+            if n == 0:
+                if self.take(2) != b'\r\n':
+                    raise ValueError('bad last chunk')
+                return body, chunks
+            body += self.take(n)
+            if self.take(2) != b'\r\n':
+                raise ValueError('chunk not followed by CRLF')
+            chunks += 1
+
+
+def request(path, version='HTTP/1.1', extra=''):
+    return ('GET %s %s\r\nHost: x\r\n%s\r\n' % (path, version, extra)).encode()
+
+
+def checkListing(body, what):
+    try:
+        items = json.loads(body)
+    except ValueError as e:
+        fail('%s: invalid JSON: %s' % (what, e))
+        return
+    names = set(i['name'] for i in items if i['type'] == 'file')
+    if names != expect:
+        fail('%s: %d names, expected %d' % (what, len(names), len(expect)))
+
+
+def chunkedListing():
+    s = connect()
+    r = reader(s)
+    s.sendall(request('/stream-test/?format=json'))
+    code, fields = r.head()
+    if code != 200 or fields.get(b'transfer-encoding') != b'chunked' or b'content-length' in fields:
+        fail('HTTP/1.1: status %d, fields %r' % (code, fields))
+        return
+    body, chunks = r.chunked()
+    if chunks < 2:
+        fail('HTTP/1.1: listing sent in %d chunk(s)' % chunks)
+    checkListing(body, 'HTTP/1.1')
+    # 同一连接上的下一个请求
+    s.sendall(request('/stream-test/?format=json'))
+    code, fields = r.head()
+    if code != 200:
+        fail('keep-alive: status %d' % code)
+        return
+    body, chunks = r.chunked()
+    checkListing(body, 'keep-alive')
+    s.close()
+
+
+def http10Listing():
+    s = connect()
+    r = reader(s)
+    s.sendall(request('/stream-test/?format=json', 'HTTP/1.0', 'Connection: keep-alive\r\n'))
+    code, fields = r.head()
+    if code != 200 or b'transfer-encoding' in fields:
+        fail('HTTP/1.0: status %d, fields %r' % (code, fields))
+        return
+    try:
+        while True:
+            r.more()
+    except EOFError:
+        pass
+    checkListing(r.buf, 'HTTP/1.0')
+    s.close()
+
+
+def backPressure():
+    # 读完响应头后暂停，服务器的发送缓冲写满
+    socks = []
+    for i in range(stalled):
+        s = connect(4096)
+        s.sendall(request('/stream-test/?format=json'))
+        socks.append(s)
+    readers = [reader(s) for s in socks]
+    for r in readers:
+        if r.head()[0] != 200:
+            fail('back-pressure: bad status')
+            return
+    time.sleep(1)
+    t = time.time()
+    s = connect()
+    r = reader(s)
+    s.sendall(request('/index.html'))
+    code, fields = r.head()
+    r.take(int(fields.get(b'content-length', b'0')))
+    s.close()
+    if code != 200 or time.time() - t > 1:
+        fail('request during back-pressure: status %d after %.2fs' % (code, time.time() - t))
+    # 恢复读取，服务器由写事件继续发送，各连接的列表仍应完整
+    results = []
+
+    def slow(r):
+        try:
+            body, chunks = r.chunked()
+            results.append(body)
+        except Exception as e:
+            fail('back-pressure: %r' % e)
+
+    workers = [threading.Thread(target=slow, args=(r,)) for r in readers]
+    for w in workers:
+        w.start()
+    for w in workers:
+        w.join()
+    for body in results:
+        checkListing(body, 'back-pressure')
+    for s in socks:
+        s.close()
+
+
+dir = os.path.join(root, 'stream-test')
+shutil.rmtree(dir, ignore_errors=True)
+os.mkdir(dir)
+os.chmod(dir, 0o755)
+expect = set()
+for i in range(count):
+    name = 'file-%05d.txt' % i
+    with open(os.path.join(dir, name), 'w') as f:
+        f.write('x' * (i % 100))
+    os.chmod(os.path.join(dir, name), 0o644)
+    expect.add(name)
+try:
+    chunkedListing()
+    http10Listing()
+    backPressure()
+finally:
+    shutil.rmtree(dir, ignore_errors=True)
+print('stream: %d failure(s)' % len(failures))
+sys.exit(1 if failures else 0)
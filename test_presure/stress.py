@@ -0,0 +1,120 @@
+# 连接生命周期压力测试：多个线程随机地建立后立即关闭、发送半个请求后关闭、响应中途断开、
+# keep-alive逐个请求、流水线一次发送多个请求，校验每个完整响应的状态码和长度。
+# 与ThreadSanitizer构建的服务器一起使用，覆盖reactor与工作线程交接连接的各个时机。
+# 用法: python3 stress.py 端口 [每线程连接数] [线程数] [资源目录]
+import random
+import socket
+import sys
+import threading
+import time
+
+port = int(sys.argv[1])
+n = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+threads = int(sys.argv[3]) if len(sys.argv) > 3 else 8
+root = sys.argv[4] if len(sys.argv) > 4 else '../resources'
+
+paths = ['/index.html', '/images/dog.jpg', '/login.html', '/nope', '/images/favicon.ico']
+expect = {}                     # 文件长度，不存在的文件期望404
+for p in paths:
+    try:
+        with open(root + p, 'rb') as f:
+            expect[p] = len(f.read())
+    except OSError:
+        expect[p] = None
+
+stats = {'ok': 0, 'bad': 0, 'err': 0}
+lock = threading.Lock()
+
+
+class reader:
+    # 按Content-Length逐个切分响应，流水线的多个响应可能在同一次recv中到达
+    def __init__(self, s):
+        self.s = s
+        self.buf = b''
+
+    def more(self):
+        x = self.s.recv(65536)
+        if not x:
+            raise EOFError()
+        self.buf += x
+
+    def response(self):
+        while b'\r\n\r\n' not in self.buf:
+            self.more()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        length = 0
+        for line in head.split(b'\r\n'):
+            if line.lower().startswith(b'content-length:'):
+                length = int(line.split(b':')[1])
+        while len(self.buf) < length:
+            self.more()
+        body, self.buf = self.buf[:length], self.buf[length:]
+        return head.split(b' ')[1], body
+
+
+def request(p):
+    return ('GET %s HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n' % p).encode()
+
+
+def check(p, r):
+    code, body = r
+    if expect[p] is None:
+        good = code == b'404'
+    else:
+        good = code == b'200' and len(body) == expect[p]
+    with lock:
+        stats['ok' if good else 'bad'] += 1
+
+
+def worker(k):
+    rnd = random.Random(k)
+    for i in range(n):
+        try:
+            s = socket.create_connection(('127.0.0.1', port))
+            s.settimeout(5)
+            mode = rnd.random()
+            if mode < 0.15:
+                # 建立后立即关闭
+                s.close()
+                continue
+            if mode < 0.25:
+                # 请求不完整
+                s.sendall(b'GET /index.html HTTP/1.1\r\nHost: x\r\n')
+                s.close()
+                continue
+            if mode < 0.35:
+                # 响应发送中途断开
+                s.sendall(request('/images/dog.jpg'))
+                s.recv(100)
+                s.close()
+                continue
+            r = reader(s)
+            reqs = [rnd.choice(paths) for j in range(rnd.randint(1, 4))]
+            if mode < 0.65:
+                # 流水线：全部请求一次发送，有时拆在两次发送之间
+                data = b''.join(request(p) for p in reqs)
+                cut = rnd.randint(1, len(data)) if rnd.random() < 0.3 else len(data)
+                s.sendall(data[:cut])
+                if cut < len(data):
+                    time.sleep(0.001)
+                    s.sendall(data[cut:])
+                for p in reqs:
+                    check(p, r.response())
+            else:
+                for p in reqs:
+                    s.sendall(request(p))
+                    check(p, r.response())
+            s.close()
+        except (OSError, EOFError):
+            with lock:
+                stats['err'] += 1
+
+
+ts = [threading.Thread(target=worker, args=(k,)) for k in range(threads)]
+t0 = time.time()
+for t in ts:
+    t.start()
+for t in ts:
+    t.join()
+print(stats, '%.1fs' % (time.time() - t0))
+sys.exit(0 if stats['bad'] == 0 and stats['err'] == 0 else 1)
@@ -31,11 +31,12 @@ int failed=0;
 int bytes=0;
 /* globals */
 int http10=1; /* 0 - http/0.9, 1 - http/1.0, 2 - http/1.1 */
-/* Allow: GET, HEAD, OPTIONS, TRACE */
+/* Allow: GET, HEAD, OPTIONS, TRACE, POST */
 #define METHOD_GET 0
 #define METHOD_HEAD 1
 #define METHOD_OPTIONS 2
 #define METHOD_TRACE 3
+#define METHOD_POST 4
 #define PROGRAM_VERSION "1.5"
 int method=METHOD_GET;
 int clients=1;
@@ -43,6 +44,7 @@ int force=0;
 int force_reload=0;
 int proxyport=80;
 char *proxyhost=NULL;
+char *postdata=NULL;
 int benchtime=30;
 /* internal */
 int mypipe[2];
@@ -66,6 +68,7 @@ static const struct option long_options[]=
  {"version",no_argument,NULL,'V'},
  {"proxy",required_argument,NULL,'p'},
  {"clients",required_argument,NULL,'c'},
+ {"post",required_argument,NULL,'P'},
  {NULL,0,NULL,0}
 };
 
@@ -95,6 +98,7 @@ static void usage(void)
 	"  --head                   Use HEAD request method.\n"
 	"  --options                Use OPTIONS request method.\n"
 	"  --trace                  Use TRACE request method.\n"
+	"  -P|--post <data>         Use POST request method with form <data>.\n"
 	"  -?|-h|--help             This information.\n"
 	"  -V|--version             Display program version.\n"
 	);
@@ -111,7 +115,7 @@ int main(int argc, char *argv[])
           return 2;
  } 
 
- while((opt=getopt_long(argc,argv,"912Vfrt:p:c:?h",long_options,&options_index))!=EOF )
+ while((opt=getopt_long(argc,argv,"912Vfrt:p:c:P:?h",long_options,&options_index))!=EOF )
  {
   switch(opt)
   {
@@ -147,6 +151,7 @@ int main(int argc, char *argv[])
    case 'h':
    case '?': usage();return 2;break;
    case 'c': clients=atoi(optarg);break;
+   case 'P': method=METHOD_POST;postdata=optarg;break;
   }
  }
  
@@ -176,6 +181,8 @@ int main(int argc, char *argv[])
 		 printf("HEAD");break;
 	 case METHOD_TRACE:
 		 printf("TRACE");break;
+	 case METHOD_POST:
+		 printf("POST");break;
  }
  printf(" %s",argv[optind]);
  switch(http10)
@@ -208,6 +215,7 @@ void build_request(const char *url)
   if(method==METHOD_HEAD && http10<1) http10=1;
   if(method==METHOD_OPTIONS && http10<2) http10=2;
   if(method==METHOD_TRACE && http10<2) http10=2;
+  if(method==METHOD_POST && http10<1) http10=1;
 
   switch(method)
   {
@@ -216,6 +224,7 @@ void build_request(const char *url)
 	  case METHOD_HEAD: strcpy(request,"HEAD");break;
 	  case METHOD_OPTIONS: strcpy(request,"OPTIONS");break;
 	  case METHOD_TRACE: strcpy(request,"TRACE");break;
+	  case METHOD_POST: strcpy(request,"POST");break;
   }
 		  
   strcat(request," ");
@@ -285,8 +294,19 @@ void build_request(const char *url)
   }
   if(http10>1)
 	  strcat(request,"Connection: close\r\n");
+  if(method==METHOD_POST)
+  {
+	  if(strlen(postdata)>REQUEST_SIZE-strlen(request)-100)
+	  {
+		  fprintf(stderr,"POST data is too long.\n");
+		  exit(2);
+	  }
+	  sprintf(request+strlen(request),"Content-Type: application/x-www-form-urlencoded\r\n"
+		  "Content-Length: %d\r\n",(int)strlen(postdata));
+  }
   /* add empty line at end */
   if(http10>0) strcat(request,"\r\n"); 
+  if(method==METHOD_POST) strcat(request,postdata);
   // printf("Req=%s\n",request);
 }
 
@@ -3,7 +3,7 @@
 #define THREADPOOL_H
 #include <pthread.h>
 #include "locker.h"
-#include <list>
+#include <vector>
 #include <cstdio>
 
 // T: 任务类型 本项目中为http连接
@@ -15,6 +15,10 @@ class threadPool{
         ~threadPool();
 
         bool append(T* request);
+
+        // reactor调用：1次epoll_wait就绪的连接一起入队，只加1次锁，按需唤醒空闲线程；
+        // 返回入队的个数，队列满时其余的未入队
+        int append(T** requests, int n);
     private:
         /*工作线程运行的函数，从工作队列中取出任务并执行。
         线程的工作函数需定义为静态成员函数，无this指针*/
@@ -28,62 +32,81 @@ class threadPool{
         int maxRequest;
         // 线程池数组
         pthread_t* myThreads;
-        // 请求队列
-        std::list<T*> workQueue;
+        // 请求队列：长度为maxRequest的环形缓冲，入队不分配内存
+        std::vector<T*> workQueue;
+        int queueHead;
+        int queueCnt;
         // 互斥锁，互斥访问请求队列
         locker queueLock; 
-        // 信号量，记录请求队列任务数量
-        semaphore queueState;
+        // 条件变量，队列为空时线程在此等待
+        condition queueCond;
+        // 正在等待任务的线程数
+        int idleCnt;
         // 结束线程标志
         bool stop;
 };
 
 template <typename T>
 threadPool<T>::threadPool(int _threadNum, int _maxRequest) : 
-threadNum(_threadNum), maxRequest(_maxRequest), myThreads(NULL), stop(false)
+threadNum(_threadNum), maxRequest(_maxRequest), myThreads(NULL), queueHead(0), queueCnt(0), idleCnt(0), stop(false)
 {
         if(_threadNum <= 0 || _maxRequest <= 0){
             throw std::exception();
         }
+        workQueue.resize(maxRequest);
 
         myThreads = new pthread_t[threadNum];
         if(!myThreads){
             throw std::exception();
         }
 
-        //创建线程，设置线程脱离
+        //创建线程，析构时等待线程结束
         for(int i=0; i < threadNum; i++){
             printf("Create the %dth thread.\n", i);
             if(pthread_create(myThreads + i, NULL, worker, this) != 0){
                 delete [] myThreads;
                 throw std::exception();
             }
-
-            if(pthread_detach(myThreads[i]) != 0){
-                delete [] myThreads;
-                throw std::exception();
-            }
         }
 }
 
+// 队列中剩余的任务处理完后线程退出
 template<typename T>
 threadPool<T>::~threadPool(){
-    delete [] myThreads;
+    queueLock.lock();
     stop = true;
+    queueCond.broadcast();
+    queueLock.unlock();
+    for(int i = 0; i < threadNum; i++){
+        pthread_join(myThreads[i], NULL);
+    }
+    delete [] myThreads;
 }
 
 template<typename T>
 bool threadPool<T>::append(T* request){
+    return append(&request, 1) == 1;
+}
+
+template<typename T>
+int threadPool<T>::append(T** requests, int n){
     queueLock.lock();
-    if(workQueue.size() > maxRequest){
-        queueLock.unlock();
-        return false;
+    int cnt = n < maxRequest - queueCnt ? n : maxRequest - queueCnt;
+    for(int i = 0; i < cnt; i++){
+        workQueue[(queueHead + queueCnt) % maxRequest] = requests[i];
+        queueCnt++;
     }
-    workQueue.push_back(request);
+    // 只唤醒处理这批任务所需的空闲线程，正在运行的线程处理完当前任务后直接从队列取下一个
+    int wake = cnt < idleCnt ? cnt : idleCnt;
     queueLock.unlock();
-    //V操作
-    queueState.signal(); 
-    return true;
+    if(wake == threadNum){
+        queueCond.broadcast();
+    }else{
+        for(int i = 0; i < wake; i++){
+            queueCond.signal();
+        }
+    }
+    return cnt;
 }
 
 template<typename T>
@@ -95,17 +118,21 @@ void* threadPool<T>::worker(void* arg){
 
 template<typename T>
 void threadPool<T>::run(){
-    while(!stop){
-        queueState.wait();
+    while(true){
         queueLock.lock();
-        /*
-        if(workQueue.empty()){
+        // 队列为空时等待，被唤醒时队列可能已被其他线程取空
+        while(queueCnt == 0 && !stop){
+            idleCnt++;
+            queueCond.wait(queueLock.getlock());
+            idleCnt--;
+        }
+        if(queueCnt == 0){
             queueLock.unlock();
-            continue;
+            break;
         }
-        */
-        T* request =  workQueue.front();
-        workQueue.pop_front();
+        T* request = workQueue[queueHead];
+        queueHead = (queueHead + 1) % maxRequest;
+        queueCnt--;
         queueLock.unlock();
         if(!request){
             continue;
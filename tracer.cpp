@@ -0,0 +1,143 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tracer.h"
+
+int tracer::m_sampleEvery = 0;
+std::atomic<uint32_t> tracer::m_counter(0);
+uint64_t tracer::m_wakeTime = 0;
+volatile sig_atomic_t tracer::m_dumpRequested = 0;
+int tracer::m_dumpSeq = 0;
+locker tracer::ringLock;
+std::vector<tracer::ring*> tracer::rings;
+thread_local tracer::ring* tracer::m_ring = NULL;
+
+static const char* stageNames[] = {"request", "dispatch", "read", "parse", "queue", "handler", "disk", "write"};
+
+void tracer::init(int sampleEvery){
+    m_sampleEvery = sampleEvery > 0 ? sampleEvery : 0;
+}
+
+uint32_t tracer::sample(){
+    if(m_sampleEvery == 0){
+        return 0;
+    }
+    uint32_t n = m_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(n % m_sampleEvery != 0){
+        return 0;
+    }
+    // 追踪ID即请求序号，回绕到0时跳过
+    return n ? n : 1;
+}
+
+// 粗粒度时钟的分辨率为毫秒级，不足以区分各阶段；只有选中的请求取时间，开销可以忽略
+uint64_t tracer::now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+tracer::ring* tracer::localRing(){
+    if(!m_ring){
+        ring* r = new ring;
+        r->pos.store(0, std::memory_order_relaxed);
+        ringLock.lock();
+        r->thread = rings.size();
+        rings.push_back(r);
+        ringLock.unlock();
+        m_ring = r;
+    }
+    return m_ring;
+}
+
+void tracer::record(uint32_t id, int stage, char phase){
+    recordAt(id, stage, phase, now());
+}
+
+void tracer::recordAt(uint32_t id, int stage, char phase, uint64_t ts){
+    ring* r = localRing();
+    uint64_t pos = r->pos.load(std::memory_order_relaxed);
+    traceEvent& e = r->events[pos & (TRACE_RING_SIZE - 1)];
+    e.ts = ts;
+    e.id = id;
+    e.stage = stage;
+    e.phase = phase;
+    e.thread = r->thread;
+    r->pos.store(pos + 1, std::memory_order_release);
+}
+
+void tracer::requestDump(int){
+    m_dumpRequested = 1;
+}
+
+/*
+    文件格式(本机字节序)：
+        "WSTRACE\0"  uint32 版本  uint32 线程数
+        每个线程：uint32 线程序号  uint32 事件数  traceEvent[事件数]，按时间先后
+    导出时其他线程仍在写入，正被覆盖的少量事件可能不完整
+*/
+bool tracer::dump(){
+    m_dumpRequested = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "trace-%d-%d.bin", (int)getpid(), m_dumpSeq++);
+    FILE* f = fopen(name, "wb");
+    if(!f){
+        perror("trace dump");
+        return false;
+    }
+    ringLock.lock();
+    std::vector<ring*> all = rings;
+    ringLock.unlock();
+    uint32_t head[2] = {1, (uint32_t)all.size()};
+    fwrite(TRACE_MAGIC, 1, 8, f);
+    fwrite(head, sizeof(head), 1, f);
+    for(size_t i = 0; i < all.size(); i++){
+        uint64_t end = all[i]->pos.load(std::memory_order_acquire);
+        uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+        uint32_t info[2] = {all[i]->thread, (uint32_t)(end - begin)};
+        fwrite(info, sizeof(info), 1, f);
+        for(uint64_t p = begin; p < end; p++){
+            fwrite(&all[i]->events[p & (TRACE_RING_SIZE - 1)], sizeof(traceEvent), 1, f);
+        }
+    }
+    bool ok = fclose(f) == 0;
+    printf("trace written to %s\n", name);
+    return ok;
+}
+
+bool tracer::convert(const char* file, FILE* out){
+    FILE* f = fopen(file, "rb");
+    if(!f){
+        return false;
+    }
+    char magic[8];
+    uint32_t head[2];
+    if(fread(magic, 1, 8, f) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0 || fread(head, sizeof(head), 1, f) != 1 || head[0] != 1){
+        fclose(f);
+        return false;
+    }
+    // 异步事件(b/e)按id配对，同一请求的阶段可以在不同线程开始和结束
+    fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+    for(uint32_t t = 0; t < head[1]; t++){
+        uint32_t info[2];
+        if(fread(info, sizeof(info), 1, f) != 1){
+            break;
+        }
+        for(uint32_t i = 0; i < info[1]; i++){
+            traceEvent e;
+            if(fread(&e, sizeof(e), 1, f) != 1){
+                break;
+            }
+            if(e.stage >= STAGE_COUNT || (e.phase != 'b' && e.phase != 'e')){
+                continue;
+            }
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"%c\",\"id\":%u,\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                first ? "" : ",\n", stageNames[e.stage], e.phase, e.id, e.thread, e.ts / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,71 @@
+// 请求追踪：按采样率选中的请求在各阶段开始和结束时记录时间戳，写入每个线程的环形缓冲，
+// 收到SIGUSR2时由reactor导出为二进制文件，-T参数将其转换为Chrome trace JSON(chrome://tracing或Perfetto打开)
+#ifndef TRACER_H
+#define TRACER_H
+#include <stdint.h>
+#include <stdio.h>
+#include <signal.h>
+#include <atomic>
+#include <vector>
+#include "locker.h"
+
+#define TRACE_RING_SIZE 16384                   // 每个线程保留的事件数，须为2的幂
+#define TRACE_MAGIC "WSTRACE"
+
+// 16字节的事件记录，二进制文件中原样保存
+struct traceEvent{
+    uint64_t ts;                                // CLOCK_MONOTONIC，纳秒
+    uint32_t id;                                // 请求的追踪ID
+    uint8_t stage;
+    uint8_t phase;                              // 'b'开始，'e'结束
+    uint16_t thread;
+};
+
+class tracer{
+    public:
+        // 请求的阶段：跨线程的阶段(如线程池排队)在1个线程开始、另1个线程结束
+        enum STAGE { REQUEST = 0, DISPATCH, READ, PARSE, QUEUE, HANDLER, DISK, WRITE, STAGE_COUNT };
+
+        static void init(int sampleEvery);      // 每sampleEvery个请求追踪1个，0表示关闭
+
+        static bool enabled(){ return m_sampleEvery > 0; }
+
+        // 请求开始时调用：选中时返回非0的追踪ID，未选中返回0，之后各阶段的记录只判断ID
+        static uint32_t sample();
+
+        static void record(uint32_t id, int stage, char phase);
+        static void recordAt(uint32_t id, int stage, char phase, uint64_t ts);
+
+        static uint64_t now();
+
+        // reactor在epoll_wait返回时记录时间，用于DISPATCH阶段：事件就绪到开始处理
+        static void wake(){ if(m_sampleEvery > 0){ m_wakeTime = now(); } }
+        static uint64_t wakeTime(){ return m_wakeTime; }
+
+        // SIGUSR2处理函数只设置标志，reactor在下一轮导出
+        static void requestDump(int);
+        static bool dumpRequested(){ return m_dumpRequested; }
+        static bool dump();                     // 写入trace-进程号-序号.bin
+
+        static bool convert(const char* file, FILE* out); // 二进制文件转换为Chrome trace JSON
+
+    private:
+        struct ring{
+            traceEvent events[TRACE_RING_SIZE];
+            std::atomic<uint64_t> pos;          // 已写入的事件总数，只由所属线程写
+            uint16_t thread;
+        };
+
+        static ring* localRing();
+
+        static int m_sampleEvery;
+        static std::atomic<uint32_t> m_counter;
+        static uint64_t m_wakeTime;
+        static volatile sig_atomic_t m_dumpRequested;
+        static int m_dumpSeq;
+        static locker ringLock;
+        static std::vector<ring*> rings;
+        static thread_local ring* m_ring;
+};
+
+#endif
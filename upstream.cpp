@@ -0,0 +1,238 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "upstream.h"
+#include "listener.h"
+#include "fileCache.h"
+#include "httpConnect.h"
+
+std::vector<std::unique_ptr<upstream::group> > upstream::groups;
+threadPool<httpConnect>* upstream::pool = NULL;
+thread_local std::unordered_map<backend*, std::vector<int> > upstream::idle;
+thread_local int upstream::pipeFds[2] = {-1, -1};
+
+int chunkScanner::feed(const char* p, int n, std::string* decoded){
+    int i = 0;
+    while(i < n && state != CHUNK_DONE){
+        char c = p[i];
+        switch(state){
+            case CHUNK_SIZE:
+                if(isxdigit(c)){
+                    if(++digits > 15){
+                        return -1;
+                    }
+                    remain = remain * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+                }else if(c == '\n'){
+                    if(digits == 0){
+                        return -1;
+                    }
+                    state = remain == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                    lineLen = 0;
+                }else if(digits == 0){
+                    return -1;
+                }else{
+                    // ;扩展或\r，忽略到行尾
+                    state = CHUNK_EXT;
+                }
+                i++;
+                break;
+            case CHUNK_EXT:
+                if(c == '\n'){
+                    state = remain == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                    lineLen = 0;
+                }
+                i++;
+                break;
+            case CHUNK_DATA:{
+                int m = n - i < remain ? n - i : remain;
+                if(decoded){
+                    decoded->append(p + i, m);
+                }
+                i += m;
+                remain -= m;
+                if(remain == 0){
+                    state = CHUNK_DATA_END;
+                }
+                break;
+            }
+            case CHUNK_DATA_END:
+                if(c == '\n'){
+                    state = CHUNK_SIZE;
+                    digits = 0;
+                }else if(c != '\r'){
+                    return -1;
+                }
+                i++;
+                break;
+            case CHUNK_TRAILER:
+                // trailer字段转发但不解析，空行结束
+                if(c == '\n'){
+                    if(lineLen == 0){
+                        state = CHUNK_DONE;
+                    }
+                    lineLen = 0;
+                }else if(c != '\r'){
+                    lineLen++;
+                }
+                i++;
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
+
+bool upstream::addGroup(const char* spec){
+    const char* eq = strchr(spec, '=');
+    if(groups.size() >= UPSTREAM_MAX_GROUPS || spec[0] != '/' || !eq || eq[-1] != '/'){
+        return false;
+    }
+    std::unique_ptr<group> g(new group);
+    g->prefix.assign(spec, eq - spec);
+    g->next = 0;
+    const char* p = eq + 1;
+    while(*p){
+        const char* comma = strchr(p, ',');
+        std::string address(p, comma ? comma - p : strlen(p));
+        p = comma ? comma + 1 : p + address.size();
+        // 地址格式与监听地址相同，只有端口时连接本机
+        listener l;
+        bool dualStack;
+        std::unique_ptr<backend> b(new backend);
+        if(!l.parse(address.c_str()) || (b->addrLen = l.resolve(b->addr, &dualStack)) == 0){
+            return false;
+        }
+        b->address = address;
+        b->outstanding = 0;
+        b->fails = 0;
+        b->downUntil = 0;
+        g->backends.push_back(std::move(b));
+    }
+    if(g->backends.empty()){
+        return false;
+    }
+    groups.push_back(std::move(g));
+    return true;
+}
+
+void upstream::init(int threadNum){
+    pool = new threadPool<httpConnect>(threadNum);
+}
+
+bool upstream::handoff(httpConnect* conn){
+    return pool && pool->append(conn);
+}
+
+int upstream::match(const char* url){
+    int best = -1;
+    size_t bestLen = 0;
+    for(size_t i = 0; i < groups.size(); i++){
+        const std::string& p = groups[i]->prefix;
+        if(p.size() > bestLen && strncmp(url, p.c_str(), p.size()) == 0){
+            best = i;
+            bestLen = p.size();
+        }
+    }
+    return best;
+}
+
+backend* upstream::pick(int g){
+    group* grp = groups[g].get();
+    long long now = fileCache::now();
+    size_t cnt = grp->backends.size();
+    size_t start = grp->next.fetch_add(1, std::memory_order_relaxed);
+    backend* best = NULL;
+    backend* fallback = NULL;
+    for(size_t i = 0; i < cnt; i++){
+        backend* b = grp->backends[(start + i) % cnt].get();
+        int load = b->outstanding.load(std::memory_order_relaxed);
+        if(!fallback || load < fallback->outstanding.load(std::memory_order_relaxed)){
+            fallback = b;
+        }
+        if(b->downUntil.load(std::memory_order_relaxed) > now){
+            continue;
+        }
+        if(!best || load < best->outstanding.load(std::memory_order_relaxed)){
+            best = b;
+        }
+    }
+    // 全部后端都在暂停期内时仍然尝试，不直接返回502
+    if(!best){
+        best = fallback;
+    }
+    best->outstanding++;
+    return best;
+}
+
+void upstream::done(backend* b, bool ok){
+    b->outstanding--;
+    if(ok){
+        b->fails.store(0, std::memory_order_relaxed);
+    }else if(++b->fails >= UPSTREAM_MAX_FAILS){
+        // 被动健康检查：连续失败后暂停使用，到期后由下一个请求重新探测
+        b->fails.store(0, std::memory_order_relaxed);
+        b->downUntil.store(fileCache::now() + UPSTREAM_FAIL_TIMEOUT, std::memory_order_relaxed);
+    }
+}
+
+int upstream::connectTo(backend* b){
+    int fd = socket(b->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        return -1;
+    }
+    // 阻塞socket，超时由SO_SNDTIMEO(含connect)和SO_RCVTIMEO控制
+    struct timeval tv = {UPSTREAM_TIMEOUT, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if(::connect(fd, (struct sockaddr*)&b->addr, b->addrLen) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int upstream::acquire(backend* b, bool* reused){
+    std::vector<int>& pool = idle[b];
+    while(!pool.empty()){
+        int fd = pool.back();
+        pool.pop_back();
+        // 空闲期间后端关闭了连接(可读到EOF)或发来了多余数据，都不能复用
+        char c;
+        if(recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == -1 && errno == EAGAIN){
+            *reused = true;
+            return fd;
+        }
+        close(fd);
+    }
+    *reused = false;
+    return connectTo(b);
+}
+
+void upstream::release(backend* b, int fd){
+    std::vector<int>& pool = idle[b];
+    if(pool.size() >= UPSTREAM_IDLE_PER_THREAD){
+        close(fd);
+        return;
+    }
+    pool.push_back(fd);
+}
+
+int* upstream::pipe(){
+    if(pipeFds[0] == -1 && pipe2(pipeFds, O_CLOEXEC) == -1){
+        pipeFds[0] = pipeFds[1] = -1;
+        return NULL;
+    }
+    return pipeFds;
+}
+
+void upstream::resetPipe(){
+    if(pipeFds[0] != -1){
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+}
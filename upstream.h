@@ -0,0 +1,95 @@
+// 反向代理：按路由前缀把请求转发到一组后端(TCP或Unix域socket)
+// 空闲的keep-alive后端连接按线程缓存，选择未完成请求最少的后端，连续失败的后端暂停使用一段时间
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include "threadPool.h"
+
+class httpConnect;
+
+#define UPSTREAM_MAX_GROUPS 16
+#define UPSTREAM_THREADS 16                     // 转发请求的专用线程数，等待后端和慢客户端时不占用工作线程
+#define UPSTREAM_IDLE_PER_THREAD 16             // 每个线程对每个后端缓存的空闲连接数
+#define UPSTREAM_TIMEOUT 30                     // 秒，连接、读写后端和等待客户端可写的超时
+#define UPSTREAM_MAX_FAILS 3                    // 连续失败次数达到后暂停使用该后端
+#define UPSTREAM_FAIL_TIMEOUT 10000             // 毫秒，暂停使用的时间
+#define UPSTREAM_HEADER_SIZE 16384              // 后端响应头上限
+#define UPSTREAM_H2_MAX_BODY (64 * 1024 * 1024) // HTTP/2客户端的响应体整体缓存，超过时返回502
+
+struct backend{
+    std::string address;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    std::atomic<int> outstanding;               // 正在转发的请求数
+    std::atomic<int> fails;                     // 连续失败次数
+    std::atomic<long long> downUntil;           // 暂停使用到此时间
+};
+
+// chunked响应体的分帧：转发给HTTP/1.1客户端时不解码，只找到结束位置；decoded非NULL时输出解码后的数据
+class chunkScanner{
+    public:
+        chunkScanner() : state(CHUNK_SIZE), remain(0), digits(0), lineLen(0){}
+
+        // 返回消耗的字节数，结束后不再消耗；格式错误返回-1
+        int feed(const char* p, int n, std::string* decoded);
+
+        bool done() const { return state == CHUNK_DONE; }
+
+    private:
+        enum { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER, CHUNK_DONE } state;
+        long remain;
+        int digits;
+        int lineLen;
+};
+
+class upstream{
+    public:
+        // 路由前缀=后端地址[,后端地址...]，前缀以'/'结尾：/api/=127.0.0.1:9000,[::1]:9001,unix:/tmp/app.sock
+        static bool addGroup(const char* spec);
+
+        static int groupCount(){ return groups.size(); }
+
+        static const std::string& prefix(int g){ return groups[g]->prefix; }
+
+        // 创建转发请求的专用线程，配置了后端时调用
+        static void init(int threadNum = UPSTREAM_THREADS);
+
+        // 工作线程调用：已解析的转发请求交给专用线程继续处理，未创建或队列已满时返回false，由调用者自行转发
+        static bool handoff(httpConnect* conn);
+
+        static int match(const char* url);      // 最长前缀匹配的组，-1表示没有
+
+        static backend* pick(int g);            // 未完成请求最少的可用后端，计入未完成请求
+
+        static void done(backend* b, bool ok);  // 请求结束，ok为false时计入连续失败
+
+        // 优先取本线程缓存的空闲连接；reused表示取到的是缓存连接，其可能已被后端关闭
+        static int acquire(backend* b, bool* reused);
+
+        static void release(backend* b, int fd); // 响应完整读完的keep-alive连接放回本线程缓存
+
+        static int* pipe();                     // 本线程splice用的管道，失败返回NULL
+
+        static void resetPipe();                // 管道中可能残留数据，重建
+
+    private:
+        struct group{
+            std::string prefix;
+            std::vector<std::unique_ptr<backend> > backends;
+            std::atomic<unsigned> next;         // 未完成请求数相同时轮转
+        };
+
+        static int connectTo(backend* b);
+
+        static std::vector<std::unique_ptr<group> > groups;
+        static threadPool<httpConnect>* pool;
+        static thread_local std::unordered_map<backend*, std::vector<int> > idle;
+        static thread_local int pipeFds[2];
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include "userStore.h"
+#include "sqlPool.h"
+
+rwlocker userStore::cacheLock;
+std::unordered_map<std::string, userStore::credential> userStore::cache;
+
+bool userStore::init(const char* dbFile, int connNum){
+    sqlPool* pool = sqlPool::getInstance();
+    if(!pool->init(dbFile, connNum)){
+        return false;
+    }
+    sqlite3* conn = NULL;
+    sqlConnRAII raii(&conn, pool);
+    const char* create = "CREATE TABLE IF NOT EXISTS user("
+                         "username TEXT PRIMARY KEY, salt BLOB NOT NULL, hash BLOB NOT NULL);";
+    if(sqlite3_exec(conn, create, NULL, NULL, NULL) != SQLITE_OK){
+        printf("create table: %s\n", sqlite3_errmsg(conn));
+        return false;
+    }
+
+    // 预加载全部凭据
+    sqlite3_stmt* stmt = NULL;
+    if(sqlite3_prepare_v2(conn, "SELECT username, salt, hash FROM user;", -1, &stmt, NULL) != SQLITE_OK){
+        return false;
+    }
+    cacheLock.wrlock();
+    while(sqlite3_step(stmt) == SQLITE_ROW){
+        credential cred;
+        if(sqlite3_column_bytes(stmt, 1) != PASSWORD_SALT_LEN || sqlite3_column_bytes(stmt, 2) != PASSWORD_HASH_LEN){
+            continue;
+        }
+        memcpy(cred.salt, sqlite3_column_blob(stmt, 1), PASSWORD_SALT_LEN);
+        memcpy(cred.hash, sqlite3_column_blob(stmt, 2), PASSWORD_HASH_LEN);
+        cache[(const char*)sqlite3_column_text(stmt, 0)] = cred;
+    }
+    cacheLock.unlock();
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+bool userStore::hashPassword(const char* password, const unsigned char* salt, unsigned char* hash){
+    return PKCS5_PBKDF2_HMAC(password, strlen(password), salt, PASSWORD_SALT_LEN, PASSWORD_ITERATIONS,
+                             EVP_sha256(), PASSWORD_HASH_LEN, hash) == 1;
+}
+
+bool userStore::query(const char* name, credential* cred){
+    sqlite3* conn = NULL;
+    sqlConnRAII raii(&conn, sqlPool::getInstance());
+    if(!conn){
+        return false;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if(sqlite3_prepare_v2(conn, "SELECT salt, hash FROM user WHERE username = ?;", -1, &stmt, NULL) != SQLITE_OK){
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    bool found = false;
+    if(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_bytes(stmt, 0) == PASSWORD_SALT_LEN
+        && sqlite3_column_bytes(stmt, 1) == PASSWORD_HASH_LEN){
+        memcpy(cred->salt, sqlite3_column_blob(stmt, 0), PASSWORD_SALT_LEN);
+        memcpy(cred->hash, sqlite3_column_blob(stmt, 1), PASSWORD_HASH_LEN);
+        found = true;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// 校验用户名和密码
+userStore::RESULT userStore::verify(const char* name, const char* password){
+    credential cred;
+    bool found = false;
+    cacheLock.rdlock();
+    std::unordered_map<std::string, credential>::iterator it = cache.find(name);
+    if(it != cache.end()){
+        cred = it->second;
+        found = true;
+    }
+    cacheLock.unlock();
+
+    if(!found){
+        // 可能由其他进程注册，查询数据库后加入缓存
+        if(!query(name, &cred)){
+            // 用户不存在时同样计算1次哈希，响应时间不泄露用户名是否存在
+            static const unsigned char dummySalt[PASSWORD_SALT_LEN] = {0};
+            unsigned char hash[PASSWORD_HASH_LEN];
+            hashPassword(password, dummySalt, hash);
+            return USER_FAIL;
+        }
+        cacheLock.wrlock();
+        cache[name] = cred;
+        cacheLock.unlock();
+    }
+
+    // 哈希计算在锁外进行
+    unsigned char hash[PASSWORD_HASH_LEN];
+    if(!hashPassword(password, cred.salt, hash)){
+        return USER_ERROR;
+    }
+    return CRYPTO_memcmp(hash, cred.hash, PASSWORD_HASH_LEN) == 0 ? USER_OK : USER_FAIL;
+}
+
+// 注册新用户
+userStore::RESULT userStore::add(const char* name, const char* password){
+    cacheLock.rdlock();
+    bool exists = cache.count(name) > 0;
+    cacheLock.unlock();
+    if(exists){
+        return USER_EXISTS;
+    }
+
+    credential cred;
+    if(RAND_bytes(cred.salt, PASSWORD_SALT_LEN) != 1 || !hashPassword(password, cred.salt, cred.hash)){
+        return USER_ERROR;
+    }
+
+    sqlite3* conn = NULL;
+    sqlConnRAII raii(&conn, sqlPool::getInstance());
+    if(!conn){
+        return USER_ERROR;
+    }
+    sqlite3_stmt* stmt = NULL;
+    if(sqlite3_prepare_v2(conn, "INSERT INTO user(username, salt, hash) VALUES(?, ?, ?);", -1, &stmt, NULL) != SQLITE_OK){
+        return USER_ERROR;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 2, cred.salt, PASSWORD_SALT_LEN, SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 3, cred.hash, PASSWORD_HASH_LEN, SQLITE_STATIC);
+    int ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(ret == SQLITE_CONSTRAINT){
+        // 并发注册同名用户，主键冲突
+        return USER_EXISTS;
+    }
+    if(ret != SQLITE_DONE){
+        return USER_ERROR;
+    }
+
+    cacheLock.wrlock();
+    cache[name] = cred;
+    cacheLock.unlock();
+    return USER_OK;
+}
@@ -0,0 +1,45 @@
+// 用户存储：sqlite文件持久化，内存中缓存全部凭据，读多写少
+#ifndef USERSTORE_H
+#define USERSTORE_H
+#include <string>
+#include <unordered_map>
+#include "locker.h"
+
+#define USER_NAME_LEN 32                        // 用户名最大长度
+#define USER_PASSWORD_LEN 64                    // 密码最大长度
+#define PASSWORD_SALT_LEN 16
+#define PASSWORD_HASH_LEN 32
+#define PASSWORD_ITERATIONS 4096                // PBKDF2迭代次数
+
+class userStore{
+    public:
+        /*
+            USER_OK         :   登录成功或注册成功
+            USER_FAIL       :   用户不存在或密码错误
+            USER_EXISTS     :   注册时用户名已存在
+            USER_ERROR      :   数据库错误
+        */
+        enum RESULT { USER_OK = 0, USER_FAIL, USER_EXISTS, USER_ERROR };
+
+        // 打开数据库，建表并加载全部凭据到缓存
+        static bool init(const char* dbFile, int connNum = 8);
+
+        // 以下函数计算密码哈希，须在工作线程调用，不能在reactor线程调用
+        static RESULT verify(const char* name, const char* password);
+
+        static RESULT add(const char* name, const char* password);
+
+    private:
+        struct credential{
+            unsigned char salt[PASSWORD_SALT_LEN];
+            unsigned char hash[PASSWORD_HASH_LEN];
+        };
+
+        static bool hashPassword(const char* password, const unsigned char* salt, unsigned char* hash);
+        static bool query(const char* name, credential* cred);  // 缓存未命中时查询数据库
+
+        static rwlocker cacheLock;
+        static std::unordered_map<std::string, credential> cache;
+};
+
+#endif
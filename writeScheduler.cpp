@@ -0,0 +1,83 @@
+#include "writeScheduler.h"
+#include "httpConnect.h"
+
+std::list<writeScheduler::flow> writeScheduler::active;
+unsigned int writeScheduler::m_connRate = 0;
+double writeScheduler::m_totalRate = 0;
+double writeScheduler::m_tokens = 0;
+long long writeScheduler::m_stamp = 0;
+
+void writeScheduler::init(unsigned int connRate, long long totalRate){
+    m_connRate = connRate;
+    m_totalRate = totalRate / 1000.0;
+    m_tokens = WRITE_QUANTUM;
+    m_stamp = fileCache::now();
+}
+
+void writeScheduler::add(httpConnect* conn){
+    active.push_back({conn, 0});
+}
+
+// 总速率令牌最多积累100毫秒，避免空闲后突发
+void writeScheduler::refill(){
+    if(m_totalRate <= 0){
+        return;
+    }
+    long long cur = fileCache::now();
+    m_tokens += (cur - m_stamp) * m_totalRate;
+    m_stamp = cur;
+    double burst = m_totalRate * 100 > WRITE_QUANTUM ? m_totalRate * 100 : WRITE_QUANTUM;
+    if(m_tokens > burst){
+        m_tokens = burst;
+    }
+}
+
+void writeScheduler::run(){
+    refill();
+    // 本轮只处理当前队列中的连接，配额用完的连接排到队尾等下一轮
+    size_t n = active.size();
+    for(size_t i = 0; i < n && !active.empty(); i++){
+        flow f = active.front();
+        active.pop_front();
+        bool limited = m_totalRate > 0 && f.conn->paced();
+        if(limited && m_tokens <= 0){
+            // 总速率用完，大文件响应等待令牌补充，小响应不受影响
+            active.push_back(f);
+            continue;
+        }
+        f.deficit += WRITE_QUANTUM;
+        if(!f.conn->write(f.deficit)){
+            // 写数据失败
+            f.conn->closeConnect();
+            continue;
+        }
+        if(limited){
+            m_tokens -= f.conn->lastWritten();
+        }
+        if(f.conn->writeMore()){
+            f.deficit -= f.conn->lastWritten();
+            active.push_back(f);
+        }
+        // 否则响应已发送完或socket写满，连接已重新注册事件，不再积累额度
+    }
+}
+
+int writeScheduler::nextTimeout(int timeout){
+    if(active.empty()){
+        return timeout;
+    }
+    int wait = 0;
+    if(m_totalRate > 0){
+        refill();
+        if(m_tokens <= 0){
+            wait = (int)(-m_tokens / m_totalRate) + 1;
+            for(auto& f : active){
+                if(!f.conn->paced()){
+                    wait = 0;
+                    break;
+                }
+            }
+        }
+    }
+    return timeout == -1 || wait < timeout ? wait : timeout;
+}
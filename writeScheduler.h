@@ -0,0 +1,43 @@
+// 写调度：reactor中按差额轮转(DRR)发送响应，每轮每个连接最多发送1个配额，大文件下载不阻塞小响应
+#ifndef WRITESCHEDULER_H
+#define WRITESCHEDULER_H
+#include <stddef.h>
+#include <list>
+
+#define WRITE_QUANTUM (64 * 1024)               // 每轮每个连接增加的发送额度
+#define PACE_MIN_SIZE (256 * 1024)              // 响应体达到此大小时按单连接速率限速
+
+class httpConnect;
+
+class writeScheduler{
+    public:
+        // connRate：单连接速率，由内核按SO_MAX_PACING_RATE平滑发送；totalRate：全部大文件响应的总速率；单位字节/秒，0表示不限
+        static void init(unsigned int connRate, long long totalRate);
+
+        static unsigned int connRate(){ return m_connRate; }
+
+        // reactor调用：连接可写或配额用完仍有数据，加入轮转队列
+        static void add(httpConnect* conn);
+
+        // reactor每轮事件处理后调用：队列中的连接各发送1个配额
+        static void run();
+
+        // 队列非空且总速率有余量时为0，总速率用完时为补充所需时间，与timeout取较小值
+        static int nextTimeout(int timeout);
+
+    private:
+        struct flow{
+            httpConnect* conn;
+            size_t deficit;                     // 累积的发送额度
+        };
+
+        static void refill();
+
+        static std::list<flow> active;
+        static unsigned int m_connRate;
+        static double m_totalRate;              // 字节/毫秒
+        static double m_tokens;                 // 总速率令牌，可透支1轮的发送量
+        static long long m_stamp;
+};
+
+#endif